@@ -0,0 +1,273 @@
+/*===========================================================================*\
+*                                                                            *
+*                              OpenFlipper                                   *
+*      Copyright (C) 2001-2014 by Computer Graphics Group, RWTH Aachen       *
+*                           www.openflipper.org                              *
+*                                                                            *
+*--------------------------------------------------------------------------- *
+*  This file is part of OpenFlipper.                                         *
+*                                                                            *
+*  OpenFlipper is free software: you can redistribute it and/or modify       *
+*  it under the terms of the GNU Lesser General Public License as            *
+*  published by the Free Software Foundation, either version 3 of            *
+*  the License, or (at your option) any later version with the               *
+*  following exceptions:                                                     *
+*                                                                            *
+*  If other files instantiate templates or use macros                        *
+*  or inline functions from this file, or you compile this file and          *
+*  link it with other files to produce an executable, this file does         *
+*  not by itself cause the resulting executable to be covered by the         *
+*  GNU Lesser General Public License. This exception does not however        *
+*  invalidate any other reasons why the executable file might be             *
+*  covered by the GNU Lesser General Public License.                         *
+*                                                                            *
+*  OpenFlipper is distributed in the hope that it will be useful,            *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+*  GNU Lesser General Public License for more details.                       *
+*                                                                            *
+*  You should have received a copy of the GNU LesserGeneral Public           *
+*  License along with OpenFlipper. If not,                                   *
+*  see <http://www.gnu.org/licenses/>.                                       *
+*                                                                            *
+\*===========================================================================*/
+
+#include "PoissonMeshCache.hh"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+#include <algorithm>
+
+namespace {
+
+const quint32 CACHE_MAGIC   = 0x31435250; // "PRC1" in little endian, files of the other byte order do not match
+const quint32 CACHE_VERSION = 1;
+
+/// Header of a cache entry, followed by the positions, the normals (if hasNormals is set) and the triangles
+struct CacheHeader
+{
+  quint32 magic;
+  quint32 version;
+  qint64  lastUse;     // milliseconds since the epoch, updated on every hit
+  quint32 vertexCount;
+  quint32 faceCount;
+  quint32 hasNormals;
+  quint32 reserved;
+};
+
+qint64 entrySize(const CacheHeader& _header)
+{
+  return qint64(sizeof(CacheHeader)) + qint64(_header.vertexCount) * 3 * sizeof(float) * (_header.hasNormals ? 2 : 1)
+                                     + qint64(_header.faceCount) * 3 * sizeof(quint32);
+}
+
+bool readHeader(QFile& _file, CacheHeader& _header)
+{
+  return _file.read(reinterpret_cast< char* >(&_header), sizeof(_header)) == qint64(sizeof(_header)) &&
+         _header.magic == CACHE_MAGIC && _header.version == CACHE_VERSION && _file.size() == entrySize(_header);
+}
+
+}
+
+PoissonMeshCache::PoissonMeshCache() :
+    enabled_(false),
+    maxSize_(qint64(256) << 20)
+{
+}
+
+void PoissonMeshCache::setMaxSize(qint64 _bytes)
+{
+  maxSize_ = std::max< qint64 >(_bytes, 0);
+  evict();
+}
+
+void PoissonMeshCache::addData(QCryptographicHash& _hash, const char* _data, size_t _size, size_t _maxChunk)
+{
+  // above 2 GiB a single call would truncate the length and hash only part of the points
+  while ( _size > 0 )
+  {
+    const size_t chunk = std::min(_size, _maxChunk);
+    _hash.addData(_data, int(chunk));
+    _data += chunk;
+    _size -= chunk;
+  }
+}
+
+QByteArray PoissonMeshCache::key(const std::vector< float >& _pt_data, const QByteArray& _parameters)
+{
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+
+  if ( !_pt_data.empty() )
+    addData(hash, reinterpret_cast< const char* >(&_pt_data[0]), _pt_data.size() * sizeof(float));
+
+  QByteArray version;
+  QDataStream stream(&version, QIODevice::WriteOnly);
+  stream << quint32(CACHE_VERSION);
+  hash.addData(version);
+  hash.addData(_parameters);
+
+  return hash.result().toHex();
+}
+
+QString PoissonMeshCache::fileName(const QByteArray& _key) const
+{
+  return QDir(directory_).filePath(QString::fromLatin1(_key) + ".prc");
+}
+
+bool PoissonMeshCache::load(const QByteArray& _key, TriMesh& _mesh)
+{
+  if ( !enabled_ || directory_.isEmpty() )
+    return false;
+
+  QFile file(fileName(_key));
+  if ( !file.open(QIODevice::ReadOnly) )
+    return false;
+
+  CacheHeader header;
+  if ( !readHeader(file, header) )
+    return false;
+
+  std::vector< float > points(size_t(header.vertexCount) * 3), normals(header.hasNormals ? points.size() : 0);
+  std::vector< quint32 > faces(size_t(header.faceCount) * 3);
+  if ( ( !points.empty()  && file.read(reinterpret_cast< char* >(&points[0]),  qint64(points.size()  * sizeof(float)))   != qint64(points.size()  * sizeof(float)) ) ||
+       ( !normals.empty() && file.read(reinterpret_cast< char* >(&normals[0]), qint64(normals.size() * sizeof(float)))   != qint64(normals.size() * sizeof(float)) ) ||
+       ( !faces.empty()   && file.read(reinterpret_cast< char* >(&faces[0]),   qint64(faces.size()   * sizeof(quint32))) != qint64(faces.size()   * sizeof(quint32)) ) )
+    return false;
+
+  for ( size_t i = 0 ; i < faces.size() ; ++i )
+    if ( faces[i] >= header.vertexCount )
+      return false;
+
+  _mesh.clear();
+  _mesh.reserve(header.vertexCount, size_t(header.faceCount) * 3 / 2, header.faceCount);
+
+  const bool setNormals = !normals.empty() && _mesh.has_vertex_normals();
+  for ( size_t i = 0 ; i < points.size() ; i += 3 ) {
+    TriMesh::VertexHandle vh = _mesh.add_vertex( TriMesh::Point(points[i], points[i+1], points[i+2]) );
+    if ( setNormals )
+      _mesh.set_normal( vh, TriMesh::Normal(normals[i], normals[i+1], normals[i+2]) );
+  }
+  for ( size_t i = 0 ; i < faces.size() ; i += 3 )
+    _mesh.add_face( _mesh.vertex_handle(int(faces[i])), _mesh.vertex_handle(int(faces[i+1])), _mesh.vertex_handle(int(faces[i+2])) );
+
+  if ( !setNormals )
+    _mesh.update_normals();
+  else if ( _mesh.has_face_normals() )
+    _mesh.update_face_normals();
+
+  // Stamp the entry as used, a read-only cache still works but evicts by the time of the store
+  file.close();
+  header.lastUse = QDateTime::currentMSecsSinceEpoch();
+  if ( file.open(QIODevice::ReadWrite) )
+    file.write(reinterpret_cast< const char* >(&header), sizeof(header));
+
+  return true;
+}
+
+bool PoissonMeshCache::store(const QByteArray& _key, const TriMesh& _mesh)
+{
+  if ( !enabled_ || directory_.isEmpty() || !QDir().mkpath(directory_) )
+    return false;
+
+  CacheHeader header;
+  header.magic       = CACHE_MAGIC;
+  header.version     = CACHE_VERSION;
+  header.lastUse     = QDateTime::currentMSecsSinceEpoch();
+  header.vertexCount = quint32(_mesh.n_vertices());
+  header.faceCount   = quint32(_mesh.n_faces());
+  header.hasNormals  = _mesh.has_vertex_normals() ? 1 : 0;
+  header.reserved    = 0;
+
+  // Entries larger than the whole cache are not worth keeping
+  if ( entrySize(header) > maxSize_ )
+    return false;
+
+  std::vector< float > points, normals;
+  std::vector< quint32 > faces;
+  points.reserve(size_t(header.vertexCount) * 3);
+  if ( header.hasNormals )
+    normals.reserve(points.capacity());
+  for ( TriMesh::ConstVertexIter v_it = _mesh.vertices_begin() ; v_it != _mesh.vertices_end() ; ++v_it ) {
+    const TriMesh::Point& p = _mesh.point(*v_it);
+    points.push_back(float(p[0])); points.push_back(float(p[1])); points.push_back(float(p[2]));
+    if ( header.hasNormals ) {
+      const TriMesh::Normal& n = _mesh.normal(*v_it);
+      normals.push_back(float(n[0])); normals.push_back(float(n[1])); normals.push_back(float(n[2]));
+    }
+  }
+  faces.reserve(size_t(header.faceCount) * 3);
+  for ( TriMesh::ConstFaceIter f_it = _mesh.faces_begin() ; f_it != _mesh.faces_end() ; ++f_it )
+    for ( TriMesh::ConstFaceVertexIter fv_it = _mesh.cfv_iter(*f_it) ; fv_it.is_valid() ; ++fv_it )
+      faces.push_back(quint32(fv_it->idx()));
+  if ( faces.size() != size_t(header.faceCount) * 3 )
+    return false;
+
+  // Write to a temporary file first, so that an interrupted store never leaves a truncated entry behind
+  const QString name = fileName(_key);
+  QFile file(name + ".tmp");
+  if ( !file.open(QIODevice::WriteOnly | QIODevice::Truncate) )
+    return false;
+
+  bool ok = file.write(reinterpret_cast< const char* >(&header), sizeof(header)) == qint64(sizeof(header));
+  if ( ok && !points.empty() )
+    ok = file.write(reinterpret_cast< const char* >(&points[0]),  qint64(points.size()  * sizeof(float)))   == qint64(points.size()  * sizeof(float));
+  if ( ok && !normals.empty() )
+    ok = file.write(reinterpret_cast< const char* >(&normals[0]), qint64(normals.size() * sizeof(float)))   == qint64(normals.size() * sizeof(float));
+  if ( ok && !faces.empty() )
+    ok = file.write(reinterpret_cast< const char* >(&faces[0]),   qint64(faces.size()   * sizeof(quint32))) == qint64(faces.size()   * sizeof(quint32));
+  file.close();
+
+  QFile::remove(name);
+  if ( !ok || !file.rename(name) ) {
+    file.remove();
+    return false;
+  }
+
+  evict();
+
+  return true;
+}
+
+void PoissonMeshCache::clear()
+{
+  if ( directory_.isEmpty() )
+    return;
+
+  QDir dir(directory_);
+  QStringList entries = dir.entryList(QStringList() << "*.prc" << "*.prc.tmp", QDir::Files);
+  for ( int i = 0 ; i < entries.size() ; ++i )
+    dir.remove(entries[i]);
+}
+
+void PoissonMeshCache::evict()
+{
+  if ( directory_.isEmpty() )
+    return;
+
+  QFileInfoList entries = QDir(directory_).entryInfoList(QStringList() << "*.prc", QDir::Files);
+
+  // (last use, index into entries); unreadable entries count as never used
+  std::vector< std::pair< qint64, int > > uses;
+  qint64 totalSize = 0;
+  for ( int i = 0 ; i < entries.size() ; ++i ) {
+    QFile file(entries[i].filePath());
+    CacheHeader header;
+    qint64 lastUse = -1;
+    if ( file.open(QIODevice::ReadOnly) && readHeader(file, header) )
+      lastUse = header.lastUse;
+    uses.push_back(std::make_pair(lastUse, i));
+    totalSize += entries[i].size();
+  }
+
+  std::sort(uses.begin(), uses.end());
+  for ( size_t i = 0 ; i < uses.size() && totalSize > maxSize_ ; ++i ) {
+    const QFileInfo& entry = entries[uses[i].second];
+    if ( QFile::remove(entry.filePath()) )
+      totalSize -= entry.size();
+  }
+}
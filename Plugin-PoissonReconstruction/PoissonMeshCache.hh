@@ -0,0 +1,97 @@
+/*===========================================================================*\
+*                                                                            *
+*                              OpenFlipper                                   *
+*      Copyright (C) 2001-2014 by Computer Graphics Group, RWTH Aachen       *
+*                           www.openflipper.org                              *
+*                                                                            *
+*--------------------------------------------------------------------------- *
+*  This file is part of OpenFlipper.                                         *
+*                                                                            *
+*  OpenFlipper is free software: you can redistribute it and/or modify       *
+*  it under the terms of the GNU Lesser General Public License as            *
+*  published by the Free Software Foundation, either version 3 of            *
+*  the License, or (at your option) any later version with the               *
+*  following exceptions:                                                     *
+*                                                                            *
+*  If other files instantiate templates or use macros                        *
+*  or inline functions from this file, or you compile this file and          *
+*  link it with other files to produce an executable, this file does         *
+*  not by itself cause the resulting executable to be covered by the         *
+*  GNU Lesser General Public License. This exception does not however        *
+*  invalidate any other reasons why the executable file might be             *
+*  covered by the GNU Lesser General Public License.                         *
+*                                                                            *
+*  OpenFlipper is distributed in the hope that it will be useful,            *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+*  GNU Lesser General Public License for more details.                       *
+*                                                                            *
+*  You should have received a copy of the GNU LesserGeneral Public           *
+*  License along with OpenFlipper. If not,                                   *
+*  see <http://www.gnu.org/licenses/>.                                       *
+*                                                                            *
+\*===========================================================================*/
+
+#pragma once
+
+#include <QString>
+#include <QByteArray>
+#include <QCryptographicHash>
+
+#include <ObjectTypes/TriangleMesh/TriangleMesh.hh>
+
+#include <vector>
+#include <limits>
+
+/** On-disk cache of reconstructed meshes, addressed by a hash of the input points and the reconstruction parameters.
+ *
+ * Every entry is a file <key>.prc in the cache directory: a small header followed by the vertex positions
+ * and normals as floats and the triangles as 32-bit vertex indices. Loading an entry stamps it as used, and
+ * once the entries exceed the size limit the least recently used ones are removed.
+ */
+class PoissonMeshCache
+{
+public:
+  PoissonMeshCache();
+
+  /// Enables or disables lookups and stores, the entries on disk are kept
+  void setEnabled(bool _enabled) { enabled_ = _enabled; }
+  bool enabled() const { return enabled_; }
+
+  /// Directory holding the entries, created when the first entry is stored
+  void setDirectory(const QString& _directory) { directory_ = _directory; }
+  const QString& directory() const { return directory_; }
+
+  /// Size limit of all entries together in bytes, entries are evicted when it is exceeded
+  void setMaxSize(qint64 _bytes);
+  qint64 maxSize() const { return maxSize_; }
+
+  /** Hash of the points (positions and normals, as passed to the reconstruction) and of the serialized
+   * reconstruction parameters. The caller serializes only the parameters that change the resulting mesh,
+   * so that this class does not depend on the reconstruction itself.
+   */
+  static QByteArray key(const std::vector< float >& _pt_data, const QByteArray& _parameters);
+
+  /// Adds _size bytes to _hash in chunks of at most _maxChunk bytes, as QCryptographicHash::addData takes an int length
+  static void addData(QCryptographicHash& _hash, const char* _data, size_t _size,
+                      size_t _maxChunk = size_t(std::numeric_limits< int >::max()));
+
+  /// Replaces _mesh by the cached mesh of _key, returns false if there is none
+  bool load(const QByteArray& _key, TriMesh& _mesh);
+
+  /// Stores _mesh as the result of _key and evicts old entries if the cache got too large
+  bool store(const QByteArray& _key, const TriMesh& _mesh);
+
+  /// Removes all entries
+  void clear();
+
+private:
+  QString fileName(const QByteArray& _key) const;
+
+  /// Removes the least recently used entries until the cache fits its size limit
+  void evict();
+
+  bool enabled_;
+  QString directory_;
+  qint64 maxSize_;
+};
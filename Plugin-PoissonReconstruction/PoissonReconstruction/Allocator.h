@@ -30,6 +30,15 @@ DAMAGE.
 #define ALLOCATOR_INCLUDED
 #include <vector>
 
+// Storage class for state that is private to a thread, so that independent reconstructions can run concurrently
+#ifndef POISSON_THREAD_LOCAL
+#if defined( _MSC_VER )
+#define POISSON_THREAD_LOCAL __declspec( thread )
+#else
+#define POISSON_THREAD_LOCAL __thread
+#endif
+#endif
+
 class AllocatorState{
 public:
 	int index,remains;
@@ -78,7 +87,7 @@ public:
 	void rollBack(void){
 		if( !memory.empty() ){
 			for(size_t i=0;i<memory.size();i++){
-				for(int j=0;j<blockSize;j++){
+				for(size_t j=0;j<blockSize;j++){
 					memory[i][j].~T();
 					new(&memory[i][j]) T();
 				}
@@ -30,6 +30,7 @@ DAMAGE.
 #define BSPLINE_DATA_INCLUDED
 
 
+#include <map>
 #include "PPolynomial.h"
 #include "Array.h"
 
@@ -80,6 +81,64 @@ class BSplineData
 {
   bool useDotRatios;
   int boundaryType;
+
+  // The dot-product and value tables only depend on the degree (and precision), the depth,
+  // the boundary type and the evaluation parameters. They are computed once per process and
+  // shared read-only between all instances, so the member table pointers never own memory.
+  // An entry takes about 2*F^2 Reals for the dot tables and 2*F*S Reals for the value tables,
+  // with F=2^(depth+1)-1 functions and S~2^(depth+1) samples, i.e. hundreds of MB at depth 11-12.
+  // Each cache therefore keeps at most TableCacheEntries entries, evicting the least recently
+  // used ones that no instance references, and ClearTableCache frees the unreferenced ones
+  // once a reconstruction is done.
+  static const int TableCacheEntries = 4;
+  struct DotTableKey
+  {
+    int depth , boundaryType;
+    bool useDotRatios , inset;
+    DotTableKey( void ) : depth(-1) , boundaryType(0) , useDotRatios(false) , inset(false) {}
+    DotTableKey( int d , int b , bool r , bool i ) : depth(d) , boundaryType(b) , useDotRatios(r) , inset(i) {}
+    bool operator < ( const DotTableKey& key ) const;
+  };
+  struct DotTables
+  {
+    Pointer( Real ) vv;
+    Pointer( Real ) dv;
+    Pointer( Real ) dd;
+    int references;
+    unsigned long long lastUse;
+    DotTables( void ) { vv = dv = dd = NullPointer< Real >() ; references = 0 ; lastUse = 0; }
+    void release( void );
+  };
+  struct ValueTableKey
+  {
+    int depth , boundaryType;
+    double valueSmooth , derivativeSmooth;
+    ValueTableKey( void ) : depth(-1) , boundaryType(0) , valueSmooth(0) , derivativeSmooth(0) {}
+    ValueTableKey( int d , int b , double v , double dv ) : depth(d) , boundaryType(b) , valueSmooth(v) , derivativeSmooth(dv) {}
+    bool operator < ( const ValueTableKey& key ) const;
+  };
+  struct ValueTables
+  {
+    Pointer( Real ) values;
+    Pointer( Real ) dValues;
+    int references;
+    unsigned long long lastUse;
+    ValueTables( void ) { values = dValues = NullPointer< Real >() ; references = 0 ; lastUse = 0; }
+    void release( void );
+  };
+  static std::map< DotTableKey   , DotTables   >& _DotTableCache  ( void );
+  static std::map< ValueTableKey , ValueTables >& _ValueTableCache( void );
+  static unsigned long long _NextTableCacheUse( void );
+  template< class Key , class Tables >
+  static void _TrimTableCache( std::map< Key , Tables >& cache );
+
+  // The cache entries this instance holds a reference to
+  bool _hasDotKey , _hasValueKey;
+  DotTableKey _dotKey;
+  ValueTableKey _valueKey;
+
+  void _computeDotTables  ( int flags , bool inset , DotTables& tables ) const;
+  void _computeValueTables( int flags , double valueSmooth , double derivativeSmooth , ValueTables& tables ) const;
 public:
   struct BSplineComponents
   {
@@ -118,6 +177,12 @@ public:
   virtual void   setValueTables( int flags , double valueSmooth , double normalSmooth );
   virtual void clearValueTables( void );
 
+  /********************************************************
+   * Releases the process-wide dot-product and value tables
+   * that no BSplineData instance currently references.
+   ********************************************************/
+  static void ClearTableCache( void );
+
   void setSampleSpan( int idx , int& start , int& end , double smooth=0 ) const;
 
   /********************************************************
@@ -85,20 +85,95 @@ BSplineData<Degree,Real>::BSplineData( void ) :
 {
   vvDotTable = dvDotTable = ddDotTable = NullPointer< Real >();
   valueTables = dValueTables = NullPointer< Real >();
+  _hasDotKey = _hasValueKey = false;
 }
 
 template<int Degree,class Real>
 BSplineData< Degree , Real >::~BSplineData(void)
 {
-  if( functionCount )
+  // The tables are owned by the process-wide cache
+  clearDotTables( VV_DOT_FLAG | DV_DOT_FLAG | DD_DOT_FLAG );
+  clearValueTables();
+  functionCount = 0;
+}
+
+template< int Degree , class Real >
+bool BSplineData< Degree , Real >::DotTableKey::operator < ( const DotTableKey& key ) const
+{
+  if( depth!=key.depth ) return depth<key.depth;
+  if( boundaryType!=key.boundaryType ) return boundaryType<key.boundaryType;
+  if( useDotRatios!=key.useDotRatios ) return useDotRatios<key.useDotRatios;
+  return inset<key.inset;
+}
+template< int Degree , class Real >
+bool BSplineData< Degree , Real >::ValueTableKey::operator < ( const ValueTableKey& key ) const
+{
+  if( depth!=key.depth ) return depth<key.depth;
+  if( boundaryType!=key.boundaryType ) return boundaryType<key.boundaryType;
+  if( valueSmooth!=key.valueSmooth ) return valueSmooth<key.valueSmooth;
+  return derivativeSmooth<key.derivativeSmooth;
+}
+template< int Degree , class Real >
+std::map< typename BSplineData< Degree , Real >::DotTableKey , typename BSplineData< Degree , Real >::DotTables >& BSplineData< Degree , Real >::_DotTableCache( void )
+{
+  static std::map< DotTableKey , DotTables > cache;
+  return cache;
+}
+template< int Degree , class Real >
+std::map< typename BSplineData< Degree , Real >::ValueTableKey , typename BSplineData< Degree , Real >::ValueTables >& BSplineData< Degree , Real >::_ValueTableCache( void )
+{
+  static std::map< ValueTableKey , ValueTables > cache;
+  return cache;
+}
+template< int Degree , class Real >
+unsigned long long BSplineData< Degree , Real >::_NextTableCacheUse( void )
+{
+  // Only called inside the bspline_table_cache critical section
+  static unsigned long long use = 0;
+  return ++use;
+}
+template< int Degree , class Real >
+void BSplineData< Degree , Real >::DotTables::release( void )
+{
+  if( vv ) DeletePointer( vv );
+  if( dv ) DeletePointer( dv );
+  if( dd ) DeletePointer( dd );
+}
+template< int Degree , class Real >
+void BSplineData< Degree , Real >::ValueTables::release( void )
+{
+  if( values  ) DeletePointer( values  );
+  if( dValues ) DeletePointer( dValues );
+}
+template< int Degree , class Real >
+template< class Key , class Tables >
+void BSplineData< Degree , Real >::_TrimTableCache( std::map< Key , Tables >& cache )
+{
+  // Only called inside the bspline_table_cache critical section
+  while( cache.size()>size_t( TableCacheEntries ) )
   {
-    if( vvDotTable ) DeletePointer( vvDotTable );
-    if( dvDotTable ) DeletePointer( dvDotTable );
-    if( ddDotTable ) DeletePointer( ddDotTable );
-    if(  valueTables ) DeletePointer(  valueTables );
-    if( dValueTables ) DeletePointer( dValueTables );
+    typename std::map< Key , Tables >::iterator oldest = cache.end();
+    for( typename std::map< Key , Tables >::iterator iter=cache.begin() ; iter!=cache.end() ; iter++ )
+      if( !iter->second.references && ( oldest==cache.end() || iter->second.lastUse<oldest->second.lastUse ) ) oldest = iter;
+    if( oldest==cache.end() ) break;
+    oldest->second.release();
+    cache.erase( oldest );
+  }
+}
+template< int Degree , class Real >
+void BSplineData< Degree , Real >::ClearTableCache( void )
+{
+#pragma omp critical (bspline_table_cache)
+  {
+    std::map< DotTableKey , DotTables >& dotCache = _DotTableCache();
+    for( typename std::map< DotTableKey , DotTables >::iterator iter=dotCache.begin() ; iter!=dotCache.end() ; )
+      if( iter->second.references ) iter++;
+      else iter->second.release() , dotCache.erase( iter++ );
+    std::map< ValueTableKey , ValueTables >& valueCache = _ValueTableCache();
+    for( typename std::map< ValueTableKey , ValueTables >::iterator iter=valueCache.begin() ; iter!=valueCache.end() ; )
+      if( iter->second.references ) iter++;
+      else iter->second.release() , valueCache.erase( iter++ );
   }
-  functionCount = 0;
 }
 
 template<int Degree,class Real>
@@ -179,22 +254,48 @@ void BSplineData<Degree,Real>::set( int maxDepth , bool useDotRatios , int bound
 template<int Degree,class Real>
 void BSplineData<Degree,Real>::setDotTables( int flags , bool inset )
 {
+  DotTableKey key( depth , boundaryType , useDotRatios , inset );
+  // An instance references a single cache entry
+  if( _hasDotKey && ( _dotKey<key || key<_dotKey ) ) clearDotTables( VV_DOT_FLAG | DV_DOT_FLAG | DD_DOT_FLAG );
   clearDotTables( flags );
+#pragma omp critical (bspline_table_cache)
+  {
+    std::map< DotTableKey , DotTables >& cache = _DotTableCache();
+    DotTables& tables = cache[ key ];
+    int missing = 0;
+    if( ( flags & VV_DOT_FLAG ) && !tables.vv ) missing |= VV_DOT_FLAG;
+    if( ( flags & DV_DOT_FLAG ) && !tables.dv ) missing |= DV_DOT_FLAG;
+    if( ( flags & DD_DOT_FLAG ) && !tables.dd ) missing |= DD_DOT_FLAG;
+    if( missing ) _computeDotTables( missing , inset , tables );
+    if( flags & VV_DOT_FLAG ) vvDotTable = tables.vv;
+    if( flags & DV_DOT_FLAG ) dvDotTable = tables.dv;
+    if( flags & DD_DOT_FLAG ) ddDotTable = tables.dd;
+    if( !_hasDotKey ) tables.references++ , _dotKey = key , _hasDotKey = true;
+    tables.lastUse = _NextTableCacheUse();
+    _TrimTableCache( cache );
+  }
+}
+template<int Degree,class Real>
+void BSplineData<Degree,Real>::_computeDotTables( int flags , bool inset , DotTables& tables ) const
+{
   int size = ( functionCount*functionCount + functionCount )>>1;
   int fullSize = functionCount*functionCount;
+  Pointer( Real ) vvDotTable = NullPointer< Real >();
+  Pointer( Real ) dvDotTable = NullPointer< Real >();
+  Pointer( Real ) ddDotTable = NullPointer< Real >();
   if( flags & VV_DOT_FLAG )
   {
-    vvDotTable = NewPointer< Real >( size );
+    vvDotTable = tables.vv = NewPointer< Real >( size );
     memset( vvDotTable , 0 , sizeof(Real)*size );
   }
   if( flags & DV_DOT_FLAG )
   {
-    dvDotTable = NewPointer< Real >( fullSize );
+    dvDotTable = tables.dv = NewPointer< Real >( fullSize );
     memset( dvDotTable , 0 , sizeof(Real)*fullSize );
   }
   if( flags & DD_DOT_FLAG )
   {
-    ddDotTable = NewPointer< Real >( size );
+    ddDotTable = tables.dd = NewPointer< Real >( size );
     memset( ddDotTable , 0 , sizeof(Real)*size );
   }
   double vvIntegrals[Degree+1][Degree+1];
@@ -298,9 +399,19 @@ void BSplineData<Degree,Real>::setDotTables( int flags , bool inset )
 template< int Degree,class Real>
 void BSplineData<Degree,Real>::clearDotTables( int flags )
 {
-  if( (flags & VV_DOT_FLAG) && vvDotTable ) DeletePointer( vvDotTable );
-  if( (flags & DV_DOT_FLAG) && dvDotTable ) DeletePointer( dvDotTable );
-  if( (flags & DD_DOT_FLAG) && ddDotTable ) DeletePointer( ddDotTable );
+  // Only drop the references, the tables stay in the cache for the next reconstruction
+  if( flags & VV_DOT_FLAG ) vvDotTable = NullPointer< Real >();
+  if( flags & DV_DOT_FLAG ) dvDotTable = NullPointer< Real >();
+  if( flags & DD_DOT_FLAG ) ddDotTable = NullPointer< Real >();
+  if( _hasDotKey && !vvDotTable && !dvDotTable && !ddDotTable )
+  {
+#pragma omp critical (bspline_table_cache)
+    {
+      typename std::map< DotTableKey , DotTables >::iterator iter = _DotTableCache().find( _dotKey );
+      if( iter!=_DotTableCache().end() ) iter->second.references--;
+    }
+    _hasDotKey = false;
+  }
 }
 template< int Degree , class Real >
 void BSplineData< Degree , Real >::setSampleSpan( int idx , int& start , int& end , double smooth ) const
@@ -323,38 +434,34 @@ void BSplineData< Degree , Real >::setSampleSpan( int idx , int& start , int& en
 }
 template< int Degree,class Real>
 void BSplineData<Degree,Real>::setValueTables( int flags , double smooth )
+{
+  setValueTables( flags , smooth , smooth );
+}
+template< int Degree,class Real>
+void BSplineData<Degree,Real>::setValueTables( int flags , double valueSmooth , double derivativeSmooth )
 {
   clearValueTables();
-  if( flags &   VALUE_FLAG )  valueTables = NewPointer< Real >( functionCount*sampleCount );
-  if( flags & D_VALUE_FLAG ) dValueTables = NewPointer< Real >( functionCount*sampleCount );
-  PPolynomial<Degree+1> function;
-  PPolynomial<Degree>  dFunction;
-  for( int i=0 ; i<functionCount ; i++ )
+#pragma omp critical (bspline_table_cache)
   {
-    if(smooth>0)
-    {
-      function  = baseFunctions[i].MovingAverage(smooth);
-      dFunction = baseFunctions[i].derivative().MovingAverage(smooth);
-    }
-    else
-    {
-      function  = baseFunctions[i];
-      dFunction = baseFunctions[i].derivative();
-    }
-    for( int j=0 ; j<sampleCount ; j++ )
-    {
-      double x=double(j)/(sampleCount-1);
-      if( flags &   VALUE_FLAG )  valueTables[j*functionCount+i] = Real(  function(x) );
-      if( flags & D_VALUE_FLAG ) dValueTables[j*functionCount+i] = Real( dFunction(x) );
-    }
+    std::map< ValueTableKey , ValueTables >& cache = _ValueTableCache();
+    ValueTableKey key( depth , boundaryType , valueSmooth , derivativeSmooth );
+    ValueTables& tables = cache[ key ];
+    int missing = 0;
+    if( ( flags &   VALUE_FLAG ) && !tables.values  ) missing |=   VALUE_FLAG;
+    if( ( flags & D_VALUE_FLAG ) && !tables.dValues ) missing |= D_VALUE_FLAG;
+    if( missing ) _computeValueTables( missing , valueSmooth , derivativeSmooth , tables );
+    if( flags &   VALUE_FLAG )  valueTables = tables.values;
+    if( flags & D_VALUE_FLAG ) dValueTables = tables.dValues;
+    tables.references++ , _valueKey = key , _hasValueKey = true;
+    tables.lastUse = _NextTableCacheUse();
+    _TrimTableCache( cache );
   }
 }
 template< int Degree,class Real>
-void BSplineData<Degree,Real>::setValueTables( int flags , double valueSmooth , double derivativeSmooth )
+void BSplineData<Degree,Real>::_computeValueTables( int flags , double valueSmooth , double derivativeSmooth , ValueTables& tables ) const
 {
-  clearValueTables();
-  if(flags &   VALUE_FLAG)  valueTables = NewPointer< Real >( functionCount*sampleCount );
-  if(flags & D_VALUE_FLAG) dValueTables = NewPointer< Real >( functionCount*sampleCount );
+  if(flags &   VALUE_FLAG) tables.values  = NewPointer< Real >( functionCount*sampleCount );
+  if(flags & D_VALUE_FLAG) tables.dValues = NewPointer< Real >( functionCount*sampleCount );
   PPolynomial<Degree+1> function;
   PPolynomial<Degree>  dFunction;
   for( int i=0 ; i<functionCount ; i++ )
@@ -367,8 +474,8 @@ void BSplineData<Degree,Real>::setValueTables( int flags , double valueSmooth ,
     for( int j=0 ; j<sampleCount ; j++ )
     {
       double x=double(j)/(sampleCount-1);
-      if( flags &   VALUE_FLAG )  valueTables[j*functionCount+i] = Real( function(x));
-      if( flags & D_VALUE_FLAG ) dValueTables[j*functionCount+i] = Real(dFunction(x));
+      if( flags &   VALUE_FLAG ) tables.values [j*functionCount+i] = Real( function(x));
+      if( flags & D_VALUE_FLAG ) tables.dValues[j*functionCount+i] = Real(dFunction(x));
     }
   }
 }
@@ -376,8 +483,18 @@ void BSplineData<Degree,Real>::setValueTables( int flags , double valueSmooth ,
 
 template< int Degree,class Real>
 void BSplineData<Degree,Real>::clearValueTables(void){
-  if(  valueTables ) DeletePointer(  valueTables );
-  if( dValueTables ) DeletePointer( dValueTables );
+  // Only drop the references, the tables stay in the cache for the next reconstruction
+   valueTables = NullPointer< Real >();
+  dValueTables = NullPointer< Real >();
+  if( _hasValueKey )
+  {
+#pragma omp critical (bspline_table_cache)
+    {
+      typename std::map< ValueTableKey , ValueTables >::iterator iter = _ValueTableCache().find( _valueKey );
+      if( iter!=_ValueTableCache().end() ) iter->second.references--;
+    }
+    _hasValueKey = false;
+  }
 }
 
 template< int Degree,class Real>
@@ -0,0 +1,297 @@
+#include "CoredMeshDecimator.h"
+#include <cstring>
+#include <queue>
+#include <iterator>
+#include <algorithm>
+
+CoredMeshDecimator::CoredMeshDecimator( CoredMeshData* mesh , float tolerance )
+{
+	_mesh = mesh;
+	_tolerance2 = double( tolerance ) * double( tolerance );
+	oocPoints = polygons = subtreeStart = 0;
+}
+void CoredMeshDecimator::resetIterator( void ) { ; }
+node_index_type CoredMeshDecimator::addOutOfCorePoint( const Point3D< float >& p )
+{
+	subtreePoints.push_back( p );
+	oocPoints++;
+	return oocPoints-1;
+}
+node_index_type CoredMeshDecimator::addPolygon( const std::vector< CoredVertexIndex >& vertices )
+{
+	subtreePolygons.push_back( vertices );
+	polygons++;
+	return polygons-1;
+}
+int CoredMeshDecimator::nextOutOfCorePoint( Point3D< float >& ) { return 0; }
+int CoredMeshDecimator::nextPolygon( std::vector< CoredVertexIndex >& ) { return 0; }
+node_index_type CoredMeshDecimator::outOfCorePointCount( void ){ return oocPoints; }
+node_index_type CoredMeshDecimator::polygonCount( void ) { return polygons; }
+
+double CoredMeshDecimator::quadricError( const double* q , const Point3D< double >& p ) const
+{
+	const double x = p[0] , y = p[1] , z = p[2];
+	return q[0]*x*x + 2*q[1]*x*y + 2*q[2]*x*z + 2*q[3]*x + q[4]*y*y + 2*q[5]*y*z + 2*q[6]*y + q[7]*z*z + 2*q[8]*z + q[9];
+}
+bool CoredMeshDecimator::collapseTarget( int v1 , int v2 , Collapse& collapse ) const
+{
+	const Vertex &vert1 = vertices[v1] , &vert2 = vertices[v2];
+	if( vert1.locked && vert2.locked ) return false;
+	double q[10];
+	for( int i=0 ; i<10 ; i++ ) q[i] = vert1.quadric[i] + vert2.quadric[i];
+
+	// The locked vertex survives and keeps its position
+	if( vert2.locked ) std::swap( v1 , v2 );
+	collapse.v1 = v1 , collapse.v2 = v2;
+	collapse.stamp1 = vertices[v1].stamp , collapse.stamp2 = vertices[v2].stamp;
+	if( vertices[v1].locked )
+	{
+		collapse.position = vertices[v1].position;
+		collapse.error = quadricError( q , collapse.position );
+		return collapse.error<=_tolerance2;
+	}
+
+	// Otherwise use the minimizer of the quadric if it is well defined and close to the edge,
+	// and the best of the end points and the mid point if not
+	Point3D< double > candidates[3] = { vert1.position , vert2.position , ( vert1.position + vert2.position ) / 2 };
+	collapse.position = candidates[0] , collapse.error = quadricError( q , candidates[0] );
+	for( int i=1 ; i<3 ; i++ )
+	{
+		double error = quadricError( q , candidates[i] );
+		if( error<collapse.error ) collapse.position = candidates[i] , collapse.error = error;
+	}
+	XForm3x3< double > A;
+	A(0,0) = q[0] , A(0,1) = A(1,0) = q[1] , A(0,2) = A(2,0) = q[2];
+	A(1,1) = q[4] , A(1,2) = A(2,1) = q[5] , A(2,2) = q[7];
+	double scale = A(0,0) + A(1,1) + A(2,2);
+	if( fabs( A.determinant() )>1e-6 * scale * scale * scale )
+	{
+		Point3D< double > p = A.inverse() * Point3D< double >( -q[3] , -q[6] , -q[8] );
+		double error = quadricError( q , p );
+		if( error<collapse.error && SquareDistance( p , candidates[2] )<=SquareDistance( vert1.position , vert2.position ) )
+			collapse.position = p , collapse.error = error;
+	}
+	return collapse.error<=_tolerance2;
+}
+bool CoredMeshDecimator::collapseValid( int v1 , int v2 , const Point3D< double >& position ) const
+{
+	// Link condition: the edge has to be shared by exactly two triangles, and these have to be the
+	// only vertices adjacent to both end points, otherwise the collapse would create non-manifold edges
+	std::vector< int > neighbors1 , neighbors2 , common;
+	int shared = 0;
+	for( size_t i=0 ; i<vertices[v1].faces.size() ; i++ )
+	{
+		int t = vertices[v1].faces[i];
+		if( triangleRemoved[t] ) continue;
+		bool hasV2 = false;
+		for( int j=0 ; j<3 ; j++ )
+		{
+			if( triangles[t].idx[j]==v2 ) hasV2 = true;
+			else if( triangles[t].idx[j]!=v1 ) neighbors1.push_back( triangles[t].idx[j] );
+		}
+		if( hasV2 ) shared++;
+	}
+	if( shared!=2 ) return false;
+	for( size_t i=0 ; i<vertices[v2].faces.size() ; i++ )
+	{
+		int t = vertices[v2].faces[i];
+		if( triangleRemoved[t] ) continue;
+		for( int j=0 ; j<3 ; j++ ) if( triangles[t].idx[j]!=v1 && triangles[t].idx[j]!=v2 ) neighbors2.push_back( triangles[t].idx[j] );
+	}
+	std::sort( neighbors1.begin() , neighbors1.end() ) , neighbors1.erase( std::unique( neighbors1.begin() , neighbors1.end() ) , neighbors1.end() );
+	std::sort( neighbors2.begin() , neighbors2.end() ) , neighbors2.erase( std::unique( neighbors2.begin() , neighbors2.end() ) , neighbors2.end() );
+	std::set_intersection( neighbors1.begin() , neighbors1.end() , neighbors2.begin() , neighbors2.end() , std::back_inserter( common ) );
+	if( common.size()!=2 ) return false;
+
+	// The remaining triangles must not flip or degenerate
+	for( int k=0 ; k<2 ; k++ )
+	{
+		const Vertex& v = vertices[ k==0 ? v1 : v2 ];
+		for( size_t i=0 ; i<v.faces.size() ; i++ )
+		{
+			int t = v.faces[i];
+			if( triangleRemoved[t] ) continue;
+			const int* idx = triangles[t].idx;
+			if( ( idx[0]==v1 || idx[1]==v1 || idx[2]==v1 ) && ( idx[0]==v2 || idx[1]==v2 || idx[2]==v2 ) ) continue;
+			Point3D< double > p[3] , q[3];
+			for( int j=0 ; j<3 ; j++ )
+			{
+				p[j] = vertices[ idx[j] ].position;
+				q[j] = ( idx[j]==v1 || idx[j]==v2 ) ? position : p[j];
+			}
+			Point3D< double > n1 , n2;
+			CrossProduct( p[1]-p[0] , p[2]-p[0] , n1 );
+			CrossProduct( q[1]-q[0] , q[2]-q[0] , n2 );
+			double dot = n1[0]*n2[0] + n1[1]*n2[1] + n1[2]*n2[2];
+			if( dot<=0.25 * sqrt( SquareLength( n1 ) * SquareLength( n2 ) ) ) return false;
+		}
+	}
+	return true;
+}
+void CoredMeshDecimator::decimate( void )
+{
+	// Plane quadrics of the triangles, unweighted so that the error bounds the squared distances
+	for( size_t t=0 ; t<triangles.size() ; t++ )
+	{
+		const int* idx = triangles[t].idx;
+		Point3D< double > n;
+		CrossProduct( vertices[ idx[1] ].position - vertices[ idx[0] ].position , vertices[ idx[2] ].position - vertices[ idx[0] ].position , n );
+		double l = sqrt( SquareLength( n ) );
+		if( l<=0 ) continue;
+		n /= l;
+		double d = -( n[0]*vertices[ idx[0] ].position[0] + n[1]*vertices[ idx[0] ].position[1] + n[2]*vertices[ idx[0] ].position[2] );
+		double plane[10] = { n[0]*n[0] , n[0]*n[1] , n[0]*n[2] , n[0]*d , n[1]*n[1] , n[1]*n[2] , n[1]*d , n[2]*n[2] , n[2]*d , d*d };
+		for( int j=0 ; j<3 ; j++ ) for( int k=0 ; k<10 ; k++ ) vertices[ idx[j] ].quadric[k] += plane[k];
+	}
+
+	std::priority_queue< Collapse > queue;
+	Collapse collapse;
+	for( size_t t=0 ; t<triangles.size() ; t++ ) for( int j=0 ; j<3 ; j++ )
+	{
+		int v1 = triangles[t].idx[j] , v2 = triangles[t].idx[(j+1)%3];
+		if( v1<v2 && collapseTarget( v1 , v2 , collapse ) ) queue.push( collapse );
+	}
+
+	std::vector< int > neighbors;
+	while( !queue.empty() )
+	{
+		collapse = queue.top();
+		queue.pop();
+		Vertex &v1 = vertices[ collapse.v1 ] , &v2 = vertices[ collapse.v2 ];
+		if( v1.removed || v2.removed || v1.stamp!=collapse.stamp1 || v2.stamp!=collapse.stamp2 ) continue;
+		if( !collapseValid( collapse.v1 , collapse.v2 , collapse.position ) ) continue;
+
+		// Move v2's triangles over to v1 and drop the two sharing the edge
+		for( size_t i=0 ; i<v2.faces.size() ; i++ )
+		{
+			int t = v2.faces[i];
+			if( triangleRemoved[t] ) continue;
+			int* idx = triangles[t].idx;
+			if( idx[0]==collapse.v1 || idx[1]==collapse.v1 || idx[2]==collapse.v1 ) triangleRemoved[t] = 1;
+			else
+			{
+				for( int j=0 ; j<3 ; j++ ) if( idx[j]==collapse.v2 ) idx[j] = collapse.v1;
+				v1.faces.push_back( t );
+			}
+		}
+		v2.removed = true;
+		v2.faces.clear();
+		v1.position = collapse.position;
+		for( int k=0 ; k<10 ; k++ ) v1.quadric[k] += v2.quadric[k];
+		v1.stamp++;
+
+		// Only the surviving vertex changed, re-evaluate its edges
+		const int survivor = collapse.v1;
+		size_t f = 0;
+		neighbors.clear();
+		for( size_t i=0 ; i<v1.faces.size() ; i++ )
+		{
+			int t = v1.faces[i];
+			if( triangleRemoved[t] ) continue;
+			v1.faces[f++] = t;
+			for( int j=0 ; j<3 ; j++ ) if( triangles[t].idx[j]!=survivor ) neighbors.push_back( triangles[t].idx[j] );
+		}
+		v1.faces.resize( f );
+		std::sort( neighbors.begin() , neighbors.end() ) , neighbors.erase( std::unique( neighbors.begin() , neighbors.end() ) , neighbors.end() );
+		for( size_t i=0 ; i<neighbors.size() ; i++ )
+			if( collapseTarget( survivor , neighbors[i] , collapse ) ) queue.push( collapse );
+	}
+}
+void CoredMeshDecimator::endSubtree( void )
+{
+	// Local vertices: the subtree's out-of-core points first, then the in-core points it references
+	vertices.clear() , triangles.clear() , triangleRemoved.clear();
+	vertices.resize( subtreePoints.size() );
+	for( size_t i=0 ; i<subtreePoints.size() ; i++ )
+	{
+		vertices[i].position = subtreePoints[i];
+		vertices[i].index.idx = subtreeStart + node_index_type(i) , vertices[i].index.inCore = false;
+	}
+	hash_map< node_index_type , int > inCoreMap;
+	std::vector< std::vector< int > > others;
+	for( size_t i=0 ; i<subtreePolygons.size() ; i++ )
+	{
+		const std::vector< CoredVertexIndex >& polygon = subtreePolygons[i];
+		std::vector< int > local( polygon.size() );
+		for( size_t j=0 ; j<polygon.size() ; j++ )
+		{
+			if( !polygon[j].inCore ) local[j] = int( polygon[j].idx - subtreeStart );
+			else
+			{
+				hash_map< node_index_type , int >::iterator iter = inCoreMap.find( polygon[j].idx );
+				if( iter==inCoreMap.end() )
+				{
+					Vertex v = Vertex();
+					v.position = inCorePoints[ polygon[j].idx ];
+					v.index = polygon[j];
+					iter = inCoreMap.insert( std::pair< node_index_type , int >( polygon[j].idx , int( vertices.size() ) ) ).first;
+					vertices.push_back( v );
+				}
+				local[j] = iter->second;
+			}
+		}
+		if( local.size()==3 )
+		{
+			TriangleIndex t;
+			t.idx[0] = local[0] , t.idx[1] = local[1] , t.idx[2] = local[2];
+			triangles.push_back( t );
+		}
+		else others.push_back( local );
+	}
+	subtreePolygons.clear();
+	for( size_t i=0 ; i<vertices.size() ; i++ )
+	{
+		memset( vertices[i].quadric , 0 , sizeof( vertices[i].quadric ) );
+		vertices[i].stamp = 0;
+		vertices[i].locked = vertices[i].index.inCore;
+		vertices[i].removed = false;
+	}
+	for( size_t i=0 ; i<others.size() ; i++ ) for( size_t j=0 ; j<others[i].size() ; j++ ) vertices[ others[i][j] ].locked = true;
+	triangleRemoved.resize( triangles.size() , 0 );
+	for( size_t t=0 ; t<triangles.size() ; t++ ) for( int j=0 ; j<3 ; j++ ) vertices[ triangles[t].idx[j] ].faces.push_back( int(t) );
+
+	// Lock the vertices of edges that are not shared by exactly two triangles
+	hash_map< long long , int > edgeCount;
+	for( size_t t=0 ; t<triangles.size() ; t++ ) for( int j=0 ; j<3 ; j++ )
+	{
+		long long v1 = triangles[t].idx[j] , v2 = triangles[t].idx[(j+1)%3];
+		edgeCount[ v1<v2 ? (v1<<32)|v2 : (v2<<32)|v1 ]++;
+	}
+	for( hash_map< long long , int >::iterator iter=edgeCount.begin() ; iter!=edgeCount.end() ; ++iter )
+		if( iter->second!=2 ) vertices[ int( iter->first>>32 ) ].locked = vertices[ int( iter->first & 0xffffffff ) ].locked = true;
+
+	decimate();
+
+	// Pass on the remaining points and polygons
+	std::vector< int > used( vertices.size() , 0 );
+	for( size_t t=0 ; t<triangles.size() ; t++ ) if( !triangleRemoved[t] ) for( int j=0 ; j<3 ; j++ ) used[ triangles[t].idx[j] ] = 1;
+	for( size_t i=0 ; i<others.size() ; i++ ) for( size_t j=0 ; j<others[i].size() ; j++ ) used[ others[i][j] ] = 1;
+	for( size_t i=0 ; i<vertices.size() ; i++ )
+		if( used[i] && !vertices[i].index.inCore ) vertices[i].index.idx = _mesh->addOutOfCorePoint( Point3D< float >( vertices[i].position ) );
+
+	std::vector< CoredVertexIndex > polygon;
+	for( size_t t=0 ; t<triangles.size() ; t++ )
+	{
+		if( triangleRemoved[t] ) continue;
+		polygon.resize( 3 );
+		for( int j=0 ; j<3 ; j++ ) polygon[j] = vertices[ triangles[t].idx[j] ].index;
+		_mesh->addPolygon( polygon );
+	}
+	for( size_t i=0 ; i<others.size() ; i++ )
+	{
+		polygon.resize( others[i].size() );
+		for( size_t j=0 ; j<others[i].size() ; j++ ) polygon[j] = vertices[ others[i][j] ].index;
+		_mesh->addPolygon( polygon );
+	}
+
+	subtreePoints.clear();
+	subtreeStart = oocPoints;
+	vertices.clear() , triangles.clear() , triangleRemoved.clear();
+}
+void CoredMeshDecimator::finish( void )
+{
+	endSubtree();
+	// The polygons refer to the in-core points by index, so they move over unchanged
+	_mesh->inCorePoints.swap( inCorePoints );
+	inCorePoints.clear();
+}
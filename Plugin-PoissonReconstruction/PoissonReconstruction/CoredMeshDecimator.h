@@ -0,0 +1,69 @@
+#ifndef CORED_MESH_DECIMATOR_INCLUDED
+#define CORED_MESH_DECIMATOR_INCLUDED
+
+#include <vector>
+#include "Geometry.h"
+
+// Sink that simplifies the surface of every iso-subtree before passing it on to another
+// CoredMeshData. Edges are collapsed in the order of their quadric error as long as the
+// summed squared distance to the planes of the original triangles stays below tolerance^2.
+// The in-core points (the roots on subtree boundaries), the vertices on open borders and
+// those of non-triangular polygons are never moved, so neighbouring subtrees still fit.
+class CoredMeshDecimator : public CoredMeshData
+{
+	CoredMeshData* _mesh;
+	double _tolerance2;
+	node_index_type oocPoints , polygons , subtreeStart;
+
+	// Buffered surface of the current subtree, out-of-core points relative to subtreeStart
+	std::vector< Point3D< float > > subtreePoints;
+	std::vector< std::vector< CoredVertexIndex > > subtreePolygons;
+
+	struct Collapse
+	{
+		double error;
+		int v1 , v2;
+		int stamp1 , stamp2;
+		Point3D< double > position;
+		bool operator < ( const Collapse& c ) const { return error>c.error; }
+	};
+	struct Vertex
+	{
+		Point3D< double > position;
+		double quadric[10];
+		std::vector< int > faces;
+		int stamp;
+		bool locked , removed;
+		CoredVertexIndex index;
+	};
+	std::vector< Vertex > vertices;
+	std::vector< TriangleIndex > triangles;
+	std::vector< char > triangleRemoved;
+
+	double quadricError( const double* quadric , const Point3D< double >& p ) const;
+	bool collapseTarget( int v1 , int v2 , Collapse& collapse ) const;
+	bool collapseValid( int v1 , int v2 , const Point3D< double >& position ) const;
+	void decimate( void );
+public:
+	// tolerance is the largest distance, in the units of the output points, the simplified surface may deviate
+	CoredMeshDecimator( CoredMeshData* mesh , float tolerance );
+
+	// Decimates the current subtree and passes it on
+	void endSubtree( void );
+	// Passes the remaining polygons and the in-core points on, call it after the extraction
+	void finish( void );
+
+	void resetIterator( void );
+
+	node_index_type addOutOfCorePoint( const Point3D< float >& p );
+	node_index_type addPolygon( const std::vector< CoredVertexIndex >& vertices );
+
+	// The surface is passed on, it cannot be read back
+	int nextOutOfCorePoint( Point3D< float >& p );
+	int nextPolygon( std::vector< CoredVertexIndex >& vertices );
+
+	node_index_type outOfCorePointCount( void );
+	node_index_type polygonCount( void );
+};
+
+#endif // CORED_MESH_DECIMATOR_INCLUDED
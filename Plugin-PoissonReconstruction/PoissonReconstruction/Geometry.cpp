@@ -28,6 +28,7 @@ DAMAGE.
 #include "Geometry.h"
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
 
 ///////////////////
 // CoredMeshData //
@@ -41,31 +42,39 @@ TriangulationTriangle::TriangulationTriangle(void){eIndex[0]=eIndex[1]=eIndex[2]
 /////////////////////////
 CoredVectorMeshData::CoredVectorMeshData( void ) { oocPointIndex = polygonIndex = 0; }
 void CoredVectorMeshData::resetIterator ( void ) { oocPointIndex = polygonIndex = 0; }
-int CoredVectorMeshData::addOutOfCorePoint(const Point3D<float>& p){
+node_index_type CoredVectorMeshData::addOutOfCorePoint(const Point3D<float>& p){ return addOutOfCorePoint( p , Point3D<float>() ); }
+node_index_type CoredVectorMeshData::addOutOfCorePoint( const Point3D<float>& p , const Point3D<float>& n )
+{
 	oocPoints.push_back(p);
-	return int(oocPoints.size())-1;
+	if( storeNormals ) oocNormals.push_back( n );
+	return node_index_type( oocPoints.size() )-1;
 }
-int CoredVectorMeshData::addPolygon( const std::vector< CoredVertexIndex >& vertices )
+node_index_type CoredVectorMeshData::addPolygon( const std::vector< CoredVertexIndex >& vertices )
 {
-	std::vector< int > polygon( vertices.size() );
+	std::vector< node_index_type > polygon( vertices.size() );
 	for( int i=0 ; i<int(vertices.size()) ; i++ ) 
 		if( vertices[i].inCore ) polygon[i] =  vertices[i].idx;
 		else                     polygon[i] = -vertices[i].idx-1;
 	polygons.push_back( polygon );
-	return int( polygons.size() )-1;
+	return node_index_type( polygons.size() )-1;
 }
 int CoredVectorMeshData::nextOutOfCorePoint(Point3D<float>& p){
-	if(oocPointIndex<int(oocPoints.size())){
+	if(oocPointIndex<node_index_type( oocPoints.size() )){
 		p=oocPoints[oocPointIndex++];
 		return 1;
 	}
 	else{return 0;}
 }
+int CoredVectorMeshData::nextOutOfCorePoint( Point3D<float>& p , Point3D<float>& n )
+{
+	n = oocPointIndex<node_index_type( oocNormals.size() ) ? oocNormals[oocPointIndex] : Point3D<float>();
+	return nextOutOfCorePoint( p );
+}
 int CoredVectorMeshData::nextPolygon( std::vector< CoredVertexIndex >& vertices )
 {
-	if( polygonIndex<int( polygons.size() ) )
+	if( polygonIndex<node_index_type( polygons.size() ) )
 	{
-		std::vector< int >& polygon = polygons[ polygonIndex++ ];
+		std::vector< node_index_type >& polygon = polygons[ polygonIndex++ ];
 		vertices.resize( polygon.size() );
 		for( int i=0 ; i<int(polygon.size()) ; i++ )
 			if( polygon[i]<0 ) vertices[i].idx = -polygon[i]-1 , vertices[i].inCore = false;
@@ -74,8 +83,8 @@ int CoredVectorMeshData::nextPolygon( std::vector< CoredVertexIndex >& vertices
 	}
 	else return 0;
 }
-int CoredVectorMeshData::outOfCorePointCount(void){return int(oocPoints.size());}
-int CoredVectorMeshData::polygonCount( void ) { return int( polygons.size() ); }
+node_index_type CoredVectorMeshData::outOfCorePointCount(void){ return node_index_type( oocPoints.size() ); }
+node_index_type CoredVectorMeshData::polygonCount( void ) { return node_index_type( polygons.size() ); }
 
 ///////////////////////////
 // BufferedReadWriteFile //
@@ -83,7 +92,8 @@ int CoredVectorMeshData::polygonCount( void ) { return int( polygons.size() ); }
 BufferedReadWriteFile::BufferedReadWriteFile( char* fileName , int bufferSize )
 {
 	_bufferIndex = 0;
-	_bufferSize = bufferSize;
+	_bufferSize = _bufferCapacity = bufferSize;
+	_writing = true;
 	if( fileName ) strcpy( _fileName , fileName ) , tempFile = false;
 #ifdef _WIN32
 	else strcpy( _fileName , _tempnam( "." , "foo" ) ) , tempFile = true;
@@ -102,11 +112,13 @@ BufferedReadWriteFile::~BufferedReadWriteFile( void )
 }
 void BufferedReadWriteFile::reset( void )
 {
-	if( _bufferIndex ) fwrite( _buffer , 1 , _bufferIndex , _fp );
+	// Only flush pending writes, and read with the full buffer again: a previous read pass
+	// leaves the read position in _bufferIndex and may have shrunk _bufferSize to zero
+	if( _writing && _bufferIndex ) fwrite( _buffer , 1 , _bufferIndex , _fp );
+	_writing = false;
 	_bufferIndex = 0;
 	fseek( _fp , 0 , SEEK_SET );
-	_bufferIndex = 0;
-	_bufferSize = fread( _buffer , 1 , _bufferSize , _fp );
+	_bufferSize = fread( _buffer , 1 , _bufferCapacity , _fp );
 }
 bool BufferedReadWriteFile::write( const void* data , size_t size )
 {
@@ -178,37 +190,47 @@ void CoredFileMeshData::resetIterator ( void )
 	oocPointFile->reset();
 	polygonFile->reset();
 }
-int CoredFileMeshData::addOutOfCorePoint( const Point3D< float >& p )
+node_index_type CoredFileMeshData::addOutOfCorePoint( const Point3D< float >& p ) { return addOutOfCorePoint( p , Point3D< float >() ); }
+node_index_type CoredFileMeshData::addOutOfCorePoint( const Point3D< float >& p , const Point3D< float >& n )
 {
+	// With normals, every point record is followed by its normal
 	oocPointFile->write( &p , sizeof( Point3D< float > ) );
+	if( storeNormals ) oocPointFile->write( &n , sizeof( Point3D< float > ) );
 	oocPoints++;
 	return oocPoints-1;
 }
-int CoredFileMeshData::addPolygon( const std::vector< CoredVertexIndex >& vertices )
+node_index_type CoredFileMeshData::addPolygon( const std::vector< CoredVertexIndex >& vertices )
 {
 	int pSize = int( vertices.size() );
-	std::vector< int > polygon( pSize );
+	std::vector< node_index_type > polygon( pSize );
 	for( int i=0 ; i<pSize ; i++ ) 
 		if( vertices[i].inCore ) polygon[i] =  vertices[i].idx;
 		else                     polygon[i] = -vertices[i].idx-1;
 
 	polygonFile->write( &pSize , sizeof(int) );
-	polygonFile->write( &polygon[0] , sizeof(int)*pSize );
+	polygonFile->write( &polygon[0] , sizeof(node_index_type)*pSize );
 	polygons++;
 	return polygons-1;
 }
 int CoredFileMeshData::nextOutOfCorePoint( Point3D< float >& p )
 {
-	if( oocPointFile->read( &p , sizeof( Point3D< float > ) ) ) return 1;
-	else return 0;
+	Point3D< float > n;
+	return nextOutOfCorePoint( p , n );
+}
+int CoredFileMeshData::nextOutOfCorePoint( Point3D< float >& p , Point3D< float >& n )
+{
+	if( !oocPointFile->read( &p , sizeof( Point3D< float > ) ) ) return 0;
+	if( storeNormals && !oocPointFile->read( &n , sizeof( Point3D< float > ) ) ) return 0;
+	if( !storeNormals ) n = Point3D< float >();
+	return 1;
 }
 int CoredFileMeshData::nextPolygon( std::vector< CoredVertexIndex >& vertices )
 {
 	int pSize;
 	if( polygonFile->read( &pSize , sizeof(int) ) )
 	{
-		std::vector< int > polygon( pSize );
-		if( polygonFile->read( &polygon[0] , sizeof(int)*pSize ) )
+		std::vector< node_index_type > polygon( pSize );
+		if( polygonFile->read( &polygon[0] , sizeof(node_index_type)*pSize ) )
 		{
 			vertices.resize( pSize );
 			for( int i=0 ; i<int(polygon.size()) ; i++ )
@@ -220,31 +242,211 @@ int CoredFileMeshData::nextPolygon( std::vector< CoredVertexIndex >& vertices )
 	}
 	else return 0;
 }
-int CoredFileMeshData::outOfCorePointCount( void ){ return oocPoints; }
-int CoredFileMeshData::polygonCount( void ) { return polygons; }
+node_index_type CoredFileMeshData::outOfCorePointCount( void ){ return oocPoints; }
+node_index_type CoredFileMeshData::polygonCount( void ) { return polygons; }
+
+/////////////////////////
+// CoredMeshFileWriter //
+/////////////////////////
+CoredMeshFileWriter::CoredMeshFileWriter( void )
+{
+	_fp = NULL;
+	_buffer = NULL;
+	_format = PLY_BINARY;
+	_referencedOnly = false;
+	oocPointFile = polygonFile = NULL;
+	oocPoints = polygons = 0;
+	vertexCountPos = faceCountPos = 0;
+}
+CoredMeshFileWriter::~CoredMeshFileWriter( void )
+{
+	if( _fp ) fclose( _fp );
+	free( _buffer );
+	delete oocPointFile;
+	delete polygonFile;
+}
+bool CoredMeshFileWriter::open( const char* fileName , Format format , bool referencedOnly )
+{
+	_fp = fopen( fileName , "wb" );
+	if( !_fp ) return false;
+	// Large writes, the output can be several gigabytes
+	const size_t bufferSize = 1<<22;
+	_buffer = (char*) malloc( bufferSize );
+	if( _buffer ) setvbuf( _fp , _buffer , _IOFBF , bufferSize );
+
+	_format = format;
+	_referencedOnly = referencedOnly;
+	polygonFile = new BufferedReadWriteFile();
+	if( _referencedOnly ) oocPointFile = new BufferedReadWriteFile();
+
+	if( _format==PLY_BINARY )
+	{
+		// The counts are only known in close(), leave room to patch in any 64-bit count
+		const int one = 1;
+		fprintf( _fp , "ply\nformat %s 1.0\n" , *( (const char*)&one ) ? "binary_little_endian" : "binary_big_endian" );
+		fprintf( _fp , "element vertex " );
+		vertexCountPos = ftell( _fp );
+		fprintf( _fp , "%20d\n" , 0 );
+		fprintf( _fp , "property float x\nproperty float y\nproperty float z\n" );
+		fprintf( _fp , "element face " );
+		faceCountPos = ftell( _fp );
+		fprintf( _fp , "%20d\n" , 0 );
+		fprintf( _fp , "property list uchar int vertex_indices\nend_header\n" );
+	}
+	return !ferror( _fp );
+}
+bool CoredMeshFileWriter::writeVertex( const Point3D< float >& p )
+{
+	if( _format==PLY_BINARY ) return fwrite( p.coords , sizeof(float) , 3 , _fp )==3;
+	else                      return fprintf( _fp , "v %f %f %f\n" , p[0] , p[1] , p[2] )>0;
+}
+bool CoredMeshFileWriter::writeFace( const std::vector< node_index_type >& face )
+{
+	if( _format==PLY_BINARY )
+	{
+		// PLY readers expect 32-bit vertex indices, also with 64-bit indices (BIG_DATA), so larger meshes are refused
+		_face.resize( face.size() );
+		for( size_t i=0 ; i<face.size() ; i++ )
+		{
+#ifdef BIG_DATA
+			if( face[i]>node_index_type( INT_MAX ) ) return false;
+#endif
+			_face[i] = int( face[i] );
+		}
+		unsigned char size = (unsigned char)( face.size() );
+		if( fwrite( &size , sizeof(unsigned char) , 1 , _fp )!=1 ) return false;
+		return fwrite( &_face[0] , sizeof(int) , _face.size() , _fp )==_face.size();
+	}
+	fprintf( _fp , "f" );
+	for( size_t i=0 ; i<face.size() ; i++ ) fprintf( _fp , " %lld" , (long long)face[i]+1 );
+	return fprintf( _fp , "\n" )>0;
+}
+bool CoredMeshFileWriter::close( void )
+{
+	if( !_fp ) return false;
+
+	// Vertex order in the file: out-of-core points followed by the in-core points
+	node_index_type inCoreCount = node_index_type( inCorePoints.size() );
+	std::vector< node_index_type > vertexMap;
+	node_index_type vertexCount = oocPoints + inCoreCount;
+	std::vector< node_index_type > polygon;
+	int pSize;
+	// Stop at the first failed write, e.g. on a full disk, rather than streaming the rest of the mesh
+	bool success = !ferror( _fp );
+	if( _referencedOnly && success )
+	{
+		vertexMap.resize( oocPoints + inCoreCount , -1 );
+		polygonFile->reset();
+		for( node_index_type i=0 ; i<polygons ; i++ )
+		{
+			success = polygonFile->read( &pSize , sizeof(int) );
+			if( !success ) break;
+			polygon.resize( pSize );
+			success = polygonFile->read( &polygon[0] , sizeof(node_index_type)*pSize );
+			if( !success ) break;
+			for( int j=0 ; j<pSize ; j++ ) vertexMap[ polygon[j]<0 ? -polygon[j]-1 : polygon[j]+oocPoints ] = 0;
+		}
+		vertexCount = 0;
+		Point3D< float > p;
+		oocPointFile->reset();
+		for( node_index_type i=0 ; i<oocPoints && success ; i++ )
+		{
+			success = oocPointFile->read( &p , sizeof( Point3D< float > ) );
+			if( !success || vertexMap[i]<0 ) continue;
+			success = writeVertex( p );
+			vertexMap[i] = vertexCount++;
+		}
+	}
+	for( node_index_type i=0 ; i<inCoreCount && success ; i++ )
+	{
+		if( _referencedOnly )
+		{
+			if( vertexMap[ i+oocPoints ]<0 ) continue;
+			vertexMap[ i+oocPoints ] = vertexCount++;
+		}
+		success = writeVertex( inCorePoints[i] );
+	}
+
+	polygonFile->reset();
+	std::vector< node_index_type > face;
+	for( node_index_type i=0 ; i<polygons && success ; i++ )
+	{
+		// A short read of the buffered polygons would write garbage faces
+		success = polygonFile->read( &pSize , sizeof(int) );
+		if( !success ) break;
+		polygon.resize( pSize );
+		face.resize( pSize );
+		success = polygonFile->read( &polygon[0] , sizeof(node_index_type)*pSize );
+		if( !success ) break;
+		for( int j=0 ; j<pSize ; j++ )
+		{
+			node_index_type idx = polygon[j]<0 ? -polygon[j]-1 : polygon[j]+oocPoints;
+			face[j] = _referencedOnly ? vertexMap[idx] : idx;
+		}
+		success = writeFace( face );
+	}
+
+	if( _format==PLY_BINARY && success )
+	{
+		fseek( _fp , vertexCountPos , SEEK_SET );
+		fprintf( _fp , "%20lld" , (long long)vertexCount );
+		fseek( _fp , faceCountPos , SEEK_SET );
+		fprintf( _fp , "%20lld" , (long long)polygons );
+	}
+	if( ferror( _fp ) ) success = false;
+	if( fclose( _fp ) ) success = false;
+	_fp = NULL;
+	return success;
+}
+void CoredMeshFileWriter::resetIterator( void ) { ; }
+node_index_type CoredMeshFileWriter::addOutOfCorePoint( const Point3D< float >& p )
+{
+	if( _referencedOnly ) oocPointFile->write( &p , sizeof( Point3D< float > ) );
+	// After a failed write close() reports the error, do not keep streaming into the file
+	else if( !ferror( _fp ) ) writeVertex( p );
+	oocPoints++;
+	return oocPoints-1;
+}
+node_index_type CoredMeshFileWriter::addPolygon( const std::vector< CoredVertexIndex >& vertices )
+{
+	int pSize = int( vertices.size() );
+	std::vector< node_index_type > polygon( pSize );
+	for( int i=0 ; i<pSize ; i++ )
+		if( vertices[i].inCore ) polygon[i] =  vertices[i].idx;
+		else                     polygon[i] = -vertices[i].idx-1;
+
+	polygonFile->write( &pSize , sizeof(int) );
+	polygonFile->write( &polygon[0] , sizeof(node_index_type)*pSize );
+	polygons++;
+	return polygons-1;
+}
+int CoredMeshFileWriter::nextOutOfCorePoint( Point3D< float >& ) { return 0; }
+int CoredMeshFileWriter::nextPolygon( std::vector< CoredVertexIndex >& ) { return 0; }
+node_index_type CoredMeshFileWriter::outOfCorePointCount( void ){ return oocPoints; }
+node_index_type CoredMeshFileWriter::polygonCount( void ) { return polygons; }
 
 //////////////////////////
 // CoredVectorMeshData2 //
 //////////////////////////
 CoredVectorMeshData2::CoredVectorMeshData2( void ) { oocPointIndex = polygonIndex = 0; }
 void CoredVectorMeshData2::resetIterator ( void ) { oocPointIndex = polygonIndex = 0; }
-int CoredVectorMeshData2::addOutOfCorePoint( const CoredMeshData2::Vertex& v )
+node_index_type CoredVectorMeshData2::addOutOfCorePoint( const CoredMeshData2::Vertex& v )
 {
 	oocPoints.push_back( v );
-	return int(oocPoints.size())-1;
+	return node_index_type( oocPoints.size() )-1;
 }
-int CoredVectorMeshData2::addPolygon( const std::vector< CoredVertexIndex >& vertices )
+node_index_type CoredVectorMeshData2::addPolygon( const std::vector< CoredVertexIndex >& vertices )
 {
-	std::vector< int > polygon( vertices.size() );
+	std::vector< node_index_type > polygon( vertices.size() );
 	for( int i=0 ; i<int(vertices.size()) ; i++ ) 
 		if( vertices[i].inCore ) polygon[i] =  vertices[i].idx;
 		else                     polygon[i] = -vertices[i].idx-1;
 	polygons.push_back( polygon );
-	return int( polygons.size() )-1;
+	return node_index_type( polygons.size() )-1;
 }
 int CoredVectorMeshData2::nextOutOfCorePoint( CoredMeshData2::Vertex& v )
 {
-	if(oocPointIndex<int(oocPoints.size()))
+	if(oocPointIndex<node_index_type( oocPoints.size() ))
 	{
 		v = oocPoints[oocPointIndex++];
 		return 1;
@@ -253,9 +455,9 @@ int CoredVectorMeshData2::nextOutOfCorePoint( CoredMeshData2::Vertex& v )
 }
 int CoredVectorMeshData2::nextPolygon( std::vector< CoredVertexIndex >& vertices )
 {
-	if( polygonIndex<int( polygons.size() ) )
+	if( polygonIndex<node_index_type( polygons.size() ) )
 	{
-		std::vector< int >& polygon = polygons[ polygonIndex++ ];
+		std::vector< node_index_type >& polygon = polygons[ polygonIndex++ ];
 		vertices.resize( polygon.size() );
 		for( int i=0 ; i<int(polygon.size()) ; i++ )
 			if( polygon[i]<0 ) vertices[i].idx = -polygon[i]-1 , vertices[i].inCore = false;
@@ -264,5 +466,5 @@ int CoredVectorMeshData2::nextPolygon( std::vector< CoredVertexIndex >& vertices
 	}
 	else return 0;
 }
-int CoredVectorMeshData2::outOfCorePointCount(void){return int(oocPoints.size());}
-int CoredVectorMeshData2::polygonCount( void ) { return int( polygons.size() ); }
+node_index_type CoredVectorMeshData2::outOfCorePointCount(void){ return node_index_type( oocPoints.size() ); }
+node_index_type CoredVectorMeshData2::polygonCount( void ) { return node_index_type( polygons.size() ); }
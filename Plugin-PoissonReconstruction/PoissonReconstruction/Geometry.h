@@ -34,6 +34,7 @@ DAMAGE.
 #include <cstdio>
 #include <cstdlib>
 #include "Hash.h"
+#include "NodeIndex.h"
 
 template<class Real>
 Real Random(void);
@@ -220,7 +221,7 @@ public:
 };
 class CoredPointIndex{
 public:
-	int index;
+	node_index_type index;
 	char inCore;
 
 	int operator == (const CoredPointIndex& cpi) const {return (index==cpi.index) && (inCore==cpi.inCore);};
@@ -284,23 +285,35 @@ void TriangleCollapse(const Real& edgeRatio,std::vector<TriangleIndex>& triangle
 
 struct CoredVertexIndex
 {
-	int idx;
+	node_index_type idx;
 	bool inCore;
 };
 class CoredMeshData
 {
 public:
+	CoredMeshData( void ) : storeNormals( false ) { ; }
+
 	std::vector<Point3D<float> > inCorePoints;
+	// If set before the extraction, the unit normal of every point is stored as well: inCoreNormals runs parallel to
+	// inCorePoints, and the normals of the out-of-core points are read back by nextOutOfCorePoint( p , n ).
+	// Sinks that do not store normals ignore them, points added without one get a zero normal.
+	bool storeNormals;
+	std::vector<Point3D<float> > inCoreNormals;
 	virtual void resetIterator( void ) = 0;
 
-	virtual int addOutOfCorePoint( const Point3D<float>& p ) = 0;
-	virtual int addPolygon( const std::vector< CoredVertexIndex >& vertices ) = 0;
+	virtual node_index_type addOutOfCorePoint( const Point3D<float>& p ) = 0;
+	virtual node_index_type addOutOfCorePoint( const Point3D<float>& p , const Point3D<float>& ) { return addOutOfCorePoint( p ); }
+	virtual node_index_type addPolygon( const std::vector< CoredVertexIndex >& vertices ) = 0;
 
 	virtual int nextOutOfCorePoint( Point3D<float>& p )=0;
+	virtual int nextOutOfCorePoint( Point3D<float>& p , Point3D<float>& n ) { n = Point3D<float>() ; return nextOutOfCorePoint( p ); }
 	virtual int nextPolygon( std::vector< CoredVertexIndex >& vertices ) = 0;
 
-	virtual int outOfCorePointCount(void)=0;
-	virtual int polygonCount( void ) = 0;
+	virtual node_index_type outOfCorePointCount(void)=0;
+	virtual node_index_type polygonCount( void ) = 0;
+
+	// Called by the extraction after the last polygon of an iso-subtree has been added
+	virtual void endSubtree( void ) { ; }
 };
 // Stores the iso-span of each vertex, rather than it's position
 class CoredMeshData2
@@ -325,62 +338,64 @@ public:
 	std::vector< Vertex > inCorePoints;
 	virtual void resetIterator( void ) = 0;
 
-	virtual int addOutOfCorePoint( const Vertex& v ) = 0;
-	virtual int addPolygon( const std::vector< CoredVertexIndex >& vertices ) = 0;
+	virtual node_index_type addOutOfCorePoint( const Vertex& v ) = 0;
+	virtual node_index_type addPolygon( const std::vector< CoredVertexIndex >& vertices ) = 0;
 
 	virtual int nextOutOfCorePoint( Vertex& v ) = 0;
 	virtual int nextPolygon( std::vector< CoredVertexIndex >& vertices ) = 0;
 
-	virtual int outOfCorePointCount( void )=0;
-	virtual int polygonCount( void ) = 0;
+	virtual node_index_type outOfCorePointCount( void )=0;
+	virtual node_index_type polygonCount( void ) = 0;
 };
 
 class CoredVectorMeshData : public CoredMeshData
 {
-	std::vector<Point3D<float> > oocPoints;
-	std::vector< std::vector< int > > polygons;
-	int polygonIndex;
-	int oocPointIndex;
+	std::vector<Point3D<float> > oocPoints , oocNormals;
+	std::vector< std::vector< node_index_type > > polygons;
+	node_index_type polygonIndex;
+	node_index_type oocPointIndex;
 public:
 	CoredVectorMeshData(void);
 
 	void resetIterator(void);
 
-	int addOutOfCorePoint( const Point3D<float>& p );
-	int addPolygon( const std::vector< CoredVertexIndex >& vertices );
+	node_index_type addOutOfCorePoint( const Point3D<float>& p );
+	node_index_type addOutOfCorePoint( const Point3D<float>& p , const Point3D<float>& n );
+	node_index_type addPolygon( const std::vector< CoredVertexIndex >& vertices );
 
 	int nextOutOfCorePoint( Point3D<float>& p );
+	int nextOutOfCorePoint( Point3D<float>& p , Point3D<float>& n );
 	int nextPolygon( std::vector< CoredVertexIndex >& vertices );
 
-	int outOfCorePointCount(void);
-	int polygonCount( void );
+	node_index_type outOfCorePointCount(void);
+	node_index_type polygonCount( void );
 };
 class CoredVectorMeshData2 : public CoredMeshData2
 {
 	std::vector< CoredMeshData2::Vertex > oocPoints;
-	std::vector< std::vector< int > > polygons;
-	int polygonIndex;
-	int oocPointIndex;
+	std::vector< std::vector< node_index_type > > polygons;
+	node_index_type polygonIndex;
+	node_index_type oocPointIndex;
 public:
 	CoredVectorMeshData2( void );
 
 	void resetIterator(void);
 
-	int addOutOfCorePoint( const CoredMeshData2::Vertex& v );
-	int addPolygon( const std::vector< CoredVertexIndex >& vertices );
+	node_index_type addOutOfCorePoint( const CoredMeshData2::Vertex& v );
+	node_index_type addPolygon( const std::vector< CoredVertexIndex >& vertices );
 
 	int nextOutOfCorePoint( CoredMeshData2::Vertex& v );
 	int nextPolygon( std::vector< CoredVertexIndex >& vertices );
 
-	int outOfCorePointCount( void );
-	int polygonCount( void );
+	node_index_type outOfCorePointCount( void );
+	node_index_type polygonCount( void );
 };
 class BufferedReadWriteFile
 {
-	bool tempFile;
+	bool tempFile , _writing;
 	FILE* _fp;
 	char *_buffer , _fileName[1024];
-	size_t _bufferIndex , _bufferSize;
+	size_t _bufferIndex , _bufferSize , _bufferCapacity;
 public:
 	BufferedReadWriteFile( char* fileName=NULL , int bufferSize=(1<<20) );
 	~BufferedReadWriteFile( void );
@@ -392,40 +407,83 @@ class CoredFileMeshData : public CoredMeshData
 {
 	char pointFileName[1024] , polygonFileName[1024];
 	BufferedReadWriteFile *oocPointFile , *polygonFile;
-	int oocPoints , polygons;
+	node_index_type oocPoints , polygons;
 public:
 	CoredFileMeshData( void );
 	~CoredFileMeshData( void );
 
 	void resetIterator( void );
 
-	int addOutOfCorePoint( const Point3D< float >& p );
-	int addPolygon( const std::vector< CoredVertexIndex >& vertices );
+	node_index_type addOutOfCorePoint( const Point3D< float >& p );
+	node_index_type addOutOfCorePoint( const Point3D< float >& p , const Point3D< float >& n );
+	node_index_type addPolygon( const std::vector< CoredVertexIndex >& vertices );
 
 	int nextOutOfCorePoint( Point3D< float >& p );
+	int nextOutOfCorePoint( Point3D< float >& p , Point3D< float >& n );
 	int nextPolygon( std::vector< CoredVertexIndex >& vertices );
 
-	int outOfCorePointCount( void );
-	int polygonCount( void );
+	node_index_type outOfCorePointCount( void );
+	node_index_type polygonCount( void );
 };
 class CoredFileMeshData2 : public CoredMeshData2
 {
 	FILE *oocPointFile , *polygonFile;
-	int oocPoints , polygons;
+	node_index_type oocPoints , polygons;
 public:
 	CoredFileMeshData2( void );
 	~CoredFileMeshData2( void );
 
 	void resetIterator( void );
 
-	int addOutOfCorePoint( const CoredMeshData2::Vertex& v );
-	int addPolygon( const std::vector< CoredVertexIndex >& vertices );
+	node_index_type addOutOfCorePoint( const CoredMeshData2::Vertex& v );
+	node_index_type addPolygon( const std::vector< CoredVertexIndex >& vertices );
 
 	int nextOutOfCorePoint( CoredMeshData2::Vertex& v );
 	int nextPolygon( std::vector< CoredVertexIndex >& vertices );
 
-	int outOfCorePointCount( void );
-	int polygonCount( void );
+	node_index_type outOfCorePointCount( void );
+	node_index_type polygonCount( void );
+};
+// Write-only sink that streams the extracted surface into a PLY (binary) or OBJ file
+// instead of keeping it. Out-of-core points go straight to the file, polygons are buffered
+// in a temporary file, and close() appends the in-core points and the polygons.
+class CoredMeshFileWriter : public CoredMeshData
+{
+public:
+	enum Format{ PLY_BINARY , OBJ };
+private:
+	FILE* _fp;
+	char* _buffer;
+	Format _format;
+	bool _referencedOnly;
+	BufferedReadWriteFile *oocPointFile , *polygonFile;
+	node_index_type oocPoints , polygons;
+	long vertexCountPos , faceCountPos;
+	std::vector< int > _face;
+
+	bool writeVertex( const Point3D< float >& p );
+	bool writeFace( const std::vector< node_index_type >& face );
+public:
+	CoredMeshFileWriter( void );
+	~CoredMeshFileWriter( void );
+
+	// If referencedOnly is set, vertices not used by any polygon are dropped. This needs
+	// one more pass over the buffered points, so use it only if the extraction produces them.
+	bool open( const char* fileName , Format format , bool referencedOnly=false );
+	// Completes the file, returns false if it could not be written
+	bool close( void );
+
+	void resetIterator( void );
+
+	node_index_type addOutOfCorePoint( const Point3D< float >& p );
+	node_index_type addPolygon( const std::vector< CoredVertexIndex >& vertices );
+
+	// The written surface cannot be read back
+	int nextOutOfCorePoint( Point3D< float >& p );
+	int nextPolygon( std::vector< CoredVertexIndex >& vertices );
+
+	node_index_type outOfCorePointCount( void );
+	node_index_type polygonCount( void );
 };
 #include "Geometry.inl"
 
@@ -67,15 +67,19 @@ DAMAGE.
 
 #define ROBERTO_TOLDO_FIX 1
 
+#define DETERMINISTIC_BLOCKS 16		// The number of blocks that parallel sums are split into when Octree::deterministic is set.
+									// Partial sums are combined in block order, so the results do not depend on the thread count.
+
 #if !FORCE_NEUMANN_FIELD
 #pragma message( "[WARNING] Not zeroing out normal component on boundary" )
 #endif // !FORCE_NEUMANN_FIELD
 
 #include "Hash.h"
 #include "BSplineData.h"
+#include "NodeIndex.h"
 
-char* outputFile=NULL;
-int echoStdout=0;
+POISSON_THREAD_LOCAL char* outputFile=NULL;
+POISSON_THREAD_LOCAL int echoStdout=0;
 void DumpOutput( const char* format , ... )
 {
     if( outputFile )
@@ -122,6 +126,9 @@ void DumpOutput2( char* str , const char* format , ... )
 
 
 
+// Storage precision of the coefficients / constraints (Real) and of the Laplacian matrix entries (MatrixReal).
+// The two can be chosen independently, the conjugate-gradient dot products and the matrix row sums are always
+// accumulated in double precision.
 typedef float Real;
 typedef float MatrixReal;
 typedef OctNode< class TreeNodeData , Real > TreeOctNode;
@@ -154,17 +161,22 @@ class SortedTreeNodes
 {
 public:
 	Pointer( TreeOctNode* ) treeNodes;
-	int *nodeCount;
+	node_index_type *nodeCount;
+	// The leaves in breadth-first order, the leaves of depth d are leaves[ leafCount[d] ... leafCount[d+1]-1 ]
+	Pointer( TreeOctNode* ) leaves;
+	node_index_type *leafCount;
 	int maxDepth;
 	SortedTreeNodes( void );
 	~SortedTreeNodes( void );
-	void set( TreeOctNode& root );
+	void set( TreeOctNode& root , int threads=1 );
+	// Returns the range [start,end) of the depth-d leaves (indexing into leaves) that are descendants of node
+	void leafRange( const TreeOctNode* node , int depth , node_index_type& start , node_index_type& end ) const;
 	struct CornerIndices
 	{
-		int idx[Cube::CORNERS];
-		CornerIndices( void ) { memset( idx , -1 , sizeof( int ) * Cube::CORNERS ); }
-		int& operator[] ( int i ) { return idx[i]; }
-		const int& operator[] ( int i ) const { return idx[i]; }
+		node_index_type idx[Cube::CORNERS];
+		CornerIndices( void ) { memset( idx , -1 , sizeof( node_index_type ) * Cube::CORNERS ); }
+		node_index_type& operator[] ( int i ) { return idx[i]; }
+		const node_index_type& operator[] ( int i ) const { return idx[i]; }
 	};
 	struct CornerTableData
 	{
@@ -175,20 +187,20 @@ public:
 		const CornerIndices& operator[] ( const TreeOctNode* node ) const;
 		CornerIndices& cornerIndices( const TreeOctNode* node );
 		const CornerIndices& cornerIndices( const TreeOctNode* node ) const;
-		int cCount;
+		node_index_type cCount;
 		std::vector< CornerIndices > cTable;
-		std::vector< int > offsets;
+		std::vector< node_index_type > offsets;
 	};
 	void setCornerTable( CornerTableData& cData , const TreeOctNode* rootNode , int depth , int threads ) const;
 	void setCornerTable( CornerTableData& cData , const TreeOctNode* rootNode ,             int threads ) const { setCornerTable( cData , rootNode , maxDepth-1 , threads ); }
 	void setCornerTable( CornerTableData& cData ,                                           int threads ) const { setCornerTable( cData , NULL     , maxDepth-1 , threads ); }
-	int getMaxCornerCount( int depth , int maxDepth , int threads ) const ;
+	node_index_type getMaxCornerCount( int depth , int maxDepth , int threads ) const ;
 	struct EdgeIndices
 	{
-		int idx[Cube::EDGES];
-		EdgeIndices( void ) { memset( idx , -1 , sizeof( int ) * Cube::EDGES ); }
-		int& operator[] ( int i ) { return idx[i]; }
-		const int& operator[] ( int i ) const { return idx[i]; }
+		node_index_type idx[Cube::EDGES];
+		EdgeIndices( void ) { memset( idx , -1 , sizeof( node_index_type ) * Cube::EDGES ); }
+		node_index_type& operator[] ( int i ) { return idx[i]; }
+		const node_index_type& operator[] ( int i ) const { return idx[i]; }
 	};
 	struct EdgeTableData
 	{
@@ -199,37 +211,50 @@ public:
 		const EdgeIndices& operator[] ( const TreeOctNode* node ) const;
 		EdgeIndices& edgeIndices( const TreeOctNode* node );
 		const EdgeIndices& edgeIndices( const TreeOctNode* node ) const;
-		int eCount;
+		node_index_type eCount;
 		std::vector< EdgeIndices > eTable;
-		std::vector< int > offsets;
+		std::vector< node_index_type > offsets;
 	};
 	void setEdgeTable( EdgeTableData& eData , const TreeOctNode* rootNode , int depth , int threads );
 	void setEdgeTable( EdgeTableData& eData , const TreeOctNode* rootNode ,             int threads ) { setEdgeTable( eData , rootNode , maxDepth-1 , threads ); }
 	void setEdgeTable( EdgeTableData& eData ,                                           int threads ) { setEdgeTable( eData , NULL , maxDepth-1 , threads ); }
-	int getMaxEdgeCount( const TreeOctNode* rootNode , int depth , int threads ) const ;
+	node_index_type getMaxEdgeCount( const TreeOctNode* rootNode , int depth , int threads ) const ;
 };
 
 class TreeNodeData
 {
 public:
-	int nodeIndex;
+	node_index_type nodeIndex;
 	union
 	{
 		int mcIndex;
 		struct
 		{
 			Real centerWeightContribution;
-			int normalIndex;
+			node_index_type normalIndex;
 		};
 	};
 	Real constraint , solution;
-	int pointIndex;
+	node_index_type pointIndex;
 
 	TreeNodeData(void);
 	~TreeNodeData(void);
 };
 
 
+// Report of the solve of one depth, see Octree::solverStatistics
+struct SolverDepthStatistics
+{
+	int depth;					// as passed to setTree/setTreeMemory
+	node_index_type rows;		// number of coefficients at the depth
+	int iterations;				// CG iterations, summed over the sub-domains of a subdivided solve
+	double tolerance;			// target residual norm, relative to the initial one (of the largest sub-domain of a subdivided solve)
+	double residual;			// reached relative residual norm, the largest one of the sub-domains of a subdivided solve
+								// (1 if the depth was not solved)
+	std::vector< double > residuals;	// relative residual norm before and after every iteration, not recorded for subdivided solves
+	double systemTime , solveTime;
+};
+
 template< int Degree >
 class Octree
 {
@@ -248,9 +273,32 @@ class Octree
 		PointData( Point3D< Real > p=Point3D< Real >() , Real w=0 ):position(p),coarserValue(Real(0)),weight(w){}
 	};
 	std::vector< PointData > _points;
+	// For each point, the values of the three splines along each axis that overlap it at the current depth,
+	// set by SetCoarserPointValues
+	std::vector< double > _pointSplineValues;
 
 	bool _inBounds( Point3D< Real > ) const;
 
+	// Region of interest, given in the (transformed) input coordinates and, once the tree is set, in the unit cube
+	bool _useROI;
+	Point3D< Real > _roiMin , _roiMax;
+	Point3D< Real > _roiNodeMin , _roiNodeMax;
+	Real _roiMargin;
+	int _roiCoarsening;
+	bool _inROI( const Point3D< Real >& p , Real margin ) const;
+	bool _intersectsBox( const TreeOctNode* node , const Point3D< Real >& min , const Point3D< Real >& max ) const;
+
+	// Set by setSolution: the solver starts from the coefficients in the nodes instead of from zero
+	bool _warmStart;
+	// Filled by LaplacianMatrixIteration
+	std::vector< SolverDepthStatistics > _solverStatistics;
+	// The target residual norm of a depth: the nominal tolerance of the finest depth, grown in proportion to the node width
+	double _adaptiveTolerance( int depth , double accuracy ) const;
+	void _setSolverControl( SolverControl& control , int iters ) const;
+	// Set by setFrame: setTreeMemory keeps _center and _scale instead of fitting them to the points
+	bool _fixedFrame;
+	void _setCenterWeights( void );
+
 	Real radius;
 	int width;
 	Real GetLaplacian( const int index[DIMENSION] ) const;
@@ -267,7 +315,8 @@ class Octree
 	};
 	class AdjacencySetFunction{
 	public:
-		int *adjacencies,adjacencyCount;
+		node_index_type *adjacencies;
+		int adjacencyCount;
 		void Function(const TreeOctNode* node1,const TreeOctNode* node2);
 	};
 
@@ -291,8 +340,8 @@ class Octree
 	void SetMatrixRowBounds( const TreeOctNode* node , int rDepth , const int rOff[3] , int& xStart , int& xEnd , int& yStart , int& yEnd , int& zStart , int& zEnd ) const;
 	int GetMatrixRowSize( const TreeOctNode::Neighbors5& neighbors5 ) const;
 	int GetMatrixRowSize( const TreeOctNode::Neighbors5& neighbors5 , int xStart , int xEnd , int yStart , int yEnd , int zStart , int zEnd ) const;
-	int SetMatrixRow( const TreeOctNode::Neighbors5& neighbors5 , Pointer( MatrixEntry< MatrixReal > ) row , int offset , const double stencil[5][5][5] ) const;
-	int SetMatrixRow( const TreeOctNode::Neighbors5& neighbors5 , Pointer( MatrixEntry< MatrixReal > ) row , int offset , const double stencil[5][5][5] , int xStart , int xEnd , int yStart , int yEnd , int zStart , int zEnd ) const;
+	int SetMatrixRow( const TreeOctNode::Neighbors5& neighbors5 , Pointer( MatrixEntry< MatrixReal > ) row , node_index_type offset , const double stencil[5][5][5] ) const;
+	int SetMatrixRow( const TreeOctNode::Neighbors5& neighbors5 , Pointer( MatrixEntry< MatrixReal > ) row , node_index_type offset , const double stencil[5][5][5] , int xStart , int xEnd , int yStart , int yEnd , int zStart , int zEnd ) const;
 	void SetDivergenceStencil( int depth , Point3D< double > stencil[5][5][5] , bool scatter ) const;
 	void SetLaplacianStencil( int depth , double stencil[5][5][5] ) const;
 	template< class C , int N > struct Stencil{ C values[N][N][N]; };
@@ -308,8 +357,8 @@ class Octree
 	void DownSampleFinerConstraints( int depth , SortedTreeNodes& sNodes ) const;
 	template< class C > void DownSample( int depth , const SortedTreeNodes& sNodes , C* constraints ) const;
 	template< class C > void   UpSample( int depth , const SortedTreeNodes& sNodes , C* coefficients ) const;
-	int GetFixedDepthLaplacian( SparseSymmetricMatrix< Real >& matrix , int depth , const SortedTreeNodes& sNodes , Real* subConstraints );
-	int GetRestrictedFixedDepthLaplacian( SparseSymmetricMatrix< Real >& matrix , int depth , const int* entries , int entryCount , const TreeOctNode* rNode, Real radius , const SortedTreeNodes& sNodes , Real* subConstraints );
+	int GetFixedDepthLaplacian( SparseSymmetricMatrix< MatrixReal >& matrix , int depth , const SortedTreeNodes& sNodes , Real* subConstraints );
+	int GetRestrictedFixedDepthLaplacian( SparseSymmetricMatrix< MatrixReal >& matrix , int depth , const node_index_type* entries , int entryCount , const TreeOctNode* rNode, Real radius , const SortedTreeNodes& sNodes , Real* subConstraints );
 
 	void SetIsoCorners( Real isoValue , TreeOctNode* leaf , SortedTreeNodes::CornerTableData& cData , Pointer( char ) valuesSet , Pointer( Real ) values , TreeOctNode::ConstNeighborKey3& nKey , const Real* metSolution , const Stencil< Real , 3 > stencil1[8] , const Stencil< Real , 3 > stencil2[8][8] );
 	static int IsBoundaryFace( const TreeOctNode* node , int faceIndex , int subdivideDepth );
@@ -322,10 +371,10 @@ class Octree
 	struct RootData : public SortedTreeNodes::CornerTableData , public SortedTreeNodes::EdgeTableData
 	{
 		// Edge to iso-vertex map
-		hash_map< long long , int > boundaryRoots;
+		hash_map< long long , node_index_type > boundaryRoots;
 		// Vertex to ( value , normal ) map
 		hash_map< long long , std::pair< Real , Point3D< Real > > > *boundaryValues;
-		Pointer( int ) interiorRoots;
+		Pointer( node_index_type ) interiorRoots;
 		Pointer( Real ) cornerValues;
 		Pointer( Point3D< Real > ) cornerNormals;
 		Pointer( char ) cornerValuesSet;
@@ -337,8 +386,8 @@ class Octree
 	int SetMCRootPositions( TreeOctNode* node , int sDepth , Real isoValue , TreeOctNode::ConstNeighborKey5& neighborKey5 , RootData& rootData ,
 		std::vector< Point3D< Real > >* interiorPositions , CoredMeshData* mesh , const Real* metSolution , int nonLinearFit );
 	int GetMCIsoTriangles( TreeOctNode* node , CoredMeshData* mesh , RootData& rootData ,
-		std::vector< Point3D< Real > >* interiorPositions , int offSet , int sDepth , bool polygonMesh , std::vector< Point3D< Real > >* barycenters );
-	static int AddTriangles( CoredMeshData* mesh , std::vector<CoredPointIndex>& edges , std::vector< Point3D< Real > >* interiorPositions , int offSet , bool polygonMesh , std::vector< Point3D< Real > >* barycenters );
+		std::vector< Point3D< Real > >* interiorPositions , node_index_type offSet , int sDepth , bool polygonMesh , std::vector< Point3D< Real > >* barycenters );
+	static int AddTriangles( CoredMeshData* mesh , std::vector<CoredPointIndex>& edges , std::vector< Point3D< Real > >* interiorPositions , node_index_type offSet , bool polygonMesh , std::vector< Point3D< Real > >* barycenters );
 
 
 	void GetMCIsoEdges( TreeOctNode* node , int sDepth , std::vector< std::pair< RootInfo , RootInfo > >& edges );
@@ -346,7 +395,8 @@ class Octree
 	static int InteriorFaceRootCount( const TreeOctNode* node , const int &faceIndex , int maxDepth );
 	static int EdgeRootCount( const TreeOctNode* node , int edgeIndex , int maxDepth );
 	static void GetRootSpan( const RootInfo& ri , Point3D< Real >& start , Point3D< Real >& end );
-	int GetRoot( const RootInfo& ri , Real isoValue , TreeOctNode::ConstNeighborKey5& neighborKey5 , Point3D<Real> & position , RootData& rootData , int sDepth , const Real* metSolution , int nonLinearFit );
+	// If normal is given, it is set to the unit gradient of the implicit function at the root, interpolated along the edge
+	int GetRoot( const RootInfo& ri , Real isoValue , TreeOctNode::ConstNeighborKey5& neighborKey5 , Point3D<Real> & position , RootData& rootData , int sDepth , const Real* metSolution , int nonLinearFit , Point3D< Real >* normal=NULL );
 	static int GetRootIndex( const TreeOctNode* node , int edgeIndex , int maxDepth , RootInfo& ri );
 	static int GetRootIndex( const TreeOctNode* node , int edgeIndex , int maxDepth , int sDepth , RootInfo& ri );
 	static int GetRootIndex( const RootInfo& ri , RootData& rootData , CoredPointIndex& index );
@@ -361,34 +411,102 @@ class Octree
 	Real SplatOrientedPoint( const Point3D<Real>& point , const Point3D<Real>& normal , TreeOctNode::NeighborKey3& neighborKey3 , TreeOctNode::NeighborKey5& neighborKey5 , int kernelDepth , Real samplesPerNode , int minDepth , int maxDepth );
 
 	int HasNormals(TreeOctNode* node,Real epsilon);
-	Real getCornerValue( const TreeOctNode::ConstNeighborKey3& neighborKey3 , const TreeOctNode* node , int corner , const Real* metSolution );
+	// Looks up the 1D weights of the Width consecutive functions centered on the function with index centerFunction
+	// at the sample whose table row starts at sampleOffset. Functions outside [start,end) get weight zero so that the
+	// tensor-product evaluation can run over the full, compile-time sized neighborhood.
+	template< int Width , class WeightReal >
+	void SetAxisWeights( ConstPointer( Real ) table , int sampleOffset , int centerFunction , int start , int end , WeightReal weights[Width] ) const;
 	Point3D< Real > getCornerNormal( const TreeOctNode::ConstNeighborKey5& neighborKey5 , const TreeOctNode* node , int corner , const Real* metSolution );
 	Real getCornerValue( const TreeOctNode::ConstNeighborKey3& neighborKey3 , const TreeOctNode* node , int corner , const Real* metSolution , const Real stencil1[3][3][3] , const Real stencil2[3][3][3] );
+	// Batched corner evaluation: the coefficients of the node's and its parent's 3x3x3 neighborhoods are gathered
+	// once (zero for missing neighbors) and shared by all the corners of the node.
+	void GatherCornerCoefficients( const TreeOctNode::ConstNeighborKey3& neighborKey3 , const TreeOctNode* node , const Real* metSolution , Real solutions[3][3][3] , Real coarseSolutions[3][3][3] ) const;
+	Real getCornerValue( const TreeOctNode* node , int corner , const Real solutions[3][3][3] , const Real coarseSolutions[3][3][3] ) const;
 	Real getCenterValue( const TreeOctNode::ConstNeighborKey3& neighborKey3 , const TreeOctNode* node );
 	static bool _IsInset( const TreeOctNode* node );
 	static bool _IsInsetSupported( const TreeOctNode* node );
+	// The class of the node's offset modulo period, used to schedule the sub-domains of the subdivided solve
+	static int _SubDomainColor( const TreeOctNode* node , int period );
+	int _reductionBlocks( void ) const { return deterministic ? DETERMINISTIC_BLOCKS : threads; }
+
+	// Helpers of ClipTree, finalize and refineBoundary
+	bool _hasNormal( const TreeOctNode* node ) const;
+	// Clips the subtrees without normals below node, returns true if node or a node below it has a normal
+	bool _clipSubtree( TreeOctNode* node ) const;
+	// The sides of the leaf ([axis][side]) on the boundary of a subtree of depth sDepth, but not on the boundary of the tree
+	static bool _subdivisionBoundary( const TreeOctNode* leaf , int sDepth , bool boundary[3][2] );
+	// Flags the neighbors the leaf misses across those sides, as NeighborKey3::setNeighbors expects them, returns false if there are none
+	template< class Neighbors >
+	static bool _boundaryRefinementFlags( const bool boundary[3][2] , const Neighbors& neighbors , bool flags[3][3][3] );
+	// Orders the nodes of the tree as OctNode::nextNode visits them (ancestors share the key of their first descendants)
+	static unsigned long long _depthFirstKey( const TreeOctNode* node , int maxDepth );
+	// Calls initChildren on those of the nodes without children, in parallel. If the calling thread uses an allocator,
+	// the other threads take the children from their own allocator in _nodeAllocators, which lives as long as the tree.
+	void _initChildren( const std::vector< TreeOctNode* >& nodes );
+	std::vector< AllocatorT< TreeOctNode >* > _nodeAllocators;
 public:
 	int threads;
-	static double maxMemoryUsage;
+	// If set, the output does not depend on the number of threads: sums are reduced over DETERMINISTIC_BLOCKS
+	// fixed blocks and the iso-surface vertices and polygons are emitted in a fixed order.
+	bool deterministic;
+	// If set, the CG tolerance of every depth is relative to its discretization error (see _adaptiveTolerance) instead of
+	// its size, a solve stops once its residual stagnates, and one that still converges may exceed its nominal iterations.
+	bool adaptiveConvergence;
+	static POISSON_THREAD_LOCAL double maxMemoryUsage;
 	static double MemoryUsage( void );
 	std::vector< Point3D<Real> >* normals;
 	Real postDerivativeSmooth;
+	// Optional hook called by LaplacianMatrixIteration once the solution up to a depth is known. The depth is given
+	// as passed to setTree/setTreeMemory. Returning false stops the solver.
+	bool (*depthSolvedCallback)( int depth , void* userData );
+	void* depthSolvedUserData;
 	TreeOctNode tree;
 	BSplineData< Degree , Real > fData;
 	Octree( void );
+	~Octree( void );
 
 	void setBSplineData( int maxDepth , int boundaryType=BSplineElements< Degree >::NONE );
+	// Restricts the reconstruction to the box [min,max]. Points farther than margin (relative to the largest box extent)
+	// outside the box are ignored, points in the margin are splatted coarsening levels above the maximum depth and
+	// iso-surface extraction only visits leaves touching the box. Must be called before setTreeMemory.
+	void setROI( const Point3D< Real >& min , const Point3D< Real >& max , Real margin=Real(0.1) , int coarsening=2 );
+	// Maps the input point p to (p-origin)/scale in the unit cube, instead of fitting the cube to the bounding box of
+	// the points in setTreeMemory. Points falling outside the cube are ignored then. Must be called before setTreeMemory.
+	void setFrame( const Point3D< Real >& origin , Real scale );
+	// The origin and scale of the unit cube, valid after setTreeMemory
+	void getFrame( Point3D< Real >& origin , Real& scale ) const { origin = _center , scale = _scale; }
+	// The box, in the coordinates of the input points, outside of which points are ignored, valid after setTreeMemory
+	void getBounds( Point3D< Real >& min , Point3D< Real >& max ) const;
+	// Width of the nodes at the given depth in the coordinates of the input points, valid after setTreeMemory
+	Real cellWidth( int depth ) const { return _scale / Real( 1<<depth ); }
 	void finalize( int subdivisionDepth );
 	int refineBoundary( int subdivisionDepth );
 	Pointer( Real ) GetSolutionGrid( int& res , Real isoValue=0.f , int depth=-1 );
+	// Position of the first sample and sample distance of a solution grid with resolution res, in the coordinates of the input points
+	void GetSolutionGridFrame( int res , Point3D< Real >& origin , Real& spacing ) const;
+	// Cheap preview extraction: marching cubes on the solution sampled on the regular grid of the given depth,
+	// with the iso-value estimated from the samples. Returns the number of triangles added to the mesh.
+	int GetSolutionGridIsoTriangles( int depth , CoredMeshData* mesh );
 	int setTree( char* fileName , int maxDepth , int minDepth , int kernelDepth , Real samplesPerNode ,
         Real scaleFactor , int useConfidence , Real constraintWeight , int adaptiveExponent , XForm4x4< Real > xForm=XForm4x4< Real >::Identity() );
     int setTreeMemory( std::vector< Real >& _pts_stream, int maxDepth , int minDepth ,
                                 int splatDepth , Real samplesPerNode , Real scaleFactor ,
                                 int useConfidence , Real constraintWeight , int adaptiveExponent , XForm4x4< Real > xForm=XForm4x4< Real >::Identity() );
     void SetLaplacianConstraints(void);
+	// Sets the constraints computed by SetLaplacianConstraints for the same tree and normals, see getConstraints
+	void SetLaplacianConstraints( const std::vector< Real >& constraints );
 	void ClipTree(void);
 	int LaplacianMatrixIteration( int subdivideDepth , bool showResidual , int minIters , double accuracy , int maxSolveDepth , int fixedIters );
+	// Residuals and iterations of the depths solved by the last LaplacianMatrixIteration, coarsest first
+	const std::vector< SolverDepthStatistics >& solverStatistics( void ) const { return _solverStatistics; }
+
+	// Warm start of a solve on the same points: the keys, constraints and coefficients of the nodes in sorted order,
+	// valid after finalize. setSolution uses the coefficients of the nodes with a matching key as the initial guess
+	// of LaplacianMatrixIteration, which then measures its accuracy against the residual of a zero guess.
+	void getNodeKeys( std::vector< long long >& keys ) const;
+	void getConstraints( std::vector< Real >& constraints ) const;
+	void getSolution( std::vector< Real >& solution ) const;
+	void setSolution( const std::vector< long long >& keys , const std::vector< Real >& solution );
 
 	Real GetIsoValue( void );
 	void GetMCIsoTriangles( Real isoValue , int subdivideDepth , CoredMeshData* mesh , int fullDepthIso=0 , int nonLinearFit=1 , bool addBarycenter=false , bool polygonMesh=false );
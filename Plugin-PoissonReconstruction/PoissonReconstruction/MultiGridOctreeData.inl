@@ -34,7 +34,13 @@ DAMAGE.
 #include "PointStream.h"
 #include "MAT.h"
 
+#include <functional>
+#include <queue>
+
 #define ITERATION_POWER 1.0/3
+#define STAGNATION_WINDOW 10		// With Octree::adaptiveConvergence, a CG solve stops once its residual has dropped by less
+#define STAGNATION_REDUCTION 0.01	// than STAGNATION_REDUCTION over the last STAGNATION_WINDOW iterations
+#define MAX_ADAPTIVE_TOLERANCE 0.1	// Bound of the relative residual tolerances set by Octree::adaptiveConvergence
 #define MEMORY_ALLOCATOR_BLOCK_SIZE 1<<12
 //#define MEMORY_ALLOCATOR_BLOCK_SIZE 0
 #define SPLAT_ORDER 2
@@ -52,6 +58,8 @@ SortedTreeNodes::SortedTreeNodes( void )
 {
     nodeCount = NULL;
     treeNodes = NullPointer< TreeOctNode* >();
+    leafCount = NULL;
+    leaves = NullPointer< TreeOctNode* >();
     maxDepth = 0;
 }
 SortedTreeNodes::~SortedTreeNodes( void )
@@ -59,31 +67,115 @@ SortedTreeNodes::~SortedTreeNodes( void )
     if( nodeCount ) delete[] nodeCount;
     nodeCount = NULL;
     if( treeNodes ) DeletePointer(  treeNodes );
+    if( leafCount ) delete[] leafCount;
+    leafCount = NULL;
+    if( leaves ) DeletePointer( leaves );
 }
 
-void SortedTreeNodes::set( TreeOctNode& root )
+void SortedTreeNodes::set( TreeOctNode& root , int threads )
 {
+    if( threads<=0 ) threads = 1;
     if( nodeCount ) delete[] nodeCount;
     if( treeNodes ) DeletePointer( treeNodes );
+    if( leafCount ) delete[] leafCount;
+    if( leaves ) DeletePointer( leaves );
     maxDepth = root.maxDepth()+1;
-    nodeCount = new int[ maxDepth+1 ];
+    nodeCount = new node_index_type[ maxDepth+1 ];
+    leafCount = new node_index_type[ maxDepth+1 ];
     treeNodes = NewPointer< TreeOctNode* >( root.nodes() );
 
-    int startDepth = 0;
-    startDepth = 0;
     nodeCount[0] = 0 , nodeCount[1] = 1;
     treeNodes[0] = &root;
-    for( TreeOctNode* node=root.nextNode() ; node ; node=root.nextNode( node ) ) node->nodeData.nodeIndex = -1;
-    for( int d=startDepth+1 ; d<maxDepth ; d++ )
+    // Level-by-level breadth-first ordering. Every node of the tree is reached, so all node indices get (re)set.
+    // Each thread counts the children of its share of the coarser level and a prefix sum over the counts gives
+    // the position at which it writes them, so the ordering is the same as for the serial traversal.
+    std::vector< node_index_type > offsets( threads+1 );
+    for( int d=1 ; d<maxDepth ; d++ )
     {
-        nodeCount[d+1] = nodeCount[d];
-        for( int i=nodeCount[d-1] ; i<nodeCount[d] ; i++ )
+        node_index_type start = nodeCount[d-1] , count = nodeCount[d]-nodeCount[d-1];
+#ifdef USE_OPENMP
+#pragma omp parallel for num_threads( threads )
+#endif
+        for( int t=0 ; t<threads ; t++ )
+        {
+            node_index_type c = 0;
+            for( node_index_type i=start+(count*t)/threads ; i<start+(count*(t+1))/threads ; i++ ) if( treeNodes[i]->children ) c += Cube::CORNERS;
+            offsets[t+1] = c;
+        }
+        offsets[0] = nodeCount[d];
+        for( int t=0 ; t<threads ; t++ ) offsets[t+1] += offsets[t];
+#ifdef USE_OPENMP
+#pragma omp parallel for num_threads( threads )
+#endif
+        for( int t=0 ; t<threads ; t++ )
         {
-            TreeOctNode* temp = treeNodes[i];
-            if( temp->children ) for( int c=0 ; c<8 ; c++ ) treeNodes[ nodeCount[d+1]++ ] = temp->children + c;
+            node_index_type idx = offsets[t];
+            for( node_index_type i=start+(count*t)/threads ; i<start+(count*(t+1))/threads ; i++ )
+            {
+                TreeOctNode* temp = treeNodes[i];
+                if( temp->children ) for( int c=0 ; c<8 ; c++ ) treeNodes[ idx++ ] = temp->children + c;
+            }
         }
+        nodeCount[d+1] = offsets[threads];
+    }
+#ifdef USE_OPENMP
+#pragma omp parallel for num_threads( threads )
+#endif
+    for( node_index_type i=0 ; i<nodeCount[maxDepth] ; i++ ) treeNodes[i]->nodeData.nodeIndex = i;
+
+    // Per-depth leaf lists, using the same counting / prefix sum scheme
+    std::vector< std::vector< node_index_type > > counts( maxDepth , std::vector< node_index_type >( threads , 0 ) );
+#ifdef USE_OPENMP
+#pragma omp parallel for num_threads( threads )
+#endif
+    for( int t=0 ; t<threads ; t++ ) for( int d=0 ; d<maxDepth ; d++ )
+    {
+        node_index_type start = nodeCount[d] , count = nodeCount[d+1]-nodeCount[d];
+        for( node_index_type i=start+(count*t)/threads ; i<start+(count*(t+1))/threads ; i++ ) if( !treeNodes[i]->children ) counts[d][t]++;
+    }
+    leafCount[0] = 0;
+    for( int d=0 ; d<maxDepth ; d++ )
+    {
+        leafCount[d+1] = leafCount[d];
+        for( int t=0 ; t<threads ; t++ ) leafCount[d+1] += counts[d][t];
+    }
+    leaves = NewPointer< TreeOctNode* >( std::max< node_index_type >( leafCount[maxDepth] , 1 ) );
+#ifdef USE_OPENMP
+#pragma omp parallel for num_threads( threads )
+#endif
+    for( int t=0 ; t<threads ; t++ ) for( int d=0 ; d<maxDepth ; d++ )
+    {
+        node_index_type start = nodeCount[d] , count = nodeCount[d+1]-nodeCount[d];
+        node_index_type idx = leafCount[d];
+        for( int _t=0 ; _t<t ; _t++ ) idx += counts[d][_t];
+        for( node_index_type i=start+(count*t)/threads ; i<start+(count*(t+1))/threads ; i++ ) if( !treeNodes[i]->children ) leaves[ idx++ ] = treeNodes[i];
+    }
+}
+void SortedTreeNodes::leafRange( const TreeOctNode* node , int depth , node_index_type& start , node_index_type& end ) const
+{
+    start = end = 0;
+    if( depth<node->d || depth>=maxDepth ) return;
+    // The leaves of a depth are sorted by their ancestors' indices, so the descendants of node are contiguous
+    node_index_type key = node->nodeData.nodeIndex;
+    node_index_type lo = leafCount[depth] , hi = leafCount[depth+1];
+    while( lo<hi )
+    {
+        node_index_type mid = (lo+hi)>>1;
+        const TreeOctNode* temp = leaves[mid];
+        while( temp->d>node->d ) temp = temp->parent;
+        if( temp->nodeData.nodeIndex<key ) lo = mid+1;
+        else                               hi = mid;
+    }
+    start = lo , hi = leafCount[depth+1];
+    while( lo<hi )
+    {
+        node_index_type mid = (lo+hi)>>1;
+        const TreeOctNode* temp = leaves[mid];
+        while( temp->d>node->d ) temp = temp->parent;
+        if( temp->nodeData.nodeIndex<=key ) lo = mid+1;
+        else                                hi = mid;
     }
-    for( int i=0 ; i<nodeCount[maxDepth] ; i++ ) treeNodes[i]->nodeData.nodeIndex = i;
+    end = lo;
 }
 SortedTreeNodes::CornerIndices& SortedTreeNodes::CornerTableData::operator[] ( const TreeOctNode* node ) { return cTable[ node->nodeData.nodeIndex + offsets[node->d] ]; }
 const SortedTreeNodes::CornerIndices& SortedTreeNodes::CornerTableData::operator[] ( const TreeOctNode* node ) const { return cTable[ node->nodeData.nodeIndex + offsets[node->d] ]; }
@@ -93,11 +185,11 @@ void SortedTreeNodes::setCornerTable( CornerTableData& cData , const TreeOctNode
 {
     if( threads<=0 ) threads = 1;
     // The vector of per-depth node spans
-    std::vector< std::pair< int , int > > spans( this->maxDepth , std::pair< int , int >( -1 , -1 ) );
+    std::vector< std::pair< node_index_type , node_index_type > > spans( this->maxDepth , std::pair< node_index_type , node_index_type >( -1 , -1 ) );
     int minDepth , off[3];
     cData.offsets.resize( this->maxDepth , -1 );
-    int start = 0;
-    int end   = 0;
+    node_index_type start = 0;
+    node_index_type end   = 0;
     
     if( rootNode ) rootNode->depthAndOffset( minDepth , off ) , start = end = rootNode->nodeData.nodeIndex;
     else
@@ -105,10 +197,10 @@ void SortedTreeNodes::setCornerTable( CornerTableData& cData , const TreeOctNode
         start = 0;
         for( minDepth=0 ; minDepth<=this->maxDepth ; minDepth++ ) if( nodeCount[minDepth+1] ){ end = nodeCount[minDepth+1]-1 ; break; }
     }
-    int nodeCount = 0;
+    node_index_type nodeCount = 0;
     for( int d=minDepth ; d<=maxDepth ; d++ )
     {
-        spans[d] = std::pair< int , int >( start , end+1 );
+        spans[d] = std::pair< node_index_type , node_index_type >( start , end+1 );
         cData.offsets[d] = nodeCount - spans[d].first;
         nodeCount += spans[d].second - spans[d].first;
         if( d<maxDepth )
@@ -122,7 +214,7 @@ void SortedTreeNodes::setCornerTable( CornerTableData& cData , const TreeOctNode
     }
 
     cData.cTable.resize( nodeCount );
-    std::vector< int > count( threads );
+    std::vector< node_index_type > count( threads );
 #ifdef USE_OPENMP 
 #pragma omp parallel for num_threads( threads )
 #endif
@@ -130,12 +222,12 @@ void SortedTreeNodes::setCornerTable( CornerTableData& cData , const TreeOctNode
     {
         TreeOctNode::ConstNeighborKey3 neighborKey;
         neighborKey.set( maxDepth );
-        int offset = nodeCount * t * Cube::CORNERS;
+        node_index_type offset = nodeCount * t * Cube::CORNERS;
         count[t] = 0;
         for( int d=minDepth ; d<=maxDepth ; d++ )
         {
-            int start = spans[d].first , end = spans[d].second , width = end-start;
-            for( int i=start + (width*t)/threads ; i<start + (width*(t+1))/threads ; i++ )
+            node_index_type start = spans[d].first , end = spans[d].second , width = end-start;
+            for( node_index_type i=start + (width*t)/threads ; i<start + (width*(t+1))/threads ; i++ )
             {
                 TreeOctNode* node = treeNodes[i];
                 if( d<maxDepth && node->children ) continue;
@@ -194,7 +286,7 @@ void SortedTreeNodes::setCornerTable( CornerTableData& cData , const TreeOctNode
         }
     }
     cData.cCount = 0;
-    std::vector< int > offsets( threads+1 );
+    std::vector< node_index_type > offsets( threads+1 );
     offsets[0] = 0;
     for( int t=0 ; t<threads ; t++ ) cData.cCount += count[t] , offsets[t+1] = offsets[t] + count[t];
     
@@ -204,37 +296,37 @@ void SortedTreeNodes::setCornerTable( CornerTableData& cData , const TreeOctNode
     for( int t=0 ; t<threads ; t++ )
         for( int d=minDepth ; d<=maxDepth ; d++ )
         {
-            int start = spans[d].first , end = spans[d].second , width = end - start;
-            for( int i=start + (width*t)/threads ; i<start+(width*(t+1))/threads ; i++ )
+            node_index_type start = spans[d].first , end = spans[d].second , width = end - start;
+            for( node_index_type i=start + (width*t)/threads ; i<start+(width*(t+1))/threads ; i++ )
                 for( unsigned int c=0 ; c<Cube::CORNERS ; c++ )
                 {
-                    int& idx = cData[ treeNodes[i] ][c];
+                    node_index_type& idx = cData[ treeNodes[i] ][c];
                     if( idx<0 )
                     {
-                        fprintf( stderr , "[ERROR] Found unindexed corner nodes[%d][%u] = %d (%d,%d)\n" , treeNodes[i]->nodeData.nodeIndex , c , idx , minDepth , maxDepth );
+                        fprintf( stderr , "[ERROR] Found unindexed corner nodes[%lld][%u] = %lld (%d,%d)\n" , (long long)treeNodes[i]->nodeData.nodeIndex , c , (long long)idx , minDepth , maxDepth );
                         int _d , _off[3];
                         treeNodes[i]->depthAndOffset( _d , _off );
                         if( rootNode )
                             printf( "(%d [%d %d %d) <-> (%d [%d %d %d])\n" , minDepth , off[0] , off[1] , off[2] , _d , _off[0] , _off[1] , _off[2] );
                         else
                           std::cerr << "NULL <-> ( " << minDepth << " [ " << off[0] << " " << off[1] << " " << off[2] << " ]) " << _d  << std::endl;
-                        printf( "[%d %d]\n" , spans[d].first , spans[d].second );
+                        printf( "[%lld %lld]\n" , (long long)spans[d].first , (long long)spans[d].second );
                         exit( 0 );
                     }
                     else
                     {
-                        int div = idx / ( nodeCount*Cube::CORNERS );
-                        int rem = idx % ( nodeCount*Cube::CORNERS );
+                        node_index_type div = idx / ( nodeCount*Cube::CORNERS );
+                        node_index_type rem = idx % ( nodeCount*Cube::CORNERS );
                         idx = rem + offsets[div];
                     }
                 }
         }
 }
-int SortedTreeNodes::getMaxCornerCount( int depth , int maxDepth , int threads ) const
+node_index_type SortedTreeNodes::getMaxCornerCount( int depth , int maxDepth , int threads ) const
 {
     if( threads<=0 ) threads = 1;
     int res = 1<<depth;
-    std::vector< std::vector< int > > cornerCount( threads );
+    std::vector< std::vector< node_index_type > > cornerCount( threads );
     for( int t=0 ; t<threads ; t++ ) cornerCount[t].resize( res*res*res , 0 );
 
 #ifdef USE_OPENMP 
@@ -242,11 +334,11 @@ int SortedTreeNodes::getMaxCornerCount( int depth , int maxDepth , int threads )
 #endif
     for( int t=0 ; t<threads ; t++ )
     {
-        std::vector< int >& _cornerCount = cornerCount[t];
+        std::vector< node_index_type >& _cornerCount = cornerCount[t];
         TreeOctNode::ConstNeighborKey3 neighborKey;
         neighborKey.set( maxDepth );
-        int start = nodeCount[depth] , end = nodeCount[maxDepth+1] , range = end-start;
-        for( int i=(range*t)/threads ; i<(range*(t+1))/threads ; i++ )
+        node_index_type start = nodeCount[depth] , end = nodeCount[maxDepth+1] , range = end-start;
+        for( node_index_type i=(range*t)/threads ; i<(range*(t+1))/threads ; i++ )
         {
             TreeOctNode* node = treeNodes[start+i];
             int d , off[3];
@@ -276,12 +368,12 @@ int SortedTreeNodes::getMaxCornerCount( int depth , int maxDepth , int threads )
             }
         }
     }
-    int maxCount = 0;
+    node_index_type maxCount = 0;
     for( int i=0 ; i<res*res*res ; i++ )
     {
-        int c = 0;
+        node_index_type c = 0;
         for( int t=0 ; t<threads ; t++ ) c += cornerCount[t][i];
-        maxCount = std::max< int >( maxCount , c );
+        maxCount = std::max< node_index_type >( maxCount , c );
     }
     return maxCount;
 }
@@ -292,12 +384,12 @@ const SortedTreeNodes::EdgeIndices& SortedTreeNodes::EdgeTableData::edgeIndices(
 void SortedTreeNodes::setEdgeTable( EdgeTableData& eData , const TreeOctNode* rootNode , int maxDepth , int threads )
 {
     if( threads<=0 ) threads = 1;
-    std::vector< std::pair< int , int > > spans( this->maxDepth , std::pair< int , int >( -1 , -1 ) );
+    std::vector< std::pair< node_index_type , node_index_type > > spans( this->maxDepth , std::pair< node_index_type , node_index_type >( -1 , -1 ) );
 
     int minDepth;
     eData.offsets.resize( this->maxDepth , -1 );
-    int start = 0;
-    int end   = 0;
+    node_index_type start = 0;
+    node_index_type end   = 0;
     
     if( rootNode ) minDepth = rootNode->depth() , start = end = rootNode->nodeData.nodeIndex;
     else
@@ -306,11 +398,11 @@ void SortedTreeNodes::setEdgeTable( EdgeTableData& eData , const TreeOctNode* ro
         for( minDepth=0 ; minDepth<=this->maxDepth ; minDepth++ ) if( nodeCount[minDepth+1] ){ end = nodeCount[minDepth+1]-1 ; break; }
     }
 
-    int nodeCount = 0;
+    node_index_type nodeCount = 0;
     {
         for( int d=minDepth ; d<=maxDepth ; d++ )
         {
-            spans[d] = std::pair< int , int >( start , end+1 );
+            spans[d] = std::pair< node_index_type , node_index_type >( start , end+1 );
             eData.offsets[d] = nodeCount - spans[d].first;
             nodeCount += spans[d].second - spans[d].first;
             if( d<maxDepth )
@@ -324,7 +416,7 @@ void SortedTreeNodes::setEdgeTable( EdgeTableData& eData , const TreeOctNode* ro
         }
     }
     eData.eTable.resize( nodeCount );
-    std::vector< int > count( threads );
+    std::vector< node_index_type > count( threads );
 
 #ifdef USE_OPENMP 
 #pragma omp parallel for num_threads( threads )
@@ -333,12 +425,12 @@ void SortedTreeNodes::setEdgeTable( EdgeTableData& eData , const TreeOctNode* ro
     {
         TreeOctNode::ConstNeighborKey3 neighborKey;
         neighborKey.set( maxDepth );
-        int offset = nodeCount * t * Cube::EDGES;
+        node_index_type offset = nodeCount * t * Cube::EDGES;
         count[t] = 0;
         for( int d=minDepth ; d<=maxDepth ; d++ )
         {
-            int start = spans[d].first , end = spans[d].second , width = end-start;
-            for( int i=start + (width*t)/threads ; i<start + (width*(t+1))/threads ; i++ )
+            node_index_type start = spans[d].first , end = spans[d].second , width = end-start;
+            for( node_index_type i=start + (width*t)/threads ; i<start + (width*(t+1))/threads ; i++ )
             {
                 TreeOctNode* node = treeNodes[i];
                 const TreeOctNode::ConstNeighbors3& neighbors = neighborKey.getNeighbors( node , minDepth );
@@ -399,7 +491,7 @@ void SortedTreeNodes::setEdgeTable( EdgeTableData& eData , const TreeOctNode* ro
         }
     }
     eData.eCount = 0;
-    std::vector< int > offsets( threads+1 );
+    std::vector< node_index_type > offsets( threads+1 );
     offsets[0] = 0;
     for( int t=0 ; t<threads ; t++ ) eData.eCount += count[t] , offsets[t+1] = offsets[t] + count[t];
     
@@ -409,26 +501,26 @@ void SortedTreeNodes::setEdgeTable( EdgeTableData& eData , const TreeOctNode* ro
     for( int t=0 ; t<threads ; t++ )
         for( int d=minDepth ; d<=maxDepth ; d++ )
         {
-            int start = spans[d].first , end = spans[d].second , width = end - start;
-            for( int i=start + (width*t)/threads ; i<start+(width*(t+1))/threads ; i++ )
+            node_index_type start = spans[d].first , end = spans[d].second , width = end - start;
+            for( node_index_type i=start + (width*t)/threads ; i<start+(width*(t+1))/threads ; i++ )
                 for( unsigned int e=0 ; e<Cube::EDGES ; e++ )
                 {
-                    int& idx = eData[ treeNodes[i] ][e];
-                    if( idx<0 ) fprintf( stderr , "[ERROR] Found unindexed edge %d (%d,%d)\n" , idx , minDepth , maxDepth ) , exit( 0 );
+                    node_index_type& idx = eData[ treeNodes[i] ][e];
+                    if( idx<0 ) fprintf( stderr , "[ERROR] Found unindexed edge %lld (%d,%d)\n" , (long long)idx , minDepth , maxDepth ) , exit( 0 );
                     else
                     {
-                        int div = idx / ( nodeCount*Cube::EDGES );
-                        int rem = idx % ( nodeCount*Cube::EDGES );
+                        node_index_type div = idx / ( nodeCount*Cube::EDGES );
+                        node_index_type rem = idx % ( nodeCount*Cube::EDGES );
                         idx = rem + offsets[div];
                     }
                 }
         }
 }
-int SortedTreeNodes::getMaxEdgeCount( const TreeOctNode* rootNode , int depth , int threads ) const
+node_index_type SortedTreeNodes::getMaxEdgeCount( const TreeOctNode* rootNode , int depth , int threads ) const
 {
     if( threads<=0 ) threads = 1;
     int res = 1<<depth;
-    std::vector< std::vector< int > > edgeCount( threads );
+    std::vector< std::vector< node_index_type > > edgeCount( threads );
     for( int t=0 ; t<threads ; t++ ) edgeCount[t].resize( res*res*res , 0 );
 
 #ifdef USE_OPENMP 
@@ -436,11 +528,11 @@ int SortedTreeNodes::getMaxEdgeCount( const TreeOctNode* rootNode , int depth ,
 #endif
     for( int t=0 ; t<threads ; t++ )
     {
-        std::vector< int >& _edgeCount = edgeCount[t];
+        std::vector< node_index_type >& _edgeCount = edgeCount[t];
         TreeOctNode::ConstNeighborKey3 neighborKey;
         neighborKey.set( maxDepth-1 );
-        int start = nodeCount[depth] , end = nodeCount[maxDepth] , range = end-start;
-        for( int i=(range*t)/threads ; i<(range*(t+1))/threads ; i++ )
+        node_index_type start = nodeCount[depth] , end = nodeCount[maxDepth] , range = end-start;
+        for( node_index_type i=(range*t)/threads ; i<(range*(t+1))/threads ; i++ )
         {
             TreeOctNode* node = treeNodes[start+i];
             const TreeOctNode::ConstNeighbors3& neighbors = neighborKey.getNeighbors( node , depth );
@@ -475,12 +567,12 @@ int SortedTreeNodes::getMaxEdgeCount( const TreeOctNode* rootNode , int depth ,
             }
         }
     }
-    int maxCount = 0;
+    node_index_type maxCount = 0;
     for( int i=0 ; i<res*res*res ; i++ )
     {
-        int c = 0;
+        node_index_type c = 0;
         for( int t=0 ; t<threads ; t++ ) c += edgeCount[t][i];
-        maxCount = std::max< int >( maxCount , c );
+        maxCount = std::max< node_index_type >( maxCount , c );
     }
     return maxCount;
 }
@@ -504,7 +596,7 @@ TreeNodeData::~TreeNodeData( void ) { }
 ////////////
 // Octree //
 ////////////
-template< int Degree > double Octree< Degree >::maxMemoryUsage=0;
+template< int Degree > POISSON_THREAD_LOCAL double Octree< Degree >::maxMemoryUsage=0;
 
 template<int Degree>
 double Octree<Degree>::MemoryUsage(void)
@@ -518,6 +610,8 @@ template<int Degree>
 Octree<Degree>::Octree(void)
 {
     threads = 1;
+    deterministic = false;
+    adaptiveConvergence = false;
     radius = 0;
     width = 0;
     postDerivativeSmooth = 0;
@@ -526,6 +620,50 @@ Octree<Degree>::Octree(void)
     _boundaryType = 0;
     _scale = Real(0);
     normals = NULL;
+    _useROI = false;
+    _roiMargin = Real(0);
+    _roiCoarsening = 0;
+    _warmStart = false;
+    _fixedFrame = false;
+    depthSolvedCallback = NULL;
+    depthSolvedUserData = NULL;
+}
+template< int Degree >
+Octree< Degree >::~Octree( void )
+{
+    // Release the nodes of the worker threads while one of their allocators is current, so that the node
+    // destructors leave the pooled children alone
+    if( !_nodeAllocators.empty() )
+    {
+        AllocatorT< TreeOctNode >* allocator = TreeOctNode::ThreadAllocator();
+        TreeOctNode::SetThreadAllocator( _nodeAllocators[0] );
+        for( size_t i=0 ; i<_nodeAllocators.size() ; i++ ) delete _nodeAllocators[i];
+        TreeOctNode::SetThreadAllocator( allocator );
+    }
+}
+template< int Degree >
+void Octree< Degree >::_initChildren( const std::vector< TreeOctNode* >& nodes )
+{
+    int workers = std::max< int >( 1 , std::min< int >( threads , int( nodes.size() ) ) );
+    bool pooled = TreeOctNode::UseAllocator()!=0;
+    if( pooled ) while( int( _nodeAllocators.size() )<workers-1 )
+    {
+        _nodeAllocators.push_back( new AllocatorT< TreeOctNode >() );
+        _nodeAllocators.back()->set( MEMORY_ALLOCATOR_BLOCK_SIZE );
+    }
+#ifdef USE_OPENMP
+#pragma omp parallel num_threads( workers )
+#endif
+    {
+        int t = 0;
+#ifdef USE_OPENMP
+        t = omp_get_thread_num();
+#endif
+        AllocatorT< TreeOctNode >* allocator = TreeOctNode::ThreadAllocator();
+        if( t ) TreeOctNode::SetThreadAllocator( pooled ? _nodeAllocators[t-1] : NULL );
+        for( size_t i=( nodes.size()*t )/workers ; i<( nodes.size()*(t+1) )/workers ; i++ ) if( !nodes[i]->children ) nodes[i]->initChildren();
+        if( t ) TreeOctNode::SetThreadAllocator( allocator );
+    }
 }
 
 template< int Degree >
@@ -544,6 +682,13 @@ bool Octree< Degree >::_IsInsetSupported( const TreeOctNode* node )
     int res = 1<<d , o = (1<<(d-2))-1;
     return ( off[0]>=o && off[0]<res-o && off[1]>=o && off[1]<res-o && off[2]>=o && off[2]<res-o );
 }
+template< int Degree >
+int Octree< Degree >::_SubDomainColor( const TreeOctNode* node , int period )
+{
+    int d , off[3];
+    node->depthAndOffset( d , off );
+    return ( off[0]%period ) + ( off[1]%period )*period + ( off[2]%period )*period*period;
+}
 
 template<int Degree>
 int Octree<Degree>::SplatOrientedPoint( TreeOctNode* node , const Point3D<Real>& position , const Point3D<Real>& normal , TreeOctNode::NeighborKey3& neighborKey )
@@ -594,13 +739,13 @@ int Octree<Degree>::SplatOrientedPoint( TreeOctNode* node , const Point3D<Real>&
             {
                 dxdydz = dxdy * dx[2][k];
                 TreeOctNode* _node = neighbors.neighbors[i][j][k];
-                int idx =_node->nodeData.normalIndex;
+                node_index_type idx =_node->nodeData.normalIndex;
                 if( idx<0 )
                 {
                     Point3D<Real> n;
                     n[0] = n[1] = n[2] = 0;
                     _node->nodeData.nodeIndex = 0;
-                    idx = _node->nodeData.normalIndex = int(normals->size());
+                    idx = _node->nodeData.normalIndex = node_index_type( normals->size() );
                     normals->push_back(n);
                 }
                 (*normals)[idx] += normal * Real( dxdydz );
@@ -730,13 +875,13 @@ int Octree<Degree>::SplatOrientedPoint( TreeOctNode* node , const Point3D<Real>&
             {
                 dxdydz = dxdy * dx[2][k];
                 TreeOctNode* _node = neighbors.neighbors[i+1][j+1][k+1];
-                int idx =_node->nodeData.normalIndex;
+                node_index_type idx =_node->nodeData.normalIndex;
                 if( idx<0 )
                 {
                     Point3D<Real> n;
                     n[0] = n[1] = n[2] = 0;
                     _node->nodeData.nodeIndex = 0;
-                    idx = _node->nodeData.normalIndex = int(normals->size());
+                    idx = _node->nodeData.normalIndex = node_index_type( normals->size() );
                     normals->push_back(n);
                 }
                 (*normals)[idx] += normal * Real( dxdydz );
@@ -913,6 +1058,42 @@ bool Octree< Degree >::_inBounds( Point3D< Real > p ) const
     return true;
 }
 template< int Degree >
+void Octree< Degree >::setROI( const Point3D< Real >& min , const Point3D< Real >& max , Real margin , int coarsening )
+{
+    _useROI = true;
+    _roiMin = min , _roiMax = max;
+    _roiMargin = std::max< Real >( max[0]-min[0] , std::max< Real >( max[1]-min[1] , max[2]-min[2] ) ) * std::max< Real >( margin , Real(0) );
+    _roiCoarsening = std::max< int >( coarsening , 0 );
+}
+template< int Degree >
+void Octree< Degree >::setFrame( const Point3D< Real >& origin , Real scale )
+{
+    _fixedFrame = true;
+    _center = origin , _scale = scale;
+}
+template< int Degree >
+void Octree< Degree >::getBounds( Point3D< Real >& min , Point3D< Real >& max ) const
+{
+    // The unit cube box of _inBounds, mapped back to the input coordinates
+    Real lo = _boundaryType==0 ? Real(0.25) : Real(0.00) , hi = _boundaryType==0 ? Real(0.75) : Real(1.00);
+    for( int d=0 ; d<DIMENSION ; d++ ) min[d] = _center[d] + lo*_scale , max[d] = _center[d] + hi*_scale;
+}
+template< int Degree >
+bool Octree< Degree >::_inROI( const Point3D< Real >& p , Real margin ) const
+{
+    for( int d=0 ; d<3 ; d++ ) if( p[d]<_roiMin[d]-margin || p[d]>_roiMax[d]+margin ) return false;
+    return true;
+}
+template< int Degree >
+bool Octree< Degree >::_intersectsBox( const TreeOctNode* node , const Point3D< Real >& min , const Point3D< Real >& max ) const
+{
+    Point3D< Real > center;
+    Real width;
+    node->centerAndWidth( center , width );
+    for( int d=0 ; d<3 ; d++ ) if( center[d]+width/2<min[d] || center[d]-width/2>max[d] ) return false;
+    return true;
+}
+template< int Degree >
 int Octree<Degree>::setTree( char* fileName , int maxDepth , int minDepth , 
                              int splatDepth , Real samplesPerNode , Real scaleFactor ,
                              int useConfidence , Real constraintWeight , int adaptiveExponent , XForm4x4< Real > xForm )
@@ -1069,10 +1250,10 @@ int Octree<Degree>::setTree( char* fileName , int maxDepth , int minDepth ,
             myWidth = Real(1.0);
             while( 1 )
             {
-                int idx = temp->nodeData.pointIndex;
+                node_index_type idx = temp->nodeData.pointIndex;
                 if( idx==-1 )
                 {
-                    idx = int( _points.size() );
+                    idx = node_index_type( _points.size() );
                     _points.push_back( PointData( p , Real(1.) ) );
                     temp->nodeData.pointIndex = idx;
                 }
@@ -1108,7 +1289,7 @@ int Octree<Degree>::setTree( char* fileName , int maxDepth , int minDepth ,
         for( TreeOctNode* node=tree.nextNode() ; node ; node=tree.nextNode(node) )
             if( node->nodeData.pointIndex!=-1 )
             {
-                int idx = node->nodeData.pointIndex;
+                node_index_type idx = node->nodeData.pointIndex;
                 _points[idx].position /= _points[idx].weight;
                 int e = ( _boundaryType==0 ? node->d-1 : node->d ) * adaptiveExponent - ( _boundaryType==0 ? maxDepth-1 : maxDepth ) * (adaptiveExponent-1);
                 if( e<0 ) _points[idx].weight /= Real( 1<<(-e) );
@@ -1149,7 +1330,7 @@ int Octree<Degree>::setTreeMemory( std::vector< Real >& _pts_stream, int maxDept
     double pointWeightSum = 0;
     Point3D< Real > min , max , myCenter;
     Real myWidth;
-    unsigned int cnt=0;
+    unsigned int cnt=0 , inCount=0;
     TreeOctNode* temp;
 
     TreeOctNode::NeighborKey3 neighborKey;
@@ -1177,21 +1358,28 @@ int Octree<Degree>::setTreeMemory( std::vector< Real >& _pts_stream, int maxDept
             }
 
             p = xForm * p;
+            cnt++;
+            if( _useROI && !_inROI( p , _roiMargin ) ) continue;
             for( int i=0 ; i<DIMENSION ; i++ )
             {
-                if( !cnt || p[i]<min[i] ) min[i] = p[i];
-                if( !cnt || p[i]>max[i] ) max[i] = p[i];
+                if( !inCount || p[i]<min[i] ) min[i] = p[i];
+                if( !inCount || p[i]>max[i] ) max[i] = p[i];
             }
-            cnt++;
+            inCount++;
         }
+        if( !inCount ) return 0;
 
-        if( _boundaryType==0 ) _scale = std::max< Real >( max[0]-min[0] , std::max< Real >( max[1]-min[1] , max[2]-min[2] ) ) * 2;
-        else         _scale = std::max< Real >( max[0]-min[0] , std::max< Real >( max[1]-min[1] , max[2]-min[2] ) );
-        _center = ( max+min ) /2;
+        if( !_fixedFrame )
+        {
+            if( _boundaryType==0 ) _scale = std::max< Real >( max[0]-min[0] , std::max< Real >( max[1]-min[1] , max[2]-min[2] ) ) * 2;
+            else         _scale = std::max< Real >( max[0]-min[0] , std::max< Real >( max[1]-min[1] , max[2]-min[2] ) );
+            _center = ( max+min ) /2;
+            _scale *= scaleFactor;
+            for( int i=0 ; i<DIMENSION ; i++ ) _center[i] -= _scale/2;
+        }
     }
 
-    _scale *= scaleFactor;
-    for( int i=0 ; i<DIMENSION ; i++ ) _center[i] -= _scale/2;
+    if( _useROI ) _roiNodeMin = ( _roiMin - _center ) / _scale , _roiNodeMax = ( _roiMax - _center ) / _scale;
     
     if( splatDepth>0 )
     {
@@ -1208,15 +1396,21 @@ int Octree<Degree>::setTreeMemory( std::vector< Real >& _pts_stream, int maxDept
             }
 
             p = xForm * p , n = xFormN * n;
+            int pointSplatDepth = splatDepth;
+            if( _useROI )
+            {
+                if( !_inROI( p , _roiMargin ) ){ cnt++ ; continue; }
+                if( !_inROI( p , Real(0) ) ) pointSplatDepth = std::min< int >( splatDepth , std::max< int >( _minDepth , maxDepth-_roiCoarsening ) );
+            }
             p = ( p - _center ) / _scale;
-            if( !_inBounds(p) ) continue;
+            if( !_inBounds(p) ){ cnt++ ; continue; }
             myCenter = Point3D< Real >( Real(0.5) , Real(0.5) , Real(0.5) );
             myWidth = Real(1.0);
             Real weight=Real( 1. );
             if( useConfidence ) weight = Real( Length(n) );
             temp = &tree;
             int d=0;
-            while( d<splatDepth )
+            while( d<pointSplatDepth )
             {
                 UpdateWeightContribution( temp , p , neighborKey , weight );
                 if( !temp->children ) temp->initChildren();
@@ -1252,6 +1446,21 @@ int Octree<Degree>::setTreeMemory( std::vector< Real >& _pts_stream, int maxDept
 
         n *= Real(-1.);
         p = xForm * p , n = xFormN * n;
+        // Points in the margin around the region of interest only constrain the coarser levels
+        int pointSplatDepth = splatDepth , pointMaxDepth = maxDepth;
+        if( _useROI )
+        {
+            if( !_inROI( p , _roiMargin ) )
+            {
+                ++curPt;
+                continue;
+            }
+            if( !_inROI( p , Real(0) ) )
+            {
+                pointMaxDepth = std::max< int >( _minDepth , maxDepth-_roiCoarsening );
+                pointSplatDepth = std::min< int >( splatDepth , pointMaxDepth );
+            }
+        }
         p = ( p - _center ) / _scale;
         if (!_inBounds(p))
         {
@@ -1274,7 +1483,7 @@ int Octree<Degree>::setTreeMemory( std::vector< Real >& _pts_stream, int maxDept
         Real pointWeight = Real(1.f);
         if( samplesPerNode>0 && splatDepth )
         {
-            pointWeight = SplatOrientedPoint( p , n , neighborKey , splatDepth , samplesPerNode , _minDepth , maxDepth );
+            pointWeight = SplatOrientedPoint( p , n , neighborKey , pointSplatDepth , samplesPerNode , _minDepth , pointMaxDepth );
         }
         else
         {
@@ -1282,7 +1491,7 @@ int Octree<Degree>::setTreeMemory( std::vector< Real >& _pts_stream, int maxDept
             int d=0;
             if( splatDepth )
             {
-                while( d<splatDepth )
+                while( d<pointSplatDepth )
                 {
                     int cIndex=TreeOctNode::CornerIndex(myCenter,p);
                     temp = &temp->children[cIndex];
@@ -1298,7 +1507,7 @@ int Octree<Degree>::setTreeMemory( std::vector< Real >& _pts_stream, int maxDept
                 pointWeight = GetSampleWeight( temp , p , neighborKey );
             }
             for( int i=0 ; i<DIMENSION ; i++ ) n[i] *= pointWeight;
-            while( d<maxDepth )
+            while( d<pointMaxDepth )
             {
                 if( !temp->children ) temp->initChildren();
                 int cIndex=TreeOctNode::CornerIndex(myCenter,p);
@@ -1323,10 +1532,10 @@ int Octree<Degree>::setTreeMemory( std::vector< Real >& _pts_stream, int maxDept
             myWidth = Real(1.0);
             while( 1 )
             {
-                int idx = temp->nodeData.pointIndex;
+                node_index_type idx = temp->nodeData.pointIndex;
                 if( idx==-1 )
                 {
-                    idx = int( _points.size() );
+                    idx = node_index_type( _points.size() );
                     _points.push_back( PointData( p , Real(1.) ) );
                     temp->nodeData.pointIndex = idx;
                 }
@@ -1363,7 +1572,7 @@ int Octree<Degree>::setTreeMemory( std::vector< Real >& _pts_stream, int maxDept
         for( TreeOctNode* node=tree.nextNode() ; node ; node=tree.nextNode(node) )
             if( node->nodeData.pointIndex!=-1 )
             {
-                int idx = node->nodeData.pointIndex;
+                node_index_type idx = node->nodeData.pointIndex;
                 _points[idx].position /= _points[idx].weight;
                 int e = ( _boundaryType==0 ? node->d-1 : node->d ) * adaptiveExponent - ( _boundaryType==0 ? maxDepth-1 : maxDepth ) * (adaptiveExponent-1);
                 if( e<0 ) _points[idx].weight /= Real( 1<<(-e) );
@@ -1403,25 +1612,69 @@ void Octree<Degree>::setBSplineData( int maxDepth , int boundaryType )
 template<int Degree>
 void Octree<Degree>::finalize( int subdivideDepth )
 {
+    // Every node with children needs the neighbors at offsets -2..1 along each axis, the part of its 5x5x5 neighborhood
+    // that NeighborKey5::setNeighbors creates for its first child. Going from the finest depth up, the missing ones are
+    // looked up in parallel and their parents refined at once. If the parent is missing too, the path from the root is
+    // created, and the new nodes on it are remembered as they are not in _sNodes.
+    double time = Time();
     int maxDepth = tree.maxDepth( );
-    TreeOctNode::NeighborKey5 nKey;
-    nKey.set( maxDepth );
-    for( int d=maxDepth ; d>0 ; d-- )
-        for( TreeOctNode* node=tree.nextNode() ; node ; node=tree.nextNode( node ) )
-            if( node->d==d )
+    _sNodes.set( tree , threads );
+    std::vector< std::vector< TreeOctNode* > > created( maxDepth+1 ) , parents( threads );
+    std::vector< std::vector< int > > paths( threads );
+    std::vector< TreeOctNode::ConstNeighborKey5 > nKeys( threads );
+    for( int d=maxDepth-1 ; d>0 ; d-- )
+    {
+        node_index_type sortedCount = _sNodes.nodeCount[d+1]-_sNodes.nodeCount[d] , count = sortedCount + node_index_type( created[d].size() );
+        int res = 1<<d;
+#ifdef USE_OPENMP
+#pragma omp parallel for num_threads( threads )
+#endif
+        for( int t=0 ; t<threads ; t++ )
+        {
+            // Start from an empty key, the neighborhoods of the last depth may miss nodes created since
+            nKeys[t].set( d );
+            parents[t].clear() , paths[t].clear();
+            for( node_index_type i=(count*t)/threads ; i<(count*(t+1))/threads ; i++ )
             {
-                int xStart=0 , xEnd=5 , yStart=0 , yEnd=5 , zStart=0 , zEnd=5;
-                int c = int( node - node->parent->children );
-                int x , y , z;
-                Cube::FactorCornerIndex( c , x , y , z );
-                if( x ) xStart = 1;
-                else    xEnd   = 4;
-                if( y ) yStart = 1;
-                else    yEnd   = 4;
-                if( z ) zStart = 1;
-                else    zEnd   = 4;
-                nKey.setNeighbors( node->parent , xStart , xEnd , yStart , yEnd , zStart , zEnd );
+                TreeOctNode* node = i<sortedCount ? _sNodes.treeNodes[ _sNodes.nodeCount[d]+i ] : created[d][ i-sortedCount ];
+                if( !node->children ) continue;
+                int _d , off[3];
+                node->depthAndOffset( _d , off );
+                const typename TreeOctNode::ConstNeighbors5& neighbors = nKeys[t].getNeighbors( node );
+                for( int x=0 ; x<4 ; x++ ) for( int y=0 ; y<4 ; y++ ) for( int z=0 ; z<4 ; z++ )
+                {
+                    int o[] = { off[0]+x-2 , off[1]+y-2 , off[2]+z-2 };
+                    if( neighbors.neighbors[x][y][z] || o[0]<0 || o[0]>=res || o[1]<0 || o[1]>=res || o[2]<0 || o[2]>=res ) continue;
+                    // The parent of the missing node is in the neighborhood of the node's parent
+                    const TreeOctNode* parent = nKeys[t].neighbors[d-1].neighbors[ 2+(o[0]>>1)-(off[0]>>1) ][ 2+(o[1]>>1)-(off[1]>>1) ][ 2+(o[2]>>1)-(off[2]>>1) ];
+                    if( parent ) parents[t].push_back( const_cast< TreeOctNode* >( parent ) );
+                    else paths[t].insert( paths[t].end() , o , o+3 );
+                }
+            }
+        }
+
+        std::vector< TreeOctNode* > refine;
+        for( int t=0 ; t<threads ; t++ ) refine.insert( refine.end() , parents[t].begin() , parents[t].end() );
+        std::sort( refine.begin() , refine.end() );
+        refine.erase( std::unique( refine.begin() , refine.end() ) , refine.end() );
+        _initChildren( refine );
+
+        for( int t=0 ; t<threads ; t++ ) for( size_t i=0 ; i<paths[t].size() ; i+=3 )
+        {
+            TreeOctNode* node = &tree;
+            for( int _d=0 ; _d<d ; _d++ )
+            {
+                if( !node->children )
+                {
+                    node->initChildren();
+                    for( unsigned int c=0 ; c<Cube::CORNERS ; c++ ) created[_d+1].push_back( node->children+c );
+                }
+                int shift = d-_d-1;
+                node = node->children + Cube::CornerIndex( (paths[t][i]>>shift)&1 , (paths[t][i+1]>>shift)&1 , (paths[t][i+2]>>shift)&1 );
             }
+        }
+    }
+    DumpOutput( "Time for neighbor refinement: %f\n" , Time()-time );
     refineBoundary( subdivideDepth );
 }
 template<int Degree>
@@ -1537,13 +1790,13 @@ int Octree< Degree >::GetMatrixRowSize( const OctNode< TreeNodeData , Real >::Ne
     return count;
 }
 template< int Degree >
-int Octree< Degree >::SetMatrixRow( const OctNode< TreeNodeData , Real >::Neighbors5& neighbors5 , Pointer( MatrixEntry< MatrixReal > ) row , int offset , const double stencil[5][5][5] ) const
+int Octree< Degree >::SetMatrixRow( const OctNode< TreeNodeData , Real >::Neighbors5& neighbors5 , Pointer( MatrixEntry< MatrixReal > ) row , node_index_type offset , const double stencil[5][5][5] ) const
 {
     return SetMatrixRow( neighbors5 , row , offset , stencil , 0 , 5 , 0 , 5 , 0 , 5 );
 }
 
 template< int Degree >
-int Octree< Degree >::SetMatrixRow( const OctNode< TreeNodeData , Real >::Neighbors5& neighbors5 , Pointer( MatrixEntry< MatrixReal > ) row , int offset , const double stencil[5][5][5] , int xStart , int xEnd , int yStart , int yEnd , int zStart , int zEnd ) const
+int Octree< Degree >::SetMatrixRow( const OctNode< TreeNodeData , Real >::Neighbors5& neighbors5 , Pointer( MatrixEntry< MatrixReal > ) row , node_index_type offset , const double stencil[5][5][5] , int xStart , int xEnd , int yStart , int yEnd , int zStart , int zEnd ) const
 {
     bool hasYZPoints[3] , hasZPoints[3][3];
     Real diagonal = 0;
@@ -1564,11 +1817,6 @@ int Octree< Degree >::SetMatrixRow( const OctNode< TreeNodeData , Real >::Neighb
 
     if( _constrainValues )
     {
-        int d , idx[3];
-        node->depthAndOffset( d , idx );
-        idx[0] = BinaryNode< double >::CenterIndex( d , idx[0] );
-        idx[1] = BinaryNode< double >::CenterIndex( d , idx[1] );
-        idx[2] = BinaryNode< double >::CenterIndex( d , idx[2] );
         for( int j=0 ; j<3 ; j++ )
         {
             hasYZPoints[j] = false;
@@ -1580,22 +1828,11 @@ int Octree< Degree >::SetMatrixRow( const OctNode< TreeNodeData , Real >::Neighb
                     const TreeOctNode* _node = neighbors5.neighbors[j+1][k+1][l+1];
                     if( _node && _node->nodeData.pointIndex!=-1 )
                     {
-                        const PointData& pData = _points[ _node->nodeData.pointIndex ];
                         Real* _splineValues = splineValues + 3*3*(3*(3*j+k)+l);
-                        Real weight = pData.weight;
-                        Point3D< Real > p = pData.position;
-                        for( int s=0 ; s<3 ; s++ )
-                        {
-#if ROBERTO_TOLDO_FIX
-                            if( idx[0]+j-s>=0 && idx[0]+j-s<((2<<node->d)-1) ) _splineValues[3*0+s] = Real( fData.baseBSplines[ idx[0]+j-s][s]( p[0] ) );
-                            if( idx[1]+k-s>=0 && idx[1]+k-s<((2<<node->d)-1) ) _splineValues[3*1+s] = Real( fData.baseBSplines[ idx[1]+k-s][s]( p[1] ) );
-                            if( idx[2]+l-s>=0 && idx[2]+l-s<((2<<node->d)-1) ) _splineValues[3*2+s] = Real( fData.baseBSplines[ idx[2]+l-s][s]( p[2] ) );
-#else // !ROBERTO_TOLDO_FIX
-                            _splineValues[3*0+s] = Real( fData.baseBSplines[ idx[0]+j-s][s]( p[0] ) );
-                            _splineValues[3*1+s] = Real( fData.baseBSplines[ idx[1]+k-s][s]( p[1] ) );
-                            _splineValues[3*2+s] = Real( fData.baseBSplines[ idx[2]+l-s][s]( p[2] ) );
-#endif // ROBERTO_TOLDO_FIX
-                        }
+                        Real weight = _points[ _node->nodeData.pointIndex ].weight;
+                        // Tabulated by SetCoarserPointValues
+                        const double* pointSplineValues = &_pointSplineValues[ 9*_node->nodeData.pointIndex ];
+                        for( int s=0 ; s<9 ; s++ ) _splineValues[s] = Real( pointSplineValues[s] );
                         Real value = _splineValues[3*0+j] * _splineValues[3*1+k] * _splineValues[3*2+l];
                         Real weightedValue = value * weight;
                         for( int s=0 ; s<3 ; s++ ) _splineValues[3*0+s] *= weightedValue;
@@ -1914,23 +2151,18 @@ void Octree< Degree >::UpdateConstraintsFromCoarser( const OctNode< TreeNodeData
     if( _constrainValues )
     {
         double constraint = 0;
-        int d , idx[3];
-        node->depthAndOffset( d, idx );
-        idx[0] = BinaryNode< double >::CenterIndex( d , idx[0] );
-        idx[1] = BinaryNode< double >::CenterIndex( d , idx[1] );
-        idx[2] = BinaryNode< double >::CenterIndex( d , idx[2] );
         const TreeOctNode::Neighbors5& neighbors5 = neighborKey5.neighbors[depth];
         for( int x=1 ; x<4 ; x++ ) for( int y=1 ; y<4 ; y++ ) for( int z=1 ; z<4 ; z++ )
             if( neighbors5.neighbors[x][y][z] && neighbors5.neighbors[x][y][z]->nodeData.pointIndex!=-1 )
             {
-                const PointData& pData = _points[ neighbors5.neighbors[x][y][z]->nodeData.pointIndex ];
-                Real pointValue = pData.coarserValue;
-                Point3D< Real > p = pData.position;
+                node_index_type pIdx = neighbors5.neighbors[x][y][z]->nodeData.pointIndex;
+                // The splines of this node are the (x-1)-th, (y-1)-th and (z-1)-th ones tabulated for the point
+                const double* pointSplineValues = &_pointSplineValues[ 9*pIdx ];
                 constraint +=
-                        fData.baseBSplines[idx[0]][x-1]( p[0] ) *
-                        fData.baseBSplines[idx[1]][y-1]( p[1] ) *
-                        fData.baseBSplines[idx[2]][z-1]( p[2] ) *
-                        pointValue;
+                        pointSplineValues[3*0+x-1] *
+                        pointSplineValues[3*1+y-1] *
+                        pointSplineValues[3*2+z-1] *
+                        _points[ pIdx ].coarserValue;
             }
         node->nodeData.constraint -= Real( constraint );
     }
@@ -1945,7 +2177,7 @@ struct UpSampleData
 template< int Degree >
 void Octree< Degree >::UpSampleCoarserSolution( int depth , const SortedTreeNodes& sNodes , PoissonVector< Real >& Solution ) const
 {
-    int start = sNodes.nodeCount[depth] , end = sNodes.nodeCount[depth+1] , range = end-start;
+    node_index_type start = sNodes.nodeCount[depth] , end = sNodes.nodeCount[depth+1] , range = end-start;
     Solution.Resize( range );
     double cornerValue;
     if     ( _boundaryType==-1 ) cornerValue = 0.50;
@@ -1962,7 +2194,7 @@ void Octree< Degree >::UpSampleCoarserSolution( int depth , const SortedTreeNode
         {
             TreeOctNode::NeighborKey3 neighborKey;
             neighborKey.set( depth );
-            for( int i=start+(range*t)/threads ; i<start+(range*(t+1))/threads ; i++ )
+            for( node_index_type i=start+(range*t)/threads ; i<start+(range*(t+1))/threads ; i++ )
             {
                 int d , off[3];
                 UpSampleData usData[3];
@@ -2000,7 +2232,7 @@ void Octree< Degree >::UpSampleCoarserSolution( int depth , const SortedTreeNode
 #ifdef USE_OPENMP     
 #pragma omp parallel for num_threads( threads )
 #endif
-    for( int i=start ; i<end ; i++ ) sNodes.treeNodes[i]->nodeData.solution = Real( 0. );
+    for( node_index_type i=start ; i<end ; i++ ) sNodes.treeNodes[i]->nodeData.solution = Real( 0. );
 }
 template< int Degree >
 void Octree< Degree >::DownSampleFinerConstraints( int depth , SortedTreeNodes& sNodes ) const
@@ -2013,20 +2245,18 @@ void Octree< Degree >::DownSampleFinerConstraints( int depth , SortedTreeNodes&
 #ifdef USE_OPENMP     
 #pragma omp parallel for num_threads( threads )
 #endif
-    for( int i=sNodes.nodeCount[depth-1] ; i<sNodes.nodeCount[depth] ; i++ )
+    for( node_index_type i=sNodes.nodeCount[depth-1] ; i<sNodes.nodeCount[depth] ; i++ )
         sNodes.treeNodes[i]->nodeData.constraint = Real( 0 );
 
     if( depth==1 )
     {
         sNodes.treeNodes[0]->nodeData.constraint = Real( 0 );
-        for( int i=sNodes.nodeCount[depth] ; i<sNodes.nodeCount[depth+1] ; i++ ) sNodes.treeNodes[0]->nodeData.constraint += sNodes.treeNodes[i]->nodeData.constraint;
+        for( node_index_type i=sNodes.nodeCount[depth] ; i<sNodes.nodeCount[depth+1] ; i++ ) sNodes.treeNodes[0]->nodeData.constraint += sNodes.treeNodes[i]->nodeData.constraint;
         return;
     }
-    std::vector< PoissonVector< double > > constraints( threads );
-    for( int t=0 ; t<threads ; t++ ) constraints[t].Resize( sNodes.nodeCount[depth] - sNodes.nodeCount[depth-1] ) , constraints[t].SetZero();
-    int start = sNodes.nodeCount[depth] , end = sNodes.nodeCount[depth+1] , range = end-start;
-    int lStart = sNodes.nodeCount[depth-1] , lEnd = sNodes.nodeCount[depth];
-    // For every node at the current depth
+    // Gather formulation: every coarser node collects the constraints of the children of its 3x3x3 neighbors
+    // whose up-sampling stencil covers it, so no per-thread copies of the coarser level are needed.
+    node_index_type lStart = sNodes.nodeCount[depth-1] , lEnd = sNodes.nodeCount[depth] , lRange = lEnd-lStart;
 #ifdef USE_OPENMP     
 #pragma omp parallel for num_threads( threads )
 #endif
@@ -2034,48 +2264,40 @@ void Octree< Degree >::DownSampleFinerConstraints( int depth , SortedTreeNodes&
     {
         TreeOctNode::NeighborKey3 neighborKey;
         neighborKey.set( depth );
-        for( int i=start+(range*t)/threads ; i<start+(range*(t+1))/threads ; i++ )
+        for( node_index_type i=lStart+(lRange*t)/threads ; i<lStart+(lRange*(t+1))/threads ; i++ )
         {
-            int d , off[3];
-            UpSampleData usData[3];
-            sNodes.treeNodes[i]->depthAndOffset( d , off );
-            for( int d=0 ; d<3 ; d++ )
-            {
-                if     ( off[d]  ==0          ) usData[d] = UpSampleData( 1 , cornerValue , 0.00 );
-                else if( off[d]+1==(1<<depth) ) usData[d] = UpSampleData( 0 , 0.00 , cornerValue );
-                else if( off[d]%2             ) usData[d] = UpSampleData( 1 , 0.75 , 0.25 );
-                else                            usData[d] = UpSampleData( 0 , 0.25 , 0.75 );
-            }
-            neighborKey.getNeighbors( sNodes.treeNodes[i]->parent );
-            TreeOctNode::Neighbors3& neighbors = neighborKey.neighbors[depth-1];
-            for( int ii=0 ; ii<2 ; ii++ )
+            TreeOctNode::Neighbors3& neighbors = neighborKey.getNeighbors( sNodes.treeNodes[i] );
+            double constraint = 0;
+            for( int x=0 ; x<3 ; x++ ) for( int y=0 ; y<3 ; y++ ) for( int z=0 ; z<3 ; z++ )
             {
-                int _ii = ii + usData[0].start;
-                double dx = usData[0].v[ii];
-                for( int jj=0 ; jj<2 ; jj++ )
+                const TreeOctNode* parent = neighbors.neighbors[x][y][z];
+                if( !parent || !parent->children ) continue;
+                // The position of the coarser node in the neighborhood of the child's parent
+                int _pos[] = { 2-x , 2-y , 2-z };
+                for( int c=0 ; c<Cube::CORNERS ; c++ )
                 {
-                    int _jj = jj + usData[1].start;
-                    double dxy = dx * usData[1].v[jj];
-                    for( int kk=0 ; kk<2 ; kk++ )
+                    const TreeOctNode* child = parent->children + c;
+                    if( child->nodeData.constraint==0 ) continue;
+                    int d , off[3];
+                    child->depthAndOffset( d , off );
+                    double dxyz = 1.;
+                    for( int dd=0 ; dd<3 && dxyz!=0 ; dd++ )
                     {
-                        int _kk = kk + usData[2].start;
-                        double dxyz = dxy * usData[2].v[kk];
-                        if( neighbors.neighbors[_ii][_jj][_kk]->nodeData.nodeIndex!=-1 )
-                            constraints[t][neighbors.neighbors[_ii][_jj][_kk]->nodeData.nodeIndex-lStart] += sNodes.treeNodes[i]->nodeData.constraint * dxyz;
+                        UpSampleData usData;
+                        if     ( off[dd]  ==0          ) usData = UpSampleData( 1 , cornerValue , 0.00 );
+                        else if( off[dd]+1==(1<<depth) ) usData = UpSampleData( 0 , 0.00 , cornerValue );
+                        else if( off[dd]%2             ) usData = UpSampleData( 1 , 0.75 , 0.25 );
+                        else                             usData = UpSampleData( 0 , 0.25 , 0.75 );
+                        if     ( _pos[dd]==usData.start   ) dxyz *= usData.v[0];
+                        else if( _pos[dd]==usData.start+1 ) dxyz *= usData.v[1];
+                        else                                dxyz  = 0;
                     }
+                    if( dxyz!=0 ) constraint += child->nodeData.constraint * dxyz;
                 }
             }
+            sNodes.treeNodes[i]->nodeData.constraint = Real( constraint );
         }
     }
-#ifdef USE_OPENMP     
-#pragma omp parallel for num_threads( threads )
-#endif
-    for( int i=lStart ; i<lEnd ; i++ )
-    {
-        Real cSum = Real(0.);
-        for( int t=0 ; t<threads ; t++ ) cSum += constraints[t][i-lStart];
-        sNodes.treeNodes[i]->nodeData.constraint += cSum;
-    }
 }
 template< int Degree >
 template< class C >
@@ -2086,18 +2308,19 @@ void Octree< Degree >::DownSample( int depth , const SortedTreeNodes& sNodes , C
     else if( _boundaryType== 1 ) cornerValue = 1.00;
     else                         cornerValue = 0.75;
     if( depth==0 ) return;
-    std::vector< PoissonVector< C > > _constraints( threads );
-    for( int t=0 ; t<threads ; t++ ) _constraints[t].Resize( sNodes.nodeCount[depth] - sNodes.nodeCount[depth-1] );
-    int start = sNodes.nodeCount[depth] , end = sNodes.nodeCount[depth+1] , range = end-start , lStart = sNodes.nodeCount[depth-1] , lEnd = sNodes.nodeCount[depth];
+    int blocks = _reductionBlocks();
+    std::vector< PoissonVector< C > > _constraints( blocks );
+    for( int t=0 ; t<blocks ; t++ ) _constraints[t].Resize( sNodes.nodeCount[depth] - sNodes.nodeCount[depth-1] );
+    node_index_type start = sNodes.nodeCount[depth] , end = sNodes.nodeCount[depth+1] , range = end-start , lStart = sNodes.nodeCount[depth-1] , lEnd = sNodes.nodeCount[depth];
     // For every node at the current depth
 #ifdef USE_OPENMP     
-#pragma omp parallel for num_threads( threads )
+#pragma omp parallel for num_threads( threads ) schedule( dynamic , 1 )
 #endif
-    for( int t=0 ; t<threads ; t++ )
+    for( int t=0 ; t<blocks ; t++ )
     {
         TreeOctNode::NeighborKey3 neighborKey;
         neighborKey.set( depth );
-        for( int i=start+(range*t)/threads ; i<start+(range*(t+1))/threads ; i++ )
+        for( node_index_type i=start+(range*t)/blocks ; i<start+(range*(t+1))/blocks ; i++ )
         {
             int d , off[3];
             UpSampleData usData[3];
@@ -2133,10 +2356,10 @@ void Octree< Degree >::DownSample( int depth , const SortedTreeNodes& sNodes , C
 #ifdef USE_OPENMP     
 #pragma omp parallel for num_threads( threads )
 #endif
-    for( int i=lStart ; i<lEnd ; i++ )
+    for( node_index_type i=lStart ; i<lEnd ; i++ )
     {
         C cSum = C(0);
-        for( int t=0 ; t<threads ; t++ ) cSum += _constraints[t][i-lStart];
+        for( int t=0 ; t<blocks ; t++ ) cSum += _constraints[t][i-lStart];
         constraints[i] += cSum;
     }
 }
@@ -2150,7 +2373,7 @@ void Octree< Degree >::UpSample( int depth , const SortedTreeNodes& sNodes , C*
     else                         cornerValue = 0.75;
     if     ( (_boundaryType!=0 && depth==0) || (_boundaryType==0 && depth<=2) ) return;
 
-    int start = sNodes.nodeCount[depth] , end = sNodes.nodeCount[depth+1] , range = end-start;
+    node_index_type start = sNodes.nodeCount[depth] , end = sNodes.nodeCount[depth+1] , range = end-start;
     // For every node at the current depth
 #ifdef USE_OPENMP     
 #pragma omp parallel for num_threads( threads )
@@ -2159,17 +2382,16 @@ void Octree< Degree >::UpSample( int depth , const SortedTreeNodes& sNodes , C*
     {
         TreeOctNode::NeighborKey3 neighborKey;
         neighborKey.set( depth-1 );
-        for( int i=start+(range*t)/threads ; i<start+(range*(t+1))/threads ; i++ )
+        for( node_index_type i=start+(range*t)/threads ; i<start+(range*(t+1))/threads ; i++ )
         {
-            bool isInterior = true;
             TreeOctNode* node = sNodes.treeNodes[i];
             int d , off[3];
             UpSampleData usData[3];
             node->depthAndOffset( d , off );
             for( int d=0 ; d<3 ; d++ )
             {
-                if     ( off[d]  ==0          ) usData[d] = UpSampleData( 1 , cornerValue , 0.00 ) , isInterior = false;
-                else if( off[d]+1==(1<<depth) ) usData[d] = UpSampleData( 0 , 0.00 , cornerValue ) , isInterior = false;
+                if     ( off[d]  ==0          ) usData[d] = UpSampleData( 1 , cornerValue , 0.00 );
+                else if( off[d]+1==(1<<depth) ) usData[d] = UpSampleData( 0 , 0.00 , cornerValue );
                 else if( off[d]%2             ) usData[d] = UpSampleData( 1 , 0.75 , 0.25 );
                 else                            usData[d] = UpSampleData( 0 , 0.25 , 0.75 );
             }
@@ -2189,7 +2411,7 @@ void Octree< Degree >::UpSample( int depth , const SortedTreeNodes& sNodes , C*
                         if( node && node->nodeData.nodeIndex!=-1 )
                         {
                             double dxyz = dxy * usData[2].v[kk];
-                            int _i = node->nodeData.nodeIndex;
+                            node_index_type _i = node->nodeData.nodeIndex;
                             coefficients[i] += coefficients[_i] * Real( dxyz );
                         }
                     }
@@ -2201,7 +2423,8 @@ void Octree< Degree >::UpSample( int depth , const SortedTreeNodes& sNodes , C*
 template< int Degree >
 void Octree< Degree >::SetCoarserPointValues( int depth , const SortedTreeNodes& sNodes , Real* metSolution )
 {
-    int start = sNodes.nodeCount[depth] , end = sNodes.nodeCount[depth+1] , range = end-start;
+    node_index_type start = sNodes.nodeCount[depth] , end = sNodes.nodeCount[depth+1] , range = end-start;
+    if( _pointSplineValues.size()!=9*_points.size() ) _pointSplineValues.resize( 9*_points.size() );
     // For every node at the current depth
 #ifdef USE_OPENMP     
 #pragma omp parallel for num_threads( threads )
@@ -2210,11 +2433,30 @@ void Octree< Degree >::SetCoarserPointValues( int depth , const SortedTreeNodes&
     {
         TreeOctNode::NeighborKey3 neighborKey;
         neighborKey.set( depth );
-        for( int i=start+(range*t)/threads ; i<start+(range*(t+1))/threads ; i++ )
+        for( node_index_type i=start+(range*t)/threads ; i<start+(range*(t+1))/threads ; i++ )
         {
-            int pIdx = sNodes.treeNodes[i]->nodeData.pointIndex;
+            node_index_type pIdx = sNodes.treeNodes[i]->nodeData.pointIndex;
             if( pIdx!=-1 )
             {
+                // Tabulate the values of the splines centered at the node and its two neighbors along each
+                // axis (the s-th entry is the (c+1-s)-th spline, for node center c), so that the matrix rows
+                // and constraints of the 27 nodes around the point do not re-evaluate the polynomials
+                const TreeOctNode* node = sNodes.treeNodes[i];
+                Point3D< Real > p = _points[ pIdx ].position;
+                double* pointSplineValues = &_pointSplineValues[ 9*pIdx ];
+                int d , idx[3];
+                node->depthAndOffset( d , idx );
+                for( int c=0 ; c<3 ; c++ )
+                {
+                    int center = BinaryNode< double >::CenterIndex( d , idx[c] );
+                    for( int s=0 ; s<3 ; s++ )
+#if ROBERTO_TOLDO_FIX
+                        if( center+1-s>=0 && center+1-s<((2<<node->d)-1) ) pointSplineValues[3*c+s] = fData.baseBSplines[ center+1-s ][s]( p[c] );
+                        else                                                pointSplineValues[3*c+s] = 0;
+#else // !ROBERTO_TOLDO_FIX
+                        pointSplineValues[3*c+s] = fData.baseBSplines[ center+1-s ][s]( p[c] );
+#endif // ROBERTO_TOLDO_FIX
+                }
                 neighborKey.getNeighbors( sNodes.treeNodes[i] );
                 _points[ pIdx ].coarserValue = WeightedCoarserFunctionValue( neighborKey , sNodes.treeNodes[i] , metSolution );
             }
@@ -2242,35 +2484,28 @@ Real Octree< Degree >::WeightedCoarserFunctionValue( const OctNode< TreeNodeData
         _idx[1] = BinaryNode< double >::CenterIndex( d , _idx[1]-1 );
         _idx[2] = BinaryNode< double >::CenterIndex( d , _idx[2]-1 );
 
-        for( int j=0 ; j<3 ; j++ )
-        {
+        // Evaluate the three splines along each axis once, rather than once per basis function
+        double splineValues[3][3];
+        for( int c=0 ; c<3 ; c++ ) for( int j=0 ; j<3 ; j++ )
 #if ROBERTO_TOLDO_FIX
-            double xValue = 0;
-            if( _idx[0]+j>=0 && _idx[0]+j<((1<<depth)-1) ) xValue = fData.baseBSplines[ _idx[0]+j ][2-j]( p[0] );
-            else continue;
+            if( _idx[c]+j>=0 && _idx[c]+j<((1<<depth)-1) ) splineValues[c][j] = fData.baseBSplines[ _idx[c]+j ][2-j]( p[c] );
+            else                                           splineValues[c][j] = 0;
 #else // !ROBERTO_TOLDO_FIX
-            double xValue = fData.baseBSplines[ _idx[0]+j ][2-j]( p[0] );
+            splineValues[c][j] = fData.baseBSplines[ _idx[c]+j ][2-j]( p[c] );
 #endif // ROBERTO_TOLDO_FIX
+
+        for( int j=0 ; j<3 ; j++ )
+        {
+            double xValue = splineValues[0][j];
             for( int k=0 ; k<3 ; k++ )
             {
-#if ROBERTO_TOLDO_FIX
-                double xyValue = 0;
-                if( _idx[1]+k>=0 && _idx[1]+k<((1<<depth)-1) ) xyValue = xValue * fData.baseBSplines[ _idx[1]+k ][2-k]( p[1] );
-                else continue;
-#else // !ROBERTO_TOLDO_FIX
-                double xyValue = xValue * fData.baseBSplines[ _idx[1]+k ][2-k]( p[1] );
-#endif // ROBERTO_TOLDO_FIX
+                double xyValue = xValue * splineValues[1][k];
                 double _pointValue = 0;
                 for( int l=0 ; l<3 ; l++ )
                 {
                     const TreeOctNode* basisNode = neighbors.neighbors[j][k][l];
-#if ROBERTO_TOLDO_FIX
-                    if( basisNode && basisNode->nodeData.nodeIndex>=0 && _idx[2]+l>=0 && _idx[2]+l<((1<<depth)-1) )
-                        _pointValue += fData.baseBSplines[ _idx[2]+l ][2-l]( p[2] ) * double( metSolution[basisNode->nodeData.nodeIndex] );
-#else // !ROBERTO_TOLDO_FIX
                     if( basisNode && basisNode->nodeData.nodeIndex>=0 )
-                        _pointValue += fData.baseBSplines[ _idx[2]+l ][2-l]( p[2] ) * double( metSolution[basisNode->nodeData.nodeIndex] );
-#endif // ROBERTO_TOLDO_FIX
+                        _pointValue += splineValues[2][l] * double( metSolution[basisNode->nodeData.nodeIndex] );
                 }
                 pointValue += _pointValue * xyValue;
             }
@@ -2280,9 +2515,9 @@ Real Octree< Degree >::WeightedCoarserFunctionValue( const OctNode< TreeNodeData
     return Real( pointValue * weight );
 }
 template< int Degree >
-int Octree< Degree >::GetFixedDepthLaplacian( SparseSymmetricMatrix< Real >& matrix , int depth , const SortedTreeNodes& sNodes , Real* metSolution )
+int Octree< Degree >::GetFixedDepthLaplacian( SparseSymmetricMatrix< MatrixReal >& matrix , int depth , const SortedTreeNodes& sNodes , Real* metSolution )
 {
-    int start = sNodes.nodeCount[depth] , end = sNodes.nodeCount[depth+1] , range = end-start;
+    node_index_type start = sNodes.nodeCount[depth] , end = sNodes.nodeCount[depth+1] , range = end-start;
     double stencil[5][5][5];
     SetLaplacianStencil( depth , stencil );
     Stencil< double , 5 > stencils[2][2][2];
@@ -2295,7 +2530,7 @@ int Octree< Degree >::GetFixedDepthLaplacian( SparseSymmetricMatrix< Real >& mat
     {
         TreeOctNode::NeighborKey5 neighborKey5;
         neighborKey5.set( depth );
-        for( int i=(range*t)/threads ; i<(range*(t+1))/threads ; i++ )
+        for( node_index_type i=(range*t)/threads ; i<(range*(t+1))/threads ; i++ )
         {
             TreeOctNode* node = sNodes.treeNodes[i+start];
             neighborKey5.getNeighbors( node );
@@ -2315,7 +2550,7 @@ int Octree< Degree >::GetFixedDepthLaplacian( SparseSymmetricMatrix< Real >& mat
             if( insetSupported ) matrix.rowSizes[i] = SetMatrixRow( neighborKey5.neighbors[depth] , matrix[i] , start , stencil );
             else
             {
-                matrix[i][0] = MatrixEntry< Real >( i , Real(1) );
+                matrix[i][0] = MatrixEntry< MatrixReal >( i , MatrixReal(1) );
                 matrix.rowSizes[i] = 1;
             }
 
@@ -2333,7 +2568,7 @@ int Octree< Degree >::GetFixedDepthLaplacian( SparseSymmetricMatrix< Real >& mat
     return 1;
 }
 template<int Degree>
-int Octree<Degree>::GetRestrictedFixedDepthLaplacian( SparseSymmetricMatrix< Real >& matrix , int depth , const int* entries , int entryCount ,
+int Octree<Degree>::GetRestrictedFixedDepthLaplacian( SparseSymmetricMatrix< MatrixReal >& matrix , int depth , const node_index_type* entries , int entryCount ,
                                                       const TreeOctNode* rNode , Real radius ,
                                                       const SortedTreeNodes& sNodes , Real* metSolution )
 {
@@ -2381,7 +2616,7 @@ int Octree<Degree>::GetRestrictedFixedDepthLaplacian( SparseSymmetricMatrix< Rea
             if( insetSupported ) matrix.rowSizes[i] = SetMatrixRow( neighborKey5.neighbors[depth] , matrix[i] , 0 , stencil , xStart , xEnd , yStart , yEnd , zStart , zEnd );
             else
             {
-                matrix[i][0] = MatrixEntry< Real >( i , Real(1) );
+                matrix[i][0] = MatrixEntry< MatrixReal >( i , MatrixReal(1) );
                 matrix.rowSizes[i] = 1;
             }
 
@@ -2400,6 +2635,26 @@ int Octree<Degree>::GetRestrictedFixedDepthLaplacian( SparseSymmetricMatrix< Rea
     return 1;
 }
 
+template< int Degree >
+double Octree< Degree >::_adaptiveTolerance( int depth , double accuracy ) const
+{
+    // The discretization error of a depth shrinks with the width of its nodes, so there is no point in solving a
+    // coarser depth much more accurately than that: every coarser depth doubles the tolerance of the finest one
+    int finest = _sNodes.maxDepth-1;
+    double tolerance = accuracy / 100000 * double( _sNodes.nodeCount[finest+1]-_sNodes.nodeCount[finest] );
+    tolerance = std::min< double >( tolerance , MAX_ADAPTIVE_TOLERANCE );
+    return std::min< double >( tolerance * double( 1<<(finest-depth) ) , MAX_ADAPTIVE_TOLERANCE );
+}
+template< int Degree >
+void Octree< Degree >::_setSolverControl( SolverControl& control , int iters ) const
+{
+    if( !adaptiveConvergence ) return;
+    control.stagnationWindow = STAGNATION_WINDOW;
+    control.stagnationReduction = STAGNATION_REDUCTION;
+    control.extraIters = iters;
+    // The tolerance is relative, so only skip solves with nothing to do
+    control.minResidual = 0;
+}
 template<int Degree>
 int Octree<Degree>::LaplacianMatrixIteration( int subdivideDepth , bool showResidual , int minIters , double accuracy , int maxSolveDepth , int fixedIters )
 {
@@ -2408,13 +2663,22 @@ int Octree<Degree>::LaplacianMatrixIteration( int subdivideDepth , bool showResi
     if( _boundaryType==0 ) subdivideDepth++ , maxSolveDepth++;
 
     _sNodes.treeNodes[0]->nodeData.solution = 0;
+    _solverStatistics.clear();
 
-    std::vector< Real > metSolution( _sNodes.nodeCount[ _sNodes.maxDepth ] , 0 );
+    // Allocated (and first touched) with the solver's static partition, see PoissonVector::Resize
+    PoissonVector< Real > metSolution;
+    metSolution.Resize( _sNodes.nodeCount[ _sNodes.maxDepth ] , threads );
     for( int d=(_boundaryType==0?2:0) ; d<_sNodes.maxDepth ; d++ )
     {
-        DumpOutput( "Depth[%d/%d]: %d\n" , _boundaryType==0 ? d-1 : d , _boundaryType==0 ? _sNodes.maxDepth-2 : _sNodes.maxDepth-1 , _sNodes.nodeCount[d+1]-_sNodes.nodeCount[d] );
+        DumpOutput( "Depth[%d/%d]: %lld\n" , _boundaryType==0 ? d-1 : d , _boundaryType==0 ? _sNodes.maxDepth-2 : _sNodes.maxDepth-1 , (long long)( _sNodes.nodeCount[d+1]-_sNodes.nodeCount[d] ) );
         if( subdivideDepth>0 ) iter += _SolveFixedDepthMatrix( d , _sNodes , &metSolution[0] , subdivideDepth , showResidual , minIters , accuracy , d>maxSolveDepth , fixedIters );
         else                   iter += _SolveFixedDepthMatrix( d , _sNodes , &metSolution[0] ,                  showResidual , minIters , accuracy , d>maxSolveDepth , fixedIters );
+        if( depthSolvedCallback && !depthSolvedCallback( _boundaryType==0 ? d-1 : d , depthSolvedUserData ) )
+        {
+            DumpOutput( "Solver stopped after depth %d\n" , _boundaryType==0 ? d-1 : d );
+            fData.clearDotTables( fData.VV_DOT_FLAG | fData.DV_DOT_FLAG | fData.DD_DOT_FLAG );
+            return -1;
+        }
     }
     fData.clearDotTables( fData.VV_DOT_FLAG | fData.DV_DOT_FLAG | fData.DD_DOT_FLAG );
 
@@ -2428,9 +2692,9 @@ int Octree< Degree >::_SolveFixedDepthMatrix( int depth , const SortedTreeNodes&
     maxMemoryUsage = 0;
     int iter = 0;
     PoissonVector< Real > X , B;
-    SparseSymmetricMatrix< Real > M;
+    SparseSymmetricMatrix< MatrixReal > M;
     double systemTime=0. , solveTime=0.  ,  evaluateTime = 0.; //, updateTime=0.
-    X.Resize( sNodes.nodeCount[depth+1]-sNodes.nodeCount[depth] );
+    X.Resize( sNodes.nodeCount[depth+1]-sNodes.nodeCount[depth] , threads );
     if( depth<=_minDepth ) UpSampleCoarserSolution( depth , sNodes , X );
     else
     {
@@ -2441,7 +2705,10 @@ int Octree< Degree >::_SolveFixedDepthMatrix( int depth , const SortedTreeNodes&
 #ifdef USE_OPENMP         
 #pragma omp parallel for num_threads( threads )
 #endif
-            for( int i=_sNodes.nodeCount[depth-1] ; i<_sNodes.nodeCount[depth] ; i++ ) metSolution[i] += _sNodes.treeNodes[i]->nodeData.solution;
+            for( node_index_type i=_sNodes.nodeCount[depth-1] ; i<_sNodes.nodeCount[depth] ; i++ ) metSolution[i] += _sNodes.treeNodes[i]->nodeData.solution;
+        // Start from the coefficients of the previous solve
+        if( _warmStart )
+            for( node_index_type i=sNodes.nodeCount[depth] ; i<sNodes.nodeCount[depth+1] ; i++ ) X[i-sNodes.nodeCount[depth]] = sNodes.treeNodes[i]->nodeData.solution;
     }
     if( _constrainValues )
     {
@@ -2455,8 +2722,11 @@ int Octree< Degree >::_SolveFixedDepthMatrix( int depth , const SortedTreeNodes&
         // Get the system matrix
         GetFixedDepthLaplacian( M , depth , sNodes , metSolution );
         // Set the constraint vector
-        B.Resize( sNodes.nodeCount[depth+1]-sNodes.nodeCount[depth] );
-        for( int i=sNodes.nodeCount[depth] ; i<sNodes.nodeCount[depth+1] ; i++ )
+        B.Resize( sNodes.nodeCount[depth+1]-sNodes.nodeCount[depth] , threads );
+#ifdef USE_OPENMP
+#pragma omp parallel for num_threads( threads ) schedule( static )
+#endif
+        for( node_index_type i=sNodes.nodeCount[depth] ; i<sNodes.nodeCount[depth+1] ; i++ )
             if( _boundaryType!=0 || _IsInsetSupported( sNodes.treeNodes[i] ) ) B[i-sNodes.nodeCount[depth]] = sNodes.treeNodes[i]->nodeData.constraint;
             else                                                               B[i-sNodes.nodeCount[depth]] = Real(0);
     }
@@ -2469,28 +2739,46 @@ int Octree< Degree >::_SolveFixedDepthMatrix( int depth , const SortedTreeNodes&
     int res = 1<<depth;
 
     MapReduceVector< Real > mrVector;
-    mrVector.resize( threads , M.rows );
+    mrVector.resize( threads , M.rows , deterministic ? DETERMINISTIC_BLOCKS : 0 );
 
     if( _boundaryType==0 && depth>3 ) res -= 1<<(depth-2);
+    SolverControl control;
+    if( adaptiveConvergence ) _accuracy = Real( _adaptiveTolerance( depth , accuracy ) );
     if( !noSolve ) 
     {
-        if( fixedIters>=0 ) iter += SparseSymmetricMatrix< Real >::Solve( M , B , fixedIters                                                           , X , mrVector , Real(1e-10) , 0 , M.rows==res*res*res && !_constrainValues && _boundaryType!=-1 );
-        else                iter += SparseSymmetricMatrix< Real >::Solve( M , B , std::max< int >( int( pow( M.rows , ITERATION_POWER ) ) , minIters ) , X , mrVector ,_accuracy    , 0 , M.rows==res*res*res && !_constrainValues && _boundaryType!=-1 );
+        if( fixedIters>=0 ) iter += SparseSymmetricMatrix< MatrixReal >::Solve( M , B , fixedIters                                                           , X , mrVector , Real(1e-10) , 0 , M.rows==res*res*res && !_constrainValues && _boundaryType!=-1 , false , _warmStart , &control );
+        else
+        {
+            int iters = std::max< int >( int( pow( M.rows , ITERATION_POWER ) ) , minIters );
+            _setSolverControl( control , iters );
+            iter += SparseSymmetricMatrix< MatrixReal >::Solve( M , B , iters , X , mrVector ,_accuracy    , 0 , M.rows==res*res*res && !_constrainValues && _boundaryType!=-1 , false , _warmStart , &control );
+        }
     }
     solveTime = Time()-solveTime;
     if( showResidual )
     {
         double mNorm = 0;
-        for( int i=0 ; i<M.rows ; i++ ) for( int j=0 ; j<M.rowSizes[i] ; j++ ) mNorm += M[i][j].Value * M[i][j].Value;
+        for( node_index_type i=0 ; i<M.rows ; i++ ) for( int j=0 ; j<M.rowSizes[i] ; j++ ) mNorm += M[i][j].Value * M[i][j].Value;
         double bNorm = B.Norm( 2 ) , rNorm = ( B - M * X ).Norm( 2 );
-        DumpOutput( "\tResidual: (%d %g) %g -> %g (%f) [%d]\n" , M.Entries() , sqrt(mNorm) , bNorm , rNorm , rNorm/bNorm , iter );
+        DumpOutput( "\tResidual: (%lld %g) %g -> %g (%f) [%d]\n" , (long long)M.Entries() , sqrt(mNorm) , bNorm , rNorm , rNorm/bNorm , iter );
     }
 
     // Copy the solution back into the tree (over-writing the constraints)
-    for( int i=sNodes.nodeCount[depth] ; i<sNodes.nodeCount[depth+1] ; i++ ) sNodes.treeNodes[i]->nodeData.solution = Real( X[i-sNodes.nodeCount[depth]] );
+    for( node_index_type i=sNodes.nodeCount[depth] ; i<sNodes.nodeCount[depth+1] ; i++ ) sNodes.treeNodes[i]->nodeData.solution = Real( X[i-sNodes.nodeCount[depth]] );
+
+    SolverDepthStatistics stats;
+    stats.depth = _boundaryType==0 ? depth-1 : depth;
+    stats.rows = M.rows;
+    stats.iterations = iter;
+    stats.tolerance = fixedIters>=0 ? 1e-10 : _accuracy;
+    stats.residual = noSolve ? 1. : ( control.residuals.size() ? control.residuals.back() : 0. );
+    stats.residuals.swap( control.residuals );
+    stats.systemTime = systemTime , stats.solveTime = solveTime;
+    _solverStatistics.push_back( stats );
 
     MemoryUsage();
     DumpOutput("\tEvaluated / Got / Solved in: %6.3f / %6.3f / %6.3f\t(%.3f MB)\n" , evaluateTime , systemTime , solveTime , float( maxMemoryUsage ) );
+    if( adaptiveConvergence ) DumpOutput( "\tIterations / Tolerance / Residual: %d / %g / %g\n" , stats.iterations , stats.tolerance , stats.residual );
     maxMemoryUsage = std::max< double >( maxMemoryUsage , _maxMemoryUsage );
     return iter;
 }
@@ -2499,12 +2787,9 @@ int Octree<Degree>::_SolveFixedDepthMatrix( int depth , const SortedTreeNodes& s
 {
     double _maxMemoryUsage = maxMemoryUsage;
     if( startingDepth>=depth ) return _SolveFixedDepthMatrix( depth , sNodes , metSolution , showResidual , minIters , accuracy , noSolve , fixedIters );
-    int i , j , d , tIter=0;
-    SparseSymmetricMatrix< Real > _M;
-    PoissonVector< Real > B , _B , _X;
-    AdjacencySetFunction asf;
-    AdjacencyCountFunction acf;
-    double systemTime = 0 , solveTime = 0 , memUsage = 0 , evaluateTime = 0 , gTime , sTime;
+    int d , tIter=0;
+    PoissonVector< Real > B;
+    double systemTime = 0 , solveTime = 0 , evaluateTime = 0;
     Real myRadius;
 
     if( depth>_minDepth )
@@ -2516,7 +2801,7 @@ int Octree<Degree>::_SolveFixedDepthMatrix( int depth , const SortedTreeNodes& s
 #ifdef USE_OPENMP         
 #pragma omp parallel for num_threads( threads )
 #endif
-            for( int i=_sNodes.nodeCount[depth-1] ; i<_sNodes.nodeCount[depth] ; i++ ) metSolution[i] += _sNodes.treeNodes[i]->nodeData.solution;
+            for( node_index_type i=_sNodes.nodeCount[depth-1] ; i<_sNodes.nodeCount[depth] ; i++ ) metSolution[i] += _sNodes.treeNodes[i]->nodeData.solution;
     }
 
     if( _constrainValues )
@@ -2525,10 +2810,13 @@ int Octree<Degree>::_SolveFixedDepthMatrix( int depth , const SortedTreeNodes& s
         SetCoarserPointValues( depth , sNodes , metSolution );
         evaluateTime = Time() - evaluateTime;
     }
-    B.Resize( sNodes.nodeCount[depth+1] - sNodes.nodeCount[depth] );
+    B.Resize( sNodes.nodeCount[depth+1] - sNodes.nodeCount[depth] , threads );
 
     // Back-up the constraints
-    for( i=sNodes.nodeCount[depth] ; i<sNodes.nodeCount[depth+1] ; i++ )
+#ifdef USE_OPENMP
+#pragma omp parallel for num_threads( threads ) schedule( static )
+#endif
+    for( node_index_type i=sNodes.nodeCount[depth] ; i<sNodes.nodeCount[depth+1] ; i++ )
     {
         if( _boundaryType!=0 || _IsInsetSupported( sNodes.treeNodes[i] ) ) B[i-sNodes.nodeCount[depth]] = sNodes.treeNodes[i]->nodeData.constraint;
         else                                                               B[i-sNodes.nodeCount[depth]] = Real(0);
@@ -2541,106 +2829,140 @@ int Octree<Degree>::_SolveFixedDepthMatrix( int depth , const SortedTreeNodes& s
     if( _boundaryType==0 ) d++;
     std::vector< int > subDimension( sNodes.nodeCount[d+1]-sNodes.nodeCount[d] );
     int maxDimension = 0;
-    for( i=sNodes.nodeCount[d] ; i<sNodes.nodeCount[d+1] ; i++ )
+#ifdef USE_OPENMP
+#pragma omp parallel for num_threads( threads ) schedule( dynamic , 1 )
+#endif
+    for( node_index_type i=sNodes.nodeCount[d] ; i<sNodes.nodeCount[d+1] ; i++ )
     {
         // Count the number of nodes at depth "depth" that lie under sNodes.treeNodes[i]
+        AdjacencyCountFunction acf;
         acf.adjacencyCount = 0;
         for( TreeOctNode* temp=sNodes.treeNodes[i]->nextNode() ; temp ; )
         {
             if( temp->depth()==depth ) acf.adjacencyCount++ , temp = sNodes.treeNodes[i]->nextBranch( temp );
             else                                              temp = sNodes.treeNodes[i]->nextNode  ( temp );
         }
-        for( j=sNodes.nodeCount[d] ; j<sNodes.nodeCount[d+1] ; j++ )
+        for( node_index_type j=sNodes.nodeCount[d] ; j<sNodes.nodeCount[d+1] ; j++ )
         {
             if( i==j ) continue;
             TreeOctNode::ProcessFixedDepthNodeAdjacentNodes( fData.depth , sNodes.treeNodes[i] , 1 , sNodes.treeNodes[j] , 2*width-1 , depth , &acf );
         }
         subDimension[i-sNodes.nodeCount[d]] = acf.adjacencyCount;
-        maxDimension = std::max< int >( maxDimension , subDimension[i-sNodes.nodeCount[d]] );
     }
-    asf.adjacencies = new int[maxDimension];
-    MapReduceVector< Real > mrVector;
-    mrVector.resize( threads , maxDimension );
-    // Iterate through the coarse-level nodes
-    for( i=sNodes.nodeCount[d] ; i<sNodes.nodeCount[d+1] ; i++ )
-    {
-        int iter = 0;
-        gTime = Time();
-        // Count the number of nodes at depth "depth" that lie under sNodes.treeNodes[i]
-        acf.adjacencyCount = subDimension[i-sNodes.nodeCount[d]];
-        if( !acf.adjacencyCount ) continue;
-
-        // Set the indices for the nodes under, or near, sNodes.treeNodes[i].
-        asf.adjacencyCount = 0;
-        for( TreeOctNode* temp=sNodes.treeNodes[i]->nextNode() ; temp ; )
-        {
-            if( temp->depth()==depth && temp->nodeData.nodeIndex!=-1 ) asf.adjacencies[ asf.adjacencyCount++ ] = temp->nodeData.nodeIndex , temp = sNodes.treeNodes[i]->nextBranch( temp );
-            else                                                                                                                            temp = sNodes.treeNodes[i]->nextNode  ( temp );
-        }
-        for( j=sNodes.nodeCount[d] ; j<sNodes.nodeCount[d+1] ; j++ )
-        {
-            if( i==j ) continue;
-            TreeOctNode::ProcessFixedDepthNodeAdjacentNodes( fData.depth , sNodes.treeNodes[i] , 1 , sNodes.treeNodes[j] , 2*width-1 , depth , &asf );
-        }
-
-        // Get the associated constraint vector
-        _B.Resize( asf.adjacencyCount );
-        for( j=0 ; j<asf.adjacencyCount ; j++ ) _B[j] = B[ asf.adjacencies[j]-sNodes.nodeCount[depth] ];
-
-        _X.Resize( asf.adjacencyCount );
-#ifdef USE_OPENMP         
-#pragma omp parallel for num_threads( threads ) schedule( static )
+    for( size_t i=0 ; i<subDimension.size() ; i++ ) maxDimension = std::max< int >( maxDimension , subDimension[i] );
+    double tolerance = adaptiveConvergence ? _adaptiveTolerance( depth , accuracy ) : accuracy / 100000 * maxDimension , maxResidual = 0;
+
+    // Each sub-domain is solved together with a ghost layer, the nodes of the neighboring sub-domains within two
+    // nodes of its boundary. Sub-domains in the same class modulo period are more than four nodes apart, so their
+    // ghost layers are disjoint: the classes are solved in turn, the sub-domains of a class concurrently. Ghost
+    // values are only handed on to classes that have not been solved yet.
+    int period = 2 + 4 / ( 1<<(depth-d) ) , colors = period*period*period;
+    for( int c=0 ; c<colors ; c++ )
+#ifdef USE_OPENMP
+#pragma omp parallel num_threads( threads ) reduction( + : tIter , systemTime , solveTime )
 #endif
-        for( j=0 ; j<asf.adjacencyCount ; j++ ) _X[j] = sNodes.treeNodes[ asf.adjacencies[j] ]->nodeData.solution;
-        // Get the associated matrix
-        GetRestrictedFixedDepthLaplacian( _M , depth , asf.adjacencies , asf.adjacencyCount , sNodes.treeNodes[i] , myRadius , sNodes , metSolution );
-#ifdef USE_OPENMP         
-#pragma omp parallel for num_threads( threads ) schedule( static )
+    {
+        SolverControl control;
+        SparseSymmetricMatrix< MatrixReal > _M;
+        PoissonVector< Real > _B , _X;
+        AdjacencySetFunction asf;
+        asf.adjacencies = new node_index_type[maxDimension];
+        MapReduceVector< Real > mrVector;
+        mrVector.resize( 1 , maxDimension , deterministic ? DETERMINISTIC_BLOCKS : 0 );
+        // Iterate through the coarse-level nodes
+#ifdef USE_OPENMP
+#pragma omp for schedule( dynamic , 1 )
 #endif
-        for( j=0 ; j<asf.adjacencyCount ; j++ )
+        for( node_index_type i=sNodes.nodeCount[d] ; i<sNodes.nodeCount[d+1] ; i++ )
         {
-            _B[j] += sNodes.treeNodes[asf.adjacencies[j]]->nodeData.constraint;
-            sNodes.treeNodes[ asf.adjacencies[j] ]->nodeData.constraint = 0;
-        }
-        gTime = Time()-gTime;
+            if( !subDimension[i-sNodes.nodeCount[d]] || _SubDomainColor( sNodes.treeNodes[i] , period )!=c ) continue;
+            int iter = 0;
+            double gTime = Time() , sTime;
 
-        // Solve the matrix
-        // Since we don't have the full matrix, the system shouldn't be singular, so we shouldn't have to correct it
-        sTime=Time();
-        Real _accuracy = Real( accuracy / 100000 ) * _M.rows;
-        if( !noSolve ) 
-        {
-            if( fixedIters>=0 ) iter += SparseSymmetricMatrix< Real >::Solve( _M , _B , fixedIters                                                            , _X , mrVector ,  Real(1e-10) , 0 );
-            else                iter += SparseSymmetricMatrix< Real >::Solve( _M , _B , std::max< int >( int( pow( _M.rows , ITERATION_POWER ) ) , minIters ) , _X , mrVector , _accuracy    , 0 );
-        }
-        sTime=Time()-sTime;
+            // Set the indices for the nodes under, or near, sNodes.treeNodes[i].
+            asf.adjacencyCount = 0;
+            for( TreeOctNode* temp=sNodes.treeNodes[i]->nextNode() ; temp ; )
+            {
+                if( temp->depth()==depth && temp->nodeData.nodeIndex!=-1 ) asf.adjacencies[ asf.adjacencyCount++ ] = temp->nodeData.nodeIndex , temp = sNodes.treeNodes[i]->nextBranch( temp );
+                else                                                                                                                            temp = sNodes.treeNodes[i]->nextNode  ( temp );
+            }
+            for( node_index_type j=sNodes.nodeCount[d] ; j<sNodes.nodeCount[d+1] ; j++ )
+            {
+                if( i==j ) continue;
+                TreeOctNode::ProcessFixedDepthNodeAdjacentNodes( fData.depth , sNodes.treeNodes[i] , 1 , sNodes.treeNodes[j] , 2*width-1 , depth , &asf );
+            }
 
-        if( showResidual )
-        {
-            double mNorm = 0;
-            for( int i=0 ; i<_M.rows ; i++ ) for( int j=0 ; j<_M.rowSizes[i] ; j++ ) mNorm += _M[i][j].Value * _M[i][j].Value;
-            double bNorm = _B.Norm( 2 ) , rNorm = ( _B - _M * _X ).Norm( 2 );
-            DumpOutput( "\t\tResidual: (%d %g) %g -> %g (%f) [%d]\n" , _M.Entries() , sqrt(mNorm) , bNorm , rNorm , rNorm/bNorm , iter );
-        }
+            // Get the associated constraint vector
+            _B.Resize( asf.adjacencyCount );
+            for( int j=0 ; j<asf.adjacencyCount ; j++ ) _B[j] = B[ asf.adjacencies[j]-sNodes.nodeCount[depth] ];
 
-        // Update the solution for all nodes in the sub-tree
-#ifdef USE_OPENMP         
-#pragma omp parallel for num_threads( threads )
+            _X.Resize( asf.adjacencyCount );
+            for( int j=0 ; j<asf.adjacencyCount ; j++ ) _X[j] = sNodes.treeNodes[ asf.adjacencies[j] ]->nodeData.solution;
+            // Get the associated matrix
+            GetRestrictedFixedDepthLaplacian( _M , depth , asf.adjacencies , asf.adjacencyCount , sNodes.treeNodes[i] , myRadius , sNodes , metSolution );
+            for( int j=0 ; j<asf.adjacencyCount ; j++ )
+            {
+                _B[j] += sNodes.treeNodes[asf.adjacencies[j]]->nodeData.constraint;
+                sNodes.treeNodes[ asf.adjacencies[j] ]->nodeData.constraint = 0;
+            }
+            gTime = Time()-gTime;
+
+            // Solve the matrix
+            // Since we don't have the full matrix, the system shouldn't be singular, so we shouldn't have to correct it
+            sTime=Time();
+            Real _accuracy = Real( accuracy / 100000 ) * _M.rows;
+            if( adaptiveConvergence ) _accuracy = Real( tolerance );
+            if( !noSolve ) 
+            {
+                if( fixedIters>=0 ) iter += SparseSymmetricMatrix< MatrixReal >::Solve( _M , _B , fixedIters                                                            , _X , mrVector ,  Real(1e-10) , 0 , false , false , _warmStart , &control );
+                else
+                {
+                    int iters = std::max< int >( int( pow( _M.rows , ITERATION_POWER ) ) , minIters );
+                    _setSolverControl( control , iters );
+                    iter += SparseSymmetricMatrix< MatrixReal >::Solve( _M , _B , iters , _X , mrVector , _accuracy    , 0 , false , false , _warmStart , &control );
+                }
+                if( control.residuals.size() )
+#ifdef USE_OPENMP
+#pragma omp critical (solver_statistics)
 #endif
-        for( j=0 ; j<asf.adjacencyCount ; j++ )
-        {
-            TreeOctNode* temp=sNodes.treeNodes[ asf.adjacencies[j] ];
-            while( temp->depth()>sNodes.treeNodes[i]->depth() ) temp=temp->parent;
-            if( temp->nodeData.nodeIndex>=sNodes.treeNodes[i]->nodeData.nodeIndex ) sNodes.treeNodes[ asf.adjacencies[j] ]->nodeData.solution = Real( _X[j] );
+                    maxResidual = std::max< double >( maxResidual , control.residuals.back() );
+            }
+            sTime=Time()-sTime;
+
+            if( showResidual )
+            {
+                double mNorm = 0;
+                for( int i=0 ; i<_M.rows ; i++ ) for( int j=0 ; j<_M.rowSizes[i] ; j++ ) mNorm += _M[i][j].Value * _M[i][j].Value;
+                double bNorm = _B.Norm( 2 ) , rNorm = ( _B - _M * _X ).Norm( 2 );
+                DumpOutput( "\t\tResidual: (%lld %g) %g -> %g (%f) [%d]\n" , (long long)_M.Entries() , sqrt(mNorm) , bNorm , rNorm , rNorm/bNorm , iter );
+            }
+
+            // Update the solution for all nodes in the sub-tree
+            for( int j=0 ; j<asf.adjacencyCount ; j++ )
+            {
+                TreeOctNode* temp=sNodes.treeNodes[ asf.adjacencies[j] ];
+                while( temp->depth()>sNodes.treeNodes[i]->depth() ) temp=temp->parent;
+                if( temp==sNodes.treeNodes[i] || _SubDomainColor( temp , period )>c ) sNodes.treeNodes[ asf.adjacencies[j] ]->nodeData.solution = Real( _X[j] );
+            }
+            systemTime += gTime;
+            solveTime += sTime;
+            tIter += iter;
         }
-        systemTime += gTime;
-        solveTime += sTime;
-        memUsage = std::max< double >( MemoryUsage() , memUsage );
-        tIter += iter;
+        delete[] asf.adjacencies;
     }
-    delete[] asf.adjacencies;
+
+    SolverDepthStatistics stats;
+    stats.depth = _boundaryType==0 ? depth-1 : depth;
+    stats.rows = sNodes.nodeCount[depth+1]-sNodes.nodeCount[depth];
+    stats.iterations = tIter;
+    stats.tolerance = fixedIters>=0 ? 1e-10 : tolerance;
+    stats.residual = noSolve ? 1. : maxResidual;
+    stats.systemTime = systemTime , stats.solveTime = solveTime;
+    _solverStatistics.push_back( stats );
+
     MemoryUsage();
     DumpOutput("\tEvaluated / Got / Solved in: %6.3f / %6.3f / %6.3f\t(%.3f MB)\n" , evaluateTime , systemTime , solveTime , float( maxMemoryUsage ) );
+    if( adaptiveConvergence ) DumpOutput( "\tIterations / Tolerance / Residual: %d / %g / %g\n" , stats.iterations , stats.tolerance , stats.residual );
     maxMemoryUsage = std::max< double >( maxMemoryUsage , _maxMemoryUsage );
     return tIter;
 }
@@ -2653,17 +2975,62 @@ int Octree<Degree>::HasNormals(TreeOctNode* node,Real epsilon)
 
     return hasNormals;
 }
+template< int Degree >
+bool Octree< Degree >::_hasNormal( const TreeOctNode* node ) const
+{
+    // The test of HasNormals, which never used its epsilon: any nonzero component counts, so ClipTree keeps the same nodes
+    int idx = node->nodeData.normalIndex;
+    return idx>=0 && ( (*normals)[idx][0]!=0 || (*normals)[idx][1]!=0 || (*normals)[idx][2]!=0 );
+}
+template< int Degree >
+bool Octree< Degree >::_clipSubtree( TreeOctNode* node ) const
+{
+    if( !node->children ) return _hasNormal( node );
+    bool hasNormals = false;
+    for( unsigned int c=0 ; c<Cube::CORNERS ; c++ ) if( _clipSubtree( node->children+c ) ) hasNormals = true;
+    if( !hasNormals && node->d>=_minDepth ) node->children = NULL;
+    return hasNormals || _hasNormal( node );
+}
 template<int Degree>
 void Octree<Degree>::ClipTree( void )
 {
-    int maxDepth = tree.maxDepth();
-    for( TreeOctNode* temp=tree.nextNode() ; temp ; temp=tree.nextNode(temp) )
-        if( temp->children && temp->d>=_minDepth )
+    // The children of a node are clipped if none of the nodes below it has a normal. The subtrees below the first depth
+    // with a few nodes per thread are clipped in parallel, then the coarser depths are clipped bottom up.
+    std::vector< std::vector< TreeOctNode* > > levels( 1 , std::vector< TreeOctNode* >( 1 , &tree ) );
+    while( levels.back().size()<size_t( 64*threads ) )
+    {
+        std::vector< TreeOctNode* > next;
+        for( size_t i=0 ; i<levels.back().size() ; i++ ) if( levels.back()[i]->children )
+            for( unsigned int c=0 ; c<Cube::CORNERS ; c++ ) next.push_back( levels.back()[i]->children+c );
+        if( next.empty() ) break;
+        levels.push_back( next );
+    }
+
+    const std::vector< TreeOctNode* >& subtrees = levels.back();
+    std::vector< char > hasNormals( subtrees.size() );
+#ifdef USE_OPENMP
+#pragma omp parallel for num_threads( threads ) schedule( dynamic , 1 )
+#endif
+    for( int i=0 ; i<int( subtrees.size() ) ; i++ ) hasNormals[i] = _clipSubtree( subtrees[i] ) ? 1 : 0;
+
+    for( int d=int( levels.size() )-2 ; d>=0 ; d-- )
+    {
+        // The children of the nodes of a depth are the nodes of the next depth, in order
+        std::vector< char > _hasNormals( levels[d].size() );
+        size_t c = 0;
+        for( size_t i=0 ; i<levels[d].size() ; i++ )
         {
-            int hasNormals=0;
-            for( unsigned int i=0 ; i<Cube::CORNERS && !hasNormals ; i++ ) hasNormals = HasNormals( &temp->children[i] , EPSILON/(1<<maxDepth) );
-            if( !hasNormals ) temp->children=NULL;
+            TreeOctNode* node = levels[d][i];
+            bool childHasNormals = false;
+            if( node->children )
+            {
+                for( unsigned int j=0 ; j<Cube::CORNERS ; j++ ) if( hasNormals[c++] ) childHasNormals = true;
+                if( !childHasNormals && node->d>=_minDepth ) node->children = NULL;
+            }
+            _hasNormals[i] = ( childHasNormals || _hasNormal( node ) ) ? 1 : 0;
         }
+        hasNormals.swap( _hasNormals );
+    }
     MemoryUsage();
 }
 template<int Degree>
@@ -2684,15 +3051,10 @@ void Octree<Degree>::SetLaplacianConstraints( void )
 #ifdef USE_OPENMP     
 #pragma omp parallel for num_threads( threads )
 #endif
-    for( int i=0 ; i<_sNodes.nodeCount[maxDepth+1] ; i++ ) _sNodes.treeNodes[i]->nodeData.constraint = Real( 0. );
+    for( node_index_type i=0 ; i<_sNodes.nodeCount[maxDepth+1] ; i++ ) _sNodes.treeNodes[i]->nodeData.constraint = Real( 0. );
 
     for( int d=maxDepth ; d>=(_boundaryType==0?2:0) ; d-- )
     {
-        // For the scattering part of the operation, we parallelize by duplicating the constraints and then summing at the end.
-        int sz = d>0 ? _sNodes.nodeCount[d] - _sNodes.nodeCount[d-1] : _sNodes.nodeCount[d] - 0;
-        int offset = d>0 ? _sNodes.treeNodes[ _sNodes.nodeCount[d-1] ]->nodeData.nodeIndex : 0;
-        std::vector< std::vector< Real > > _constraints( threads );
-        for( int t=0 ; t<threads ; t++ ) _constraints[t].resize( sz , 0 );
         Point3D< double > stencil[5][5][5];
         SetDivergenceStencil( d , stencil , false );
         Stencil< Point3D< double > , 5 > stencils[2][2][2];
@@ -2704,32 +3066,22 @@ void Octree<Degree>::SetLaplacianConstraints( void )
         {
             TreeOctNode::NeighborKey5 neighborKey5;
             neighborKey5.set( fData.depth );
-            int start = _sNodes.nodeCount[d] , end = _sNodes.nodeCount[d+1] , range = end-start;
-            for( int i=start+(range*t)/threads ; i<start+(range*(t+1))/threads ; i++ )
+            node_index_type start = _sNodes.nodeCount[d] , end = _sNodes.nodeCount[d+1] , range = end-start;
+            for( node_index_type i=start+(range*t)/threads ; i<start+(range*(t+1))/threads ; i++ )
             {
                 TreeOctNode* node = _sNodes.treeNodes[i];
                 int startX=0 , endX=5 , startY=0 , endY=5 , startZ=0 , endZ=5;
                 int depth = node->depth();
                 neighborKey5.getNeighbors( node );
 
-                bool isInterior , isInterior2;
+                bool isInterior;
                 {
                     int d , off[3];
                     node->depthAndOffset( d , off );
                     int o = _boundaryType==0 ? (1<<(d-2)) : 0;
                     int mn = 2+o , mx = (1<<d)-2-o;
                     isInterior = ( off[0]>=mn && off[0]<mx && off[1]>=mn && off[1]<mx && off[2]>=mn && off[2]<mx );
-                    mn += 2 , mx -= 2;
-                    isInterior2 = ( off[0]>=mn && off[0]<mx && off[1]>=mn && off[1]<mx && off[2]>=mn && off[2]<mx );
-                }
-                int cx , cy , cz;
-                if( d )
-                {
-                    int c = int( node - node->parent->children );
-                    Cube::FactorCornerIndex( c , cx , cy , cz );
                 }
-                else cx = cy = cz = 0;
-                Stencil< Point3D< double > , 5 >& _stencil = stencils[cx][cy][cz];
 
                 // Set constraints from current depth
                 {
@@ -2755,39 +3107,66 @@ void Octree<Degree>::SetLaplacianConstraints( void )
                                 node->nodeData.constraint += GetDivergence( _node , node ,  _normal );
                             }
                         }
-                    UpdateCoarserSupportBounds( neighbors5.neighbors[2][2][2] , startX , endX , startY  , endY , startZ , endZ );
                 }
-                if( node->nodeData.nodeIndex<0 || node->nodeData.normalIndex<0 ) continue;
-                const Point3D< Real >& normal = (*normals)[node->nodeData.normalIndex];
-                if( normal[0]==0 && normal[1]==0 && normal[2]==0 ) continue;
-
-                if( depth )
+            }
+        }
+        // Set the constraints at the coarser depth as a gather: every node at depth d-1 collects the divergence of the
+        // normals of the children of its 5x5x5 neighbors whose (coarser) support covers it. This avoids per-thread
+        // copies of the coarser constraints and the subsequent reduction.
+        if( d )
+        {
+#ifdef USE_OPENMP         
+#pragma omp parallel for num_threads( threads )
+#endif
+            for( int t=0 ; t<threads ; t++ )
+            {
+                TreeOctNode::NeighborKey5 neighborKey5;
+                neighborKey5.set( fData.depth );
+                node_index_type start = _sNodes.nodeCount[d-1] , end = _sNodes.nodeCount[d] , range = end-start;
+                for( node_index_type i=start+(range*t)/threads ; i<start+(range*(t+1))/threads ; i++ )
                 {
-                    const TreeOctNode::Neighbors5& neighbors5 = neighborKey5.neighbors[depth-1];
-
-                    for( int x=startX ; x<endX ; x++ ) for( int y=startY ; y<endY ; y++ ) for( int z=startZ ; z<endZ ; z++ )
-                        if( neighbors5.neighbors[x][y][z] && neighbors5.neighbors[x][y][z]->nodeData.nodeIndex!=-1 )
+                    TreeOctNode* _node = _sNodes.treeNodes[i];
+                    const TreeOctNode::Neighbors5& neighbors5 = neighborKey5.getNeighbors( _node );
+                    double constraint = 0;
+                    for( int a=0 ; a<5 ; a++ ) for( int b=0 ; b<5 ; b++ ) for( int c=0 ; c<5 ; c++ )
+                    {
+                        const TreeOctNode* parent = neighbors5.neighbors[a][b][c];
+                        if( !parent || !parent->children ) continue;
+                        // The position of the coarser node in the 5x5x5 neighborhood of the child's parent
+                        int x = 4-a , y = 4-b , z = 4-c;
+                        for( unsigned int cc=0 ; cc<Cube::CORNERS ; cc++ )
                         {
-                            TreeOctNode* _node = neighbors5.neighbors[x][y][z];
+                            int cx , cy , cz;
+                            Cube::FactorCornerIndex( cc , cx , cy , cz );
+                            // The coarser support bounds (c.f. UpdateCoarserSupportBounds)
+                            if( ( cx==0 && x==4 ) || ( cx==1 && x==0 ) ) continue;
+                            if( ( cy==0 && y==4 ) || ( cy==1 && y==0 ) ) continue;
+                            if( ( cz==0 && z==4 ) || ( cz==1 && z==0 ) ) continue;
+                            const TreeOctNode* node = parent->children + cc;
+                            if( node->nodeData.nodeIndex<0 || node->nodeData.normalIndex<0 ) continue;
+                            const Point3D< Real >& normal = (*normals)[node->nodeData.normalIndex];
+                            if( normal[0]==0 && normal[1]==0 && normal[2]==0 ) continue;
+
+                            bool isInterior2;
+                            {
+                                int _d , off[3];
+                                node->depthAndOffset( _d , off );
+                                int o = _boundaryType==0 ? (1<<(_d-2)) : 0;
+                                int mn = 4+o , mx = (1<<_d)-4-o;
+                                isInterior2 = ( off[0]>=mn && off[0]<mx && off[1]>=mn && off[1]<mx && off[2]>=mn && off[2]<mx );
+                            }
                             if( isInterior2 )
                             {
-                                Point3D< double >& div = _stencil.values[x][y][z];
-                                _constraints[t][ _node->nodeData.nodeIndex-offset ] += Real( div[0] * normal[0] + div[1] * normal[1] + div[2] * normal[2] );
+                                const Point3D< double >& div = stencils[cx][cy][cz].values[x][y][z];
+                                constraint += Real( div[0] * normal[0] + div[1] * normal[1] + div[2] * normal[2] );
                             }
-                            else _constraints[t][ _node->nodeData.nodeIndex-offset ] += GetDivergence( node , _node , normal );
+                            else constraint += GetDivergence( node , _node , normal );
                         }
+                    }
+                    constraints[i] = Real( constraint );
                 }
             }
         }
-#ifdef USE_OPENMP         
-#pragma omp parallel for num_threads( threads ) schedule( static )
-#endif
-        for( int i=0 ; i<sz ; i++ )
-        {
-            Real cSum = Real(0.);
-            for( int t=0 ; t<threads ; t++ ) cSum += _constraints[t][i];
-            constraints[i+offset] = cSum;
-        }
         MemoryUsage();
     }
     std::vector< Point3D< Real > > coefficients( _sNodes.nodeCount[maxDepth] , zeroPoint );
@@ -2798,8 +3177,8 @@ void Octree<Degree>::SetLaplacianConstraints( void )
 #endif
         for( int t=0 ; t<threads ; t++ )
         {
-            int start = _sNodes.nodeCount[d] , end = _sNodes.nodeCount[d+1] , range = end-start;
-            for( int i=start+(range*t)/threads ; i<start+(range*(t+1))/threads ; i++ )
+            node_index_type start = _sNodes.nodeCount[d] , end = _sNodes.nodeCount[d+1] , range = end-start;
+            for( node_index_type i=start+(range*t)/threads ; i<start+(range*(t+1))/threads ; i++ )
             {
                 TreeOctNode* node = _sNodes.treeNodes[i];
                 if( node->nodeData.nodeIndex<0 || node->nodeData.normalIndex<0 ) continue;
@@ -2820,12 +3199,12 @@ void Octree<Degree>::SetLaplacianConstraints( void )
 #ifdef USE_OPENMP     
 #pragma omp parallel for num_threads( threads )
 #endif
-    for( int i=0 ; i<_sNodes.nodeCount[maxDepth] ; i++ ) _sNodes.treeNodes[i]->nodeData.constraint += constraints[i];
+    for( node_index_type i=0 ; i<_sNodes.nodeCount[maxDepth] ; i++ ) _sNodes.treeNodes[i]->nodeData.constraint += constraints[i];
 
     // Compute the contribution from all coarser depths
     for( int d=0 ; d<=maxDepth ; d++ )
     {
-        int start = _sNodes.nodeCount[d] , end = _sNodes.nodeCount[d+1] , range = end - start;
+        node_index_type start = _sNodes.nodeCount[d] , end = _sNodes.nodeCount[d+1] , range = end - start;
         Stencil< Point3D< double > , 5 > stencils[2][2][2];
         SetDivergenceStencils( d , stencils , false );
 #ifdef USE_OPENMP         
@@ -2835,7 +3214,7 @@ void Octree<Degree>::SetLaplacianConstraints( void )
         {
             TreeOctNode::NeighborKey5 neighborKey5;
             neighborKey5.set( maxDepth );
-            for( int i=start+(range*t)/threads ; i<start+(range*(t+1))/threads ; i++ )
+            for( node_index_type i=start+(range*t)/threads ; i<start+(range*(t+1))/threads ; i++ )
             {
                 TreeOctNode* node = _sNodes.treeNodes[i];
                 int depth = node->depth();
@@ -2866,7 +3245,7 @@ void Octree<Degree>::SetLaplacianConstraints( void )
                     if( neighbors5.neighbors[x][y][z] && neighbors5.neighbors[x][y][z]->nodeData.nodeIndex!=-1 )
                     {
                         TreeOctNode* _node = neighbors5.neighbors[x][y][z];
-                        int _i = _node->nodeData.nodeIndex;
+                        node_index_type _i = _node->nodeData.nodeIndex;
                         if( isInterior )
                         {
                             Point3D< double >& div = _stencil.values[x][y][z];
@@ -2882,12 +3261,29 @@ void Octree<Degree>::SetLaplacianConstraints( void )
 
     fData.clearDotTables( fData.DV_DOT_FLAG );
 
+    _setCenterWeights();
+}
+template< int Degree >
+void Octree< Degree >::SetLaplacianConstraints( const std::vector< Real >& constraints )
+{
+    // The solver expects the value dot-products that SetLaplacianConstraints leaves set
+    fData.setDotTables( fData.VV_DOT_FLAG , _boundaryType==0 );
+#ifdef USE_OPENMP     
+#pragma omp parallel for num_threads( threads )
+#endif
+    for( node_index_type i=0 ; i<_sNodes.nodeCount[_sNodes.maxDepth] ; i++ ) _sNodes.treeNodes[i]->nodeData.constraint = constraints[i];
+    _setCenterWeights();
+}
+template< int Degree >
+void Octree< Degree >::_setCenterWeights( void )
+{
+    int maxDepth = _sNodes.maxDepth-1;
     // Set the point weights for evaluating the iso-value
 #ifdef USE_OPENMP     
 #pragma omp parallel for num_threads( threads )
 #endif
     for( int t=0 ; t<threads ; t++ )
-        for( int i=(_sNodes.nodeCount[maxDepth+1]*t)/threads ; i<(_sNodes.nodeCount[maxDepth+1]*(t+1))/threads ; i++ )
+        for( node_index_type i=(_sNodes.nodeCount[maxDepth+1]*t)/threads ; i<(_sNodes.nodeCount[maxDepth+1]*(t+1))/threads ; i++ )
         {
             TreeOctNode* temp = _sNodes.treeNodes[i];
             if( temp->nodeData.nodeIndex<0 || temp->nodeData.normalIndex<0 ) temp->nodeData.centerWeightContribution = 0;
@@ -2945,6 +3341,55 @@ void Octree< Degree >::FaceEdgesFunction::Function( const TreeOctNode* node1 , c
     }
 }
 
+template< int Degree >
+bool Octree< Degree >::_subdivisionBoundary( const TreeOctNode* leaf , int sDepth , bool boundary[3][2] )
+{
+    int d , off[3] , _off[3];
+    leaf->depthAndOffset( d , off );
+    int res = (1<<d)-1 , _res = ( 1<<(d-sDepth) )-1;
+    _off[0] = off[0]&_res , _off[1] = off[1]&_res , _off[2] = off[2]&_res;
+    bool onBoundary = false;
+    for( int c=0 ; c<3 ; c++ )
+    {
+        boundary[c][0] = off[c]!=0   && _off[c]==0;
+        boundary[c][1] = off[c]!=res && _off[c]==_res;
+        onBoundary = onBoundary || boundary[c][0] || boundary[c][1];
+    }
+    return onBoundary;
+}
+template< int Degree >
+template< class Neighbors >
+bool Octree< Degree >::_boundaryRefinementFlags( const bool boundary[3][2] , const Neighbors& neighbors , bool flags[3][3][3] )
+{
+    int x=0 , y=0 , z=0;
+    if     ( boundary[0][0] && !neighbors.neighbors[0][1][1] ) x = -1;
+    else if( boundary[0][1] && !neighbors.neighbors[2][1][1] ) x =  1;
+    if     ( boundary[1][0] && !neighbors.neighbors[1][0][1] ) y = -1;
+    else if( boundary[1][1] && !neighbors.neighbors[1][2][1] ) y =  1;
+    if     ( boundary[2][0] && !neighbors.neighbors[1][1][0] ) z = -1;
+    else if( boundary[2][1] && !neighbors.neighbors[1][1][2] ) z =  1;
+    if( !x && !y && !z ) return false;
+
+    for( int i=0 ; i<3 ; i++ ) for( int j=0 ; j<3 ; j++ ) for( int k=0 ; k<3 ; k++ ) flags[i][j][k] = false;
+    // Corner case
+    if( x && y && z ) flags[1+x][1+y][1+z] = true;
+    // Edge cases
+    if( x && y      ) flags[1+x][1+y][1  ] = true;
+    if( x &&      z ) flags[1+x][1  ][1+z] = true;
+    if(      y && z ) flags[1  ][1+y][1+1] = true;
+    // Face cases
+    if( x           ) flags[1+x][1  ][1  ] = true;
+    if(      y      ) flags[1  ][1+y][1  ] = true;
+    if(           z ) flags[1  ][1  ][1+z] = true;
+    return true;
+}
+template< int Degree >
+unsigned long long Octree< Degree >::_depthFirstKey( const TreeOctNode* node , int maxDepth )
+{
+    unsigned long long key = 0;
+    for( ; node->parent ; node=node->parent ) key |= (unsigned long long)( node-node->parent->children ) << ( 3*( maxDepth-node->depth() ) );
+    return key;
+}
 template< int Degree >
 int Octree< Degree >::refineBoundary( int subdivideDepth )
 {
@@ -2955,7 +3400,6 @@ int Octree< Degree >::refineBoundary( int subdivideDepth )
     // To this end, we do the minimal refinement that ensures that a cross boundary neighbor, and any of its cross-boundary
     // neighbors are all refined simultaneously.
     // For this reason, the implementation can only support nodes deeper than sDepth.
-    bool flags[3][3][3];
     int maxDepth = tree.maxDepth();
 
     subdivideDepth = std::max< int >( subdivideDepth , 0 );
@@ -2963,59 +3407,84 @@ int Octree< Degree >::refineBoundary( int subdivideDepth )
     subdivideDepth = std::min< int >( subdivideDepth , maxDepth );
     int sDepth = maxDepth - subdivideDepth;
     if( _boundaryType==0 ) sDepth = std::max< int >( 2 , sDepth );
-    if( sDepth==0 )
+    _sNodes.set( tree , threads );
+    if( sDepth==0 ) return sDepth;
+
+    // Ensure that face adjacent neighbors across the subdivision boundary exist to allow for
+    // a consistent definition of the iso-surface.
+    // The pass goes through the leaves in depth-first order and also visits the leaves created ahead of the current one.
+    // Refining only adds neighbors, so only the leaves missing neighbors before the pass can need refinement, besides
+    // the new ones. The former are looked up in parallel, then they and the new leaves are refined in order.
+    double time = Time();
+    typedef std::pair< unsigned long long , TreeOctNode* > QueuedLeaf;
+    std::vector< std::vector< QueuedLeaf > > flagged( threads );
+    std::vector< TreeOctNode::ConstNeighborKey3 > nKeys( threads );
+    node_index_type start = _sNodes.leafCount[sDepth+1] , count = _sNodes.leafCount[_sNodes.maxDepth]-start;
+#ifdef USE_OPENMP
+#pragma omp parallel for num_threads( threads )
+#endif
+    for( int t=0 ; t<threads ; t++ )
     {
-        _sNodes.set( tree );
-        return sDepth;
+        nKeys[t].set( maxDepth );
+        for( node_index_type i=start+(count*t)/threads ; i<start+(count*(t+1))/threads ; i++ )
+        {
+            TreeOctNode* leaf = _sNodes.leaves[i];
+            bool boundary[3][2] , flags[3][3][3];
+            if( _subdivisionBoundary( leaf , sDepth , boundary ) && _boundaryRefinementFlags( boundary , nKeys[t].getNeighbors( leaf ) , flags ) )
+                flagged[t].push_back( QueuedLeaf( _depthFirstKey( leaf , maxDepth ) , leaf ) );
+        }
     }
+    std::priority_queue< QueuedLeaf , std::vector< QueuedLeaf > , std::greater< QueuedLeaf > > leaves;
+    for( int t=0 ; t<threads ; t++ ) for( size_t i=0 ; i<flagged[t].size() ; i++ ) leaves.push( flagged[t][i] );
 
-    // Ensure that face adjacent neighbors across the subdivision boundary exist to allow for
-    // a consistent definition of the iso-surface
+    bool refined = false;
     TreeOctNode::NeighborKey3 nKey;
     nKey.set( maxDepth );
-    for( TreeOctNode* leaf=tree.nextLeaf() ; leaf ; leaf=tree.nextLeaf( leaf ) )
-        if( leaf->depth()>sDepth )
+    std::vector< TreeOctNode* > childless , subtree;
+    while( !leaves.empty() )
+    {
+        QueuedLeaf current = leaves.top();
+        leaves.pop();
+        TreeOctNode* leaf = current.second;
+        bool boundary[3][2] , flags[3][3][3];
+        if( leaf->children || leaf->depth()<=sDepth || !_subdivisionBoundary( leaf , sDepth , boundary ) ) continue;
+        if( !_boundaryRefinementFlags( boundary , nKey.getNeighbors( leaf ) , flags ) ) continue;
+
+        // Only nodes in the neighborhoods of the leaf and its ancestors get children
+        childless.clear();
         {
-            int d , off[3] , _off[3];
-            leaf->depthAndOffset( d , off );
-            int res = (1<<d)-1 , _res = ( 1<<(d-sDepth) )-1;
-            _off[0] = off[0]&_res , _off[1] = off[1]&_res , _off[2] = off[2]&_res;
-            bool boundary[3][2] =
-            {
-                { (off[0]!=0 && _off[0]==0) , (off[0]!=res && _off[0]==_res) } ,
-                { (off[1]!=0 && _off[1]==0) , (off[1]!=res && _off[1]==_res) } ,
-                { (off[2]!=0 && _off[2]==0) , (off[2]!=res && _off[2]==_res) }
-            };
+            TreeOctNode::ConstNeighborKey3 cKey;
+            cKey.set( leaf->depth() );
+            cKey.getNeighbors( leaf );
+            for( int d=0 ; d<leaf->depth() ; d++ )
+                for( int i=0 ; i<3 ; i++ ) for( int j=0 ; j<3 ; j++ ) for( int k=0 ; k<3 ; k++ )
+                {
+                    const TreeOctNode* node = cKey.neighbors[d].neighbors[i][j][k];
+                    if( node && !node->children ) childless.push_back( const_cast< TreeOctNode* >( node ) );
+                }
+        }
+        nKey.setNeighbors( leaf , flags );
 
-            if( boundary[0][0] || boundary[0][1] || boundary[1][0] || boundary[1][1] || boundary[2][0] || boundary[2][1] )
+        // Queue the new leaves behind the current one
+        for( size_t i=0 ; i<childless.size() ; i++ ) if( childless[i]->children )
+        {
+            refined = true;
+            subtree.assign( 1 , childless[i] );
+            while( !subtree.empty() )
             {
-                TreeOctNode::Neighbors3& neighbors = nKey.getNeighbors( leaf );
-                for( int i=0 ; i<3 ; i++ ) for( int j=0 ; j<3 ; j++ ) for( int k=0 ; k<3 ; k++ ) flags[i][j][k] = false;
-                int x=0 , y=0 , z=0;
-                if     ( boundary[0][0] && !neighbors.neighbors[0][1][1] ) x = -1;
-                else if( boundary[0][1] && !neighbors.neighbors[2][1][1] ) x =  1;
-                if     ( boundary[1][0] && !neighbors.neighbors[1][0][1] ) y = -1;
-                else if( boundary[1][1] && !neighbors.neighbors[1][2][1] ) y =  1;
-                if     ( boundary[2][0] && !neighbors.neighbors[1][1][0] ) z = -1;
-                else if( boundary[2][1] && !neighbors.neighbors[1][1][2] ) z =  1;
-
-                if( x || y || z )
+                TreeOctNode* node = subtree.back();
+                subtree.pop_back();
+                if( node->children ) for( unsigned int c=0 ; c<Cube::CORNERS ; c++ ) subtree.push_back( node->children+c );
+                else
                 {
-                    // Corner case
-                    if( x && y && z ) flags[1+x][1+y][1+z] = true;
-                    // Edge cases
-                    if( x && y      ) flags[1+x][1+y][1  ] = true;
-                    if( x &&      z ) flags[1+x][1  ][1+z] = true;
-                    if(      y && z ) flags[1  ][1+y][1+1] = true;
-                    // Face cases
-                    if( x           ) flags[1+x][1  ][1  ] = true;
-                    if(      y      ) flags[1  ][1+y][1  ] = true;
-                    if(           z ) flags[1  ][1  ][1+z] = true;
-                    nKey.setNeighbors( leaf , flags );
+                    unsigned long long key = _depthFirstKey( node , maxDepth );
+                    if( key>current.first ) leaves.push( QueuedLeaf( key , node ) );
                 }
             }
         }
-    _sNodes.set( tree );
+    }
+    if( refined ) _sNodes.set( tree , threads );
+    DumpOutput( "Time for boundary refinement: %f\n" , Time()-time );
     MemoryUsage();
     return sDepth;
 }
@@ -3030,27 +3499,45 @@ void Octree<Degree>::GetMCIsoTriangles( Real isoValue , int subdivideDepth , Cor
     std::vector< Point3D< Real > >* interiorPoints;
     int maxDepth = tree.maxDepth();
 
+    // With a region of interest, triangles are only extracted from the leaves touching it. Roots are computed for
+    // all leaves within the bounding box of those leaves, so that every root on their edges and faces gets set.
+    Point3D< Real > rootMin = _roiNodeMin , rootMax = _roiNodeMax;
+    if( _useROI )
+        for( node_index_type i=0 ; i<_sNodes.nodeCount[maxDepth+1] ; i++ )
+        {
+            const TreeOctNode* leaf = _sNodes.treeNodes[i];
+            if( leaf->children || !_intersectsBox( leaf , _roiNodeMin , _roiNodeMax ) ) continue;
+            Point3D< Real > center;
+            Real width;
+            leaf->centerAndWidth( center , width );
+            for( int d=0 ; d<3 ; d++ )
+            {
+                rootMin[d] = std::min< Real >( rootMin[d] , center[d]-width/2 );
+                rootMax[d] = std::max< Real >( rootMax[d] , center[d]+width/2 );
+            }
+        }
+
     std::vector< Real > metSolution( _sNodes.nodeCount[maxDepth] , 0 );
 #ifdef USE_OPENMP     
 #pragma omp parallel for num_threads( threads )
 #endif
-    for( int i=_sNodes.nodeCount[_minDepth] ; i<_sNodes.nodeCount[maxDepth] ; i++ ) metSolution[i] = _sNodes.treeNodes[i]->nodeData.solution;
+    for( node_index_type i=_sNodes.nodeCount[_minDepth] ; i<_sNodes.nodeCount[maxDepth] ; i++ ) metSolution[i] = _sNodes.treeNodes[i]->nodeData.solution;
     for( int d=_minDepth ; d<maxDepth ; d++ ) UpSample( d , _sNodes , &metSolution[0] );
 
     // Clear the marching cube indices
 #ifdef USE_OPENMP     
 #pragma omp parallel for num_threads( threads )
 #endif
-    for( int i=0 ; i<_sNodes.nodeCount[maxDepth+1] ; i++ ) _sNodes.treeNodes[i]->nodeData.mcIndex = 0;
+    for( node_index_type i=0 ; i<_sNodes.nodeCount[maxDepth+1] ; i++ ) _sNodes.treeNodes[i]->nodeData.mcIndex = 0;
 
     rootData.boundaryValues = new hash_map< long long , std::pair< Real , Point3D< Real > > >();
-    int offSet = 0;
+    node_index_type offSet = 0;
 
-    int maxCCount = _sNodes.getMaxCornerCount( sDepth , maxDepth , threads );
-    int maxECount = _sNodes.getMaxEdgeCount  ( &tree , sDepth , threads );
+    node_index_type maxCCount = _sNodes.getMaxCornerCount( sDepth , maxDepth , threads );
+    node_index_type maxECount = _sNodes.getMaxEdgeCount  ( &tree , sDepth , threads );
     rootData.cornerValues     = NewPointer< Real            >( maxCCount );
     rootData.cornerNormals    = NewPointer< Point3D< Real > >( maxCCount );
-    rootData.interiorRoots    = NewPointer< int             >( maxECount );
+    rootData.interiorRoots    = NewPointer< node_index_type >( maxECount );
     rootData.cornerValuesSet  = NewPointer< char            >( maxCCount );
     rootData.cornerNormalsSet = NewPointer< char            >( maxCCount );
     rootData.edgesSet         = NewPointer< char            >( maxECount );
@@ -3071,7 +3558,7 @@ void Octree<Degree>::GetMCIsoTriangles( Real isoValue , int subdivideDepth , Cor
     TreeOctNode::ConstNeighborKey5 nKey5;
     nKey5.set( maxDepth ) , nKey.set( maxDepth );
     // First process all leaf nodes at depths strictly finer than sDepth, one subtree at a time.
-    for( int i=_sNodes.nodeCount[sDepth] ; i<_sNodes.nodeCount[sDepth+1] ; i++ )
+    for( node_index_type i=_sNodes.nodeCount[sDepth] ; i<_sNodes.nodeCount[sDepth+1] ; i++ )
     {
         if( !_sNodes.treeNodes[i]->children ) continue;
 
@@ -3083,11 +3570,10 @@ void Octree<Degree>::GetMCIsoTriangles( Real isoValue , int subdivideDepth , Cor
         interiorPoints = new std::vector< Point3D< Real > >();
         for( int d=maxDepth ; d>sDepth ; d-- )
         {
-            int leafNodeCount = 0;
-            std::vector< TreeOctNode* > leafNodes;
-            for( TreeOctNode* node=_sNodes.treeNodes[i]->nextLeaf() ; node ; node=_sNodes.treeNodes[i]->nextLeaf( node ) ) if( node->d==d && node->nodeData.nodeIndex!=-1 ) leafNodeCount++;
-            leafNodes.reserve( leafNodeCount );
-            for( TreeOctNode* node=_sNodes.treeNodes[i]->nextLeaf() ; node ; node=_sNodes.treeNodes[i]->nextLeaf( node ) ) if( node->d==d && node->nodeData.nodeIndex!=-1 ) leafNodes.push_back( node );
+            node_index_type leafStart , leafEnd;
+            _sNodes.leafRange( _sNodes.treeNodes[i] , d , leafStart , leafEnd );
+            node_index_type leafNodeCount = leafEnd - leafStart;
+            Pointer( TreeOctNode* ) leafNodes = _sNodes.leaves + leafStart;
             Stencil< Real , 3 > stencil1[8] , stencil2[8][8];
             SetEvaluationStencils( d , stencil1 , stencil2 );
 
@@ -3095,7 +3581,7 @@ void Octree<Degree>::GetMCIsoTriangles( Real isoValue , int subdivideDepth , Cor
 #ifdef USE_OPENMP             
 #pragma omp parallel for num_threads( threads )
 #endif
-            for( int t=0 ; t<threads ; t++ ) for( int i=(leafNodeCount*t)/threads ; i<(leafNodeCount*(t+1))/threads ; i++ )
+            for( int t=0 ; t<threads ; t++ ) for( node_index_type i=(leafNodeCount*t)/threads ; i<(leafNodeCount*(t+1))/threads ; i++ )
             {
                 TreeOctNode* leaf = leafNodes[i];
                 SetIsoCorners( isoValue , leaf , rootData , rootData.cornerValuesSet , rootData.cornerValues , nKeys[t] , &metSolution[0] , stencil1 , stencil2 );
@@ -3112,30 +3598,42 @@ void Octree<Degree>::GetMCIsoTriangles( Real isoValue , int subdivideDepth , Cor
                     while( temp->d!=sDepth ) temp = temp->parent;
                     int x = off[0]==0 ? 0 : 1 , y = off[1]==0 ? 0 : 1 , z = off[2]==0 ? 0 : 1;
                     int c = Cube::CornerIndex( x , y , z );
-                    int idx = coarseRootData.cornerIndices( temp )[ c ];
+                    node_index_type idx = coarseRootData.cornerIndices( temp )[ c ];
                     coarseRootData.cornerValues[ idx ] = rootData.cornerValues[ rootData.cornerIndices( leaf )[c] ];
                     coarseRootData.cornerValuesSet[ idx ] = true;
                 }
 
                 // Compute the iso-vertices
                 //
+                if( deterministic || ( _useROI && !_intersectsBox( leaf , rootMin , rootMax ) ) ) continue;
                 if( _boundaryType!=0 || _IsInset( leaf ) ) SetMCRootPositions( leaf , sDepth , isoValue , nKeys5[t] , rootData , interiorPoints , mesh , &metSolution[0] , nonLinearFit );
             }
+            // The vertex indices depend on the order in which the roots are added, so add them serially
+            if( deterministic )
+                for( node_index_type i=0 ; i<leafNodeCount ; i++ )
+                {
+                    TreeOctNode* leaf = leafNodes[i];
+                    if( _useROI && !_intersectsBox( leaf , rootMin , rootMax ) ) continue;
+                    if( _boundaryType!=0 || _IsInset( leaf ) ) SetMCRootPositions( leaf , sDepth , isoValue , nKey5 , rootData , interiorPoints , mesh , &metSolution[0] , nonLinearFit );
+                }
             // Note that this should be broken off for multi-threading as
             // the SetMCRootPositions writes to interiorPoints (with lockupdateing)
             // while GetMCIsoTriangles reads from interiorPoints (without locking)
             std::vector< Point3D< Real > > barycenters;
             std::vector< Point3D< Real > >* barycenterPtr = addBarycenter ? & barycenters : NULL;
+            int isoThreads = deterministic ? 1 : threads;
 #ifdef USE_OPENMP             
-#pragma omp parallel for num_threads( threads )
+#pragma omp parallel for num_threads( isoThreads )
 #endif
-            for( int t=0 ; t<threads ; t++ ) for( int i=(leafNodeCount*t)/threads ; i<(leafNodeCount*(t+1))/threads ; ++i )
+            for( int t=0 ; t<isoThreads ; t++ ) for( node_index_type i=(leafNodeCount*t)/isoThreads ; i<(leafNodeCount*(t+1))/isoThreads ; ++i )
             {
                 TreeOctNode* leaf = leafNodes[i];
+                if( _useROI && !_intersectsBox( leaf , _roiNodeMin , _roiNodeMax ) ) continue;
                 if( _boundaryType!=0 || _IsInset( leaf ) ) GetMCIsoTriangles( leaf , mesh , rootData , interiorPoints , offSet , sDepth , polygonMesh , barycenterPtr );
             }
             for( size_t i=0 ; i<barycenters.size() ; i++ ) interiorPoints->push_back( barycenters[i] );
         }
+        mesh->endSubtree();
         offSet = mesh->outOfCorePointCount();
         delete interiorPoints;
     }
@@ -3145,9 +3643,9 @@ void Octree<Degree>::GetMCIsoTriangles( Real isoValue , int subdivideDepth , Cor
     DeletePointer( rootData.cornerValuesSet ) ; DeletePointer( rootData.cornerNormalsSet );
     DeletePointer( rootData.interiorRoots );
     DeletePointer( rootData.edgesSet );
-    coarseRootData.interiorRoots = NullPointer< int >();
+    coarseRootData.interiorRoots = NullPointer< node_index_type >();
     coarseRootData.boundaryValues = rootData.boundaryValues;
-    for( hash_map< long long , int >::iterator iter=rootData.boundaryRoots.begin() ; iter!=rootData.boundaryRoots.end() ; ++iter )
+    for( hash_map< long long , node_index_type >::iterator iter=rootData.boundaryRoots.begin() ; iter!=rootData.boundaryRoots.end() ; ++iter )
         coarseRootData.boundaryRoots[iter->first] = iter->second;
 
     for( int d=sDepth ; d>=0 ; d-- )
@@ -3156,7 +3654,7 @@ void Octree<Degree>::GetMCIsoTriangles( Real isoValue , int subdivideDepth , Cor
         SetEvaluationStencils( d , stencil1 , stencil2 );
         std::vector< Point3D< Real > > barycenters;
         std::vector< Point3D< Real > >* barycenterPtr = addBarycenter ? &barycenters : NULL;
-        for( int i=_sNodes.nodeCount[d] ; i<_sNodes.nodeCount[d+1] ; i++ )
+        for( node_index_type i=_sNodes.nodeCount[d] ; i<_sNodes.nodeCount[d+1] ; i++ )
         {
             TreeOctNode* leaf = _sNodes.treeNodes[i];
             if( leaf->children ) continue;
@@ -3166,10 +3664,10 @@ void Octree<Degree>::GetMCIsoTriangles( Real isoValue , int subdivideDepth , Cor
 
             // Now compute the iso-vertices
             {
-                if( _boundaryType!=0 || _IsInset( leaf ) )
+                if( ( _boundaryType!=0 || _IsInset( leaf ) ) && ( !_useROI || _intersectsBox( leaf , rootMin , rootMax ) ) )
                 {
                     SetMCRootPositions( leaf , 0 , isoValue , nKey5 , coarseRootData , NULL , mesh , &metSolution[0] , nonLinearFit );
-                    GetMCIsoTriangles( leaf , mesh , coarseRootData , NULL , 0 , 0 , polygonMesh , barycenterPtr );
+                    if( !_useROI || _intersectsBox( leaf , _roiNodeMin , _roiNodeMax ) ) GetMCIsoTriangles( leaf , mesh , coarseRootData , NULL , 0 , 0 , polygonMesh , barycenterPtr );
                 }
             }
         }
@@ -3192,16 +3690,21 @@ Real Octree<Degree>::getCenterValue( const OctNode< TreeNodeData , Real >::Const
     idx[2] *= fData.functionCount;
     int minDepth = std::max< int >( 0 , std::min< int >( _minDepth , node->depth()-1 ) );
     for( int i=minDepth ; i<=node->depth() ; i++ )
-        for( int j=0 ; j<3 ; j++ ) for( int k=0 ; k<3 ; k++ ) for( int l=0 ; l<3 ; l++ )
+    {
+        const TreeOctNode* center = neighborKey.neighbors[i].neighbors[1][1][1];
+        if( !center ) continue;
+        Real weights[3][3];
+        for( int dd=0 ; dd<3 ; dd++ ) SetAxisWeights< 3 >( fData.valueTables , idx[dd] , int(center->off[dd]) , 0 , 3 , weights[dd] );
+        for( int j=0 ; j<3 ; j++ ) for( int k=0 ; k<3 ; k++ )
         {
-            const TreeOctNode* n=neighborKey.neighbors[i].neighbors[j][k][l];
-            if( n )
-                value +=
-                        n->nodeData.solution * Real(
-                            fData.valueTables[idx[0]+int(n->off[0])]*
-                            fData.valueTables[idx[1]+int(n->off[1])]*
-                            fData.valueTables[idx[2]+int(n->off[2])]);
+            Real jk = weights[0][j] * weights[1][k];
+            for( int l=0 ; l<3 ; l++ )
+            {
+                const TreeOctNode* n=neighborKey.neighbors[i].neighbors[j][k][l];
+                if( n ) value += n->nodeData.solution * Real( jk * weights[2][l] );
+            }
         }
+    }
     if( node->children )
     {
         for(unsigned int i=0;i<Cube::CORNERS;i++){
@@ -3221,17 +3724,21 @@ Real Octree<Degree>::getCenterValue( const OctNode< TreeNodeData , Real >::Const
     return value;
 }
 template< int Degree >
-Real Octree< Degree >::getCornerValue( const OctNode< TreeNodeData , Real >::ConstNeighborKey3& neighborKey3 , const TreeOctNode* node , int corner , const Real* metSolution )
+template< int Width , class WeightReal >
+void Octree< Degree >::SetAxisWeights( ConstPointer( Real ) table , int sampleOffset , int centerFunction , int start , int end , WeightReal weights[Width] ) const
+{
+    for( int i=0 ; i<Width ; i++ )
+    {
+        int f = centerFunction + i - Width/2;
+        if( i>=start && i<end && f>=0 && f<fData.functionCount ) weights[i] = WeightReal( table[ sampleOffset+f ] );
+        else                                                     weights[i] = WeightReal( 0 );
+    }
+}
+template< int Degree >
+Real Octree< Degree >::getCornerValue( const OctNode< TreeNodeData , Real >::ConstNeighborKey3& neighborKey3 , const TreeOctNode* node , int corner , const Real* metSolution , const Real stencil1[3][3][3] , const Real stencil2[3][3][3] )
 {
-    int idx[3];
     Real value = 0;
     if( _boundaryType==-1 ) value = -0.5;
-
-    VertexData::CornerIndex( node , corner , fData.depth , idx );
-    idx[0] *= fData.functionCount;
-    idx[1] *= fData.functionCount;
-    idx[2] *= fData.functionCount;
-
     int d = node->depth();
     int cx , cy , cz;
     int startX = 0 , endX = 3 , startY = 0 , endY = 3 , startZ = 0 , endZ = 3;
@@ -3247,12 +3754,7 @@ Real Octree< Degree >::getCornerValue( const OctNode< TreeNodeData , Real >::Con
         for( int x=startX ; x<endX ; x++ ) for( int y=startY ; y<endY ; y++ ) for( int z=startZ ; z<endZ ; z++ )
         {
             const TreeOctNode* n=neighbors.neighbors[x][y][z];
-            if( n )
-                value +=
-                        fData.valueTables[ idx[0]+int(n->off[0]) ]*
-                        fData.valueTables[ idx[1]+int(n->off[1]) ]*
-                        fData.valueTables[ idx[2]+int(n->off[2]) ]*
-                        n->nodeData.solution;
+            if( n ) value += n->nodeData.solution * stencil1[x][y][z];
         }
     }
     if( d>0 && d>_minDepth )
@@ -3267,37 +3769,64 @@ Real Octree< Degree >::getCornerValue( const OctNode< TreeNodeData , Real >::Con
         for( int x=startX ; x<endX ; x++ ) for( int y=startY ; y<endY ; y++ ) for( int z=startZ ; z<endZ ; z++ )
         {
             const TreeOctNode* n=neighbors.neighbors[x][y][z];
-            if( n )
-                value +=
-                        fData.valueTables[ idx[0]+int(n->off[0]) ]*
-                        fData.valueTables[ idx[1]+int(n->off[1]) ]*
-                        fData.valueTables[ idx[2]+int(n->off[2]) ]*
-                        metSolution[ n->nodeData.nodeIndex ];
+            if( n ) value += metSolution[ n->nodeData.nodeIndex ] * stencil2[x][y][z];
         }
     }
     return Real( value );
 }
 template< int Degree >
-Real Octree< Degree >::getCornerValue( const OctNode< TreeNodeData , Real >::ConstNeighborKey3& neighborKey3 , const TreeOctNode* node , int corner , const Real* metSolution , const Real stencil1[3][3][3] , const Real stencil2[3][3][3] )
+void Octree< Degree >::GatherCornerCoefficients( const OctNode< TreeNodeData , Real >::ConstNeighborKey3& neighborKey3 , const TreeOctNode* node , const Real* metSolution , Real solutions[3][3][3] , Real coarseSolutions[3][3][3] ) const
+{
+    int d = node->depth();
+    const TreeOctNode::ConstNeighbors3& neighbors = neighborKey3.neighbors[d];
+    for( int x=0 ; x<3 ; x++ ) for( int y=0 ; y<3 ; y++ ) for( int z=0 ; z<3 ; z++ )
+    {
+        const TreeOctNode* n = neighbors.neighbors[x][y][z];
+        solutions[x][y][z] = n ? n->nodeData.solution : Real(0);
+    }
+    if( d>0 && d>_minDepth )
+    {
+        const TreeOctNode::ConstNeighbors3& _neighbors = neighborKey3.neighbors[d-1];
+        for( int x=0 ; x<3 ; x++ ) for( int y=0 ; y<3 ; y++ ) for( int z=0 ; z<3 ; z++ )
+        {
+            const TreeOctNode* n = _neighbors.neighbors[x][y][z];
+            coarseSolutions[x][y][z] = n ? metSolution[ n->nodeData.nodeIndex ] : Real(0);
+        }
+    }
+    else memset( coarseSolutions , 0 , sizeof( Real ) * 27 );
+}
+template< int Degree >
+Real Octree< Degree >::getCornerValue( const TreeOctNode* node , int corner , const Real solutions[3][3][3] , const Real coarseSolutions[3][3][3] ) const
 {
+    int idx[3];
     Real value = 0;
     if( _boundaryType==-1 ) value = -0.5;
+
+    VertexData::CornerIndex( node , corner , fData.depth , idx );
+    idx[0] *= fData.functionCount;
+    idx[1] *= fData.functionCount;
+    idx[2] *= fData.functionCount;
+
     int d = node->depth();
     int cx , cy , cz;
     int startX = 0 , endX = 3 , startY = 0 , endY = 3 , startZ = 0 , endZ = 3;
     Cube::FactorCornerIndex( corner , cx , cy , cz );
     {
-        TreeOctNode::ConstNeighbors3& neighbors = neighborKey3.neighbors[d];
         if( cx==0 ) endX = 2;
         else      startX = 1;
         if( cy==0 ) endY = 2;
         else      startY = 1;
         if( cz==0 ) endZ = 2;
         else      startZ = 1;
-        for( int x=startX ; x<endX ; x++ ) for( int y=startY ; y<endY ; y++ ) for( int z=startZ ; z<endZ ; z++ )
+        Real wx[3] , wy[3] , wz[3];
+        SetAxisWeights< 3 >( fData.valueTables , idx[0] , int(node->off[0]) , startX , endX , wx );
+        SetAxisWeights< 3 >( fData.valueTables , idx[1] , int(node->off[1]) , startY , endY , wy );
+        SetAxisWeights< 3 >( fData.valueTables , idx[2] , int(node->off[2]) , startZ , endZ , wz );
+        for( int x=0 ; x<3 ; x++ ) for( int y=0 ; y<3 ; y++ )
         {
-            const TreeOctNode* n=neighbors.neighbors[x][y][z];
-            if( n ) value += n->nodeData.solution * stencil1[x][y][z];
+            Real xy = wx[x] * wy[y];
+            if( xy==0 ) continue;
+            for( int z=0 ; z<3 ; z++ ) value += xy * wz[z] * solutions[x][y][z];
         }
     }
     if( d>0 && d>_minDepth )
@@ -3308,11 +3837,16 @@ Real Octree< Degree >::getCornerValue( const OctNode< TreeNodeData , Real >::Con
         if( cx!=_cx ) startX = 0 , endX = 3;
         if( cy!=_cy ) startY = 0 , endY = 3;
         if( cz!=_cz ) startZ = 0 , endZ = 3;
-        TreeOctNode::ConstNeighbors3& neighbors = neighborKey3.neighbors[d-1];
-        for( int x=startX ; x<endX ; x++ ) for( int y=startY ; y<endY ; y++ ) for( int z=startZ ; z<endZ ; z++ )
+        const TreeOctNode* parent = node->parent;
+        Real wx[3] , wy[3] , wz[3];
+        SetAxisWeights< 3 >( fData.valueTables , idx[0] , int(parent->off[0]) , startX , endX , wx );
+        SetAxisWeights< 3 >( fData.valueTables , idx[1] , int(parent->off[1]) , startY , endY , wy );
+        SetAxisWeights< 3 >( fData.valueTables , idx[2] , int(parent->off[2]) , startZ , endZ , wz );
+        for( int x=0 ; x<3 ; x++ ) for( int y=0 ; y<3 ; y++ )
         {
-            const TreeOctNode* n=neighbors.neighbors[x][y][z];
-            if( n ) value += metSolution[ n->nodeData.nodeIndex ] * stencil2[x][y][z];
+            Real xy = wx[x] * wy[y];
+            if( xy==0 ) continue;
+            for( int z=0 ; z<3 ; z++ ) value += xy * wz[z] * coarseSolutions[x][y][z];
         }
     }
     return Real( value );
@@ -3330,61 +3864,109 @@ Point3D< Real > Octree< Degree >::getCornerNormal( const OctNode< TreeNodeData ,
     idx[2] *= fData.functionCount;
 
     int d = node->depth();
+    double values[3][5] , dValues[3][5];
     // Iterate over all ancestors that can overlap the corner
     {
         TreeOctNode::ConstNeighbors5& neighbors = neighborKey5.neighbors[d];
+        for( int dd=0 ; dd<3 ; dd++ )
+        {
+            SetAxisWeights< 5 >(  fData.valueTables , idx[dd] , int(node->off[dd]) , 0 , 5 ,  values[dd] );
+            SetAxisWeights< 5 >( fData.dValueTables , idx[dd] , int(node->off[dd]) , 0 , 5 , dValues[dd] );
+        }
         for( int j=0 ; j<5 ; j++ ) for( int k=0 ; k<5 ; k++ ) for( int l=0 ; l<5 ; l++ )
         {
             const TreeOctNode* n=neighbors.neighbors[j][k][l];
             if( n )
             {
-                int _idx[] = { idx[0] + n->off[0] , idx[1] + n->off[1] , idx[2] + n->off[2] };
-                double  values[] = {  fData.valueTables[_idx[0]] ,  fData.valueTables[_idx[1]] ,  fData.valueTables[_idx[2]] };
-                double dValues[] = { fData.dValueTables[_idx[0]] , fData.dValueTables[_idx[1]] , fData.dValueTables[_idx[2]] };
                 Real solution = n->nodeData.solution;
-                normal[0] += Real( dValues[0] *  values[1] *  values[2] * solution );
-                normal[1] += Real(  values[0] * dValues[1] *  values[2] * solution );
-                normal[2] += Real(  values[0] *  values[1] * dValues[2] * solution );
+                normal[0] += Real( dValues[0][j] *  values[1][k] *  values[2][l] * solution );
+                normal[1] += Real(  values[0][j] * dValues[1][k] *  values[2][l] * solution );
+                normal[2] += Real(  values[0][j] *  values[1][k] * dValues[2][l] * solution );
             }
         }
     }
     if( d>0 && d>_minDepth )
     {
         TreeOctNode::ConstNeighbors5& neighbors = neighborKey5.neighbors[d-1];
+        const TreeOctNode* parent = node->parent;
+        for( int dd=0 ; dd<3 ; dd++ )
+        {
+            SetAxisWeights< 5 >(  fData.valueTables , idx[dd] , int(parent->off[dd]) , 0 , 5 ,  values[dd] );
+            SetAxisWeights< 5 >( fData.dValueTables , idx[dd] , int(parent->off[dd]) , 0 , 5 , dValues[dd] );
+        }
         for( int j=0 ; j<5 ; j++ ) for( int k=0 ; k<5 ; k++ ) for( int l=0 ; l<5 ; l++ )
         {
             const TreeOctNode* n=neighbors.neighbors[j][k][l];
             if( n )
             {
-                int _idx[] = { idx[0] + n->off[0] , idx[1] + n->off[1] , idx[2] + n->off[2] };
-                double  values[] = {  fData.valueTables[_idx[0]] ,  fData.valueTables[_idx[1]] ,  fData.valueTables[_idx[2]] };
-                double dValues[] = { fData.dValueTables[_idx[0]] , fData.dValueTables[_idx[1]] , fData.dValueTables[_idx[2]] };
                 Real solution = metSolution[ n->nodeData.nodeIndex ];
-                normal[0] += Real( dValues[0] *  values[1] *  values[2] * solution );
-                normal[1] += Real(  values[0] * dValues[1] *  values[2] * solution );
-                normal[2] += Real(  values[0] *  values[1] * dValues[2] * solution );
+                normal[0] += Real( dValues[0][j] *  values[1][k] *  values[2][l] * solution );
+                normal[1] += Real(  values[0][j] * dValues[1][k] *  values[2][l] * solution );
+                normal[2] += Real(  values[0][j] *  values[1][k] * dValues[2][l] * solution );
             }
         }
     }
     return normal;
 }
 template< int Degree >
+void Octree< Degree >::getNodeKeys( std::vector< long long >& keys ) const
+{
+    keys.resize( _sNodes.nodeCount[_sNodes.maxDepth] );
+#ifdef USE_OPENMP     
+#pragma omp parallel for num_threads( threads )
+#endif
+    for( node_index_type i=0 ; i<node_index_type( keys.size() ) ; i++ ) keys[i] = VertexData::CenterIndex( _sNodes.treeNodes[i] , fData.depth );
+}
+template< int Degree >
+void Octree< Degree >::getConstraints( std::vector< Real >& constraints ) const
+{
+    constraints.resize( _sNodes.nodeCount[_sNodes.maxDepth] );
+    for( node_index_type i=0 ; i<node_index_type( constraints.size() ) ; i++ ) constraints[i] = _sNodes.treeNodes[i]->nodeData.constraint;
+}
+template< int Degree >
+void Octree< Degree >::getSolution( std::vector< Real >& solution ) const
+{
+    solution.resize( _sNodes.nodeCount[_sNodes.maxDepth] );
+    for( node_index_type i=0 ; i<node_index_type( solution.size() ) ; i++ ) solution[i] = _sNodes.treeNodes[i]->nodeData.solution;
+}
+template< int Degree >
+void Octree< Degree >::setSolution( const std::vector< long long >& keys , const std::vector< Real >& solution )
+{
+    std::vector< long long > _keys;
+    getNodeKeys( _keys );
+    if( _keys==keys )
+        for( node_index_type i=0 ; i<node_index_type( _keys.size() ) ; i++ ) _sNodes.treeNodes[i]->nodeData.solution = solution[i];
+    else
+    {
+        // The trees differ, look up the nodes they share
+        hash_map< long long , node_index_type > indices;
+        for( node_index_type i=0 ; i<node_index_type( keys.size() ) ; i++ ) indices[ keys[i] ] = i;
+        for( node_index_type i=0 ; i<node_index_type( _keys.size() ) ; i++ )
+        {
+            hash_map< long long , node_index_type >::const_iterator iter = indices.find( _keys[i] );
+            _sNodes.treeNodes[i]->nodeData.solution = iter==indices.end() ? Real(0) : solution[ iter->second ];
+        }
+    }
+    _warmStart = true;
+}
+template< int Degree >
 Real Octree<Degree>::GetIsoValue( void )
 {
-    Real isoValue , weightSum;
-
     fData.setValueTables( fData.VALUE_FLAG , 0 );
 
-    isoValue = weightSum = 0;
+    int blocks = _reductionBlocks();
+    std::vector< Real > isoValues( blocks , Real(0) ) , weightSums( blocks , Real(0) );
 #ifdef USE_OPENMP     
-#pragma omp parallel for num_threads( threads ) reduction( + : isoValue , weightSum )
+#pragma omp parallel for num_threads( threads ) schedule( dynamic , 1 )
 #endif
-    for( int t=0 ; t<threads ; t++)
+    for( int t=0 ; t<blocks ; t++)
     {
         TreeOctNode::ConstNeighborKey3 nKey;
         nKey.set( _sNodes.maxDepth-1 );
-        int nodeCount = _sNodes.nodeCount[ _sNodes.maxDepth ];
-        for( int i=(nodeCount*t)/threads ; i<(nodeCount*(t+1))/threads ; i++ )
+        node_index_type nodeCount = _sNodes.nodeCount[ _sNodes.maxDepth ];
+        Real& isoValue = isoValues[t];
+        Real& weightSum = weightSums[t];
+        for( node_index_type i=(nodeCount*t)/blocks ; i<(nodeCount*(t+1))/blocks ; i++ )
         {
             TreeOctNode* temp = _sNodes.treeNodes[i];
             nKey.getNeighbors( temp );
@@ -3396,6 +3978,8 @@ Real Octree<Degree>::GetIsoValue( void )
             }
         }
     }
+    Real isoValue = 0 , weightSum = 0;
+    for( int t=0 ; t<blocks ; t++ ) isoValue += isoValues[t] , weightSum += weightSums[t];
     if( _boundaryType==-1 ) return isoValue/weightSum - Real(0.5);
     else                    return isoValue/weightSum;
 }
@@ -3413,14 +3997,20 @@ void Octree< Degree >::SetIsoCorners( Real isoValue , TreeOctNode* leaf , Sorted
     int mn = 2+o , mx = (1<<d)-2-o;
     isInterior = ( off[0]>=mn && off[0]<mx && off[1]>=mn && off[1]<mx && off[2]>=mn && off[2]<mx );
     nKey.getNeighbors( leaf );
+    Real solutions[3][3][3] , coarseSolutions[3][3][3];
+    bool gathered = false;
     for( unsigned int c=0 ; c<Cube::CORNERS ; c++ )
     {
-        int vIndex = cIndices[c];
+        node_index_type vIndex = cIndices[c];
         if( valuesSet[vIndex] ) cornerValues[c] = values[vIndex];
         else
         {
             if( isInterior && 0 ) cornerValues[c] = getCornerValue( nKey , leaf , c , metSolution , stencil1[c].values , stencil2[int(leaf - leaf->parent->children)][c].values );
-            else             cornerValues[c] = getCornerValue( nKey , leaf , c , metSolution );
+            else
+            {
+                if( !gathered ) GatherCornerCoefficients( nKey , leaf , metSolution , solutions , coarseSolutions ) , gathered = true;
+                cornerValues[c] = getCornerValue( leaf , c , solutions , coarseSolutions );
+            }
             values[vIndex] = cornerValues[c];
             valuesSet[vIndex] = 1;
         }
@@ -3631,7 +4221,7 @@ void Octree< Degree >::GetRootSpan( const RootInfo& ri , Point3D< Real >& start
 // The assumption made when calling this code is that the edge has at most one root //
 //////////////////////////////////////////////////////////////////////////////////////
 template< int Degree >
-int Octree< Degree >::GetRoot( const RootInfo& ri , Real isoValue , TreeOctNode::ConstNeighborKey5& neighborKey5 , Point3D< Real > & position , RootData& rootData , int sDepth , const Real* metSolution , int nonLinearFit )
+int Octree< Degree >::GetRoot( const RootInfo& ri , Real isoValue , TreeOctNode::ConstNeighborKey5& neighborKey5 , Point3D< Real > & position , RootData& rootData , int sDepth , const Real* metSolution , int nonLinearFit , Point3D< Real >* normal )
 {
     if( !MarchingCubes::HasRoots( ri.node->nodeData.mcIndex ) ) return 0;
     int c1 , c2;
@@ -3655,7 +4245,7 @@ int Octree< Degree >::GetRoot( const RootInfo& ri , Real isoValue , TreeOctNode:
     bool isBoundary = ( IsBoundaryEdge( ri.node , ri.edgeIndex , sDepth )!=0 );
     bool haveKey1 , haveKey2;
     std::pair< Real , Point3D< Real > > keyValue1 , keyValue2;
-    int iter1 , iter2;
+    node_index_type iter1 , iter2;
     {
         iter1 = rootData.cornerIndices( ri.node )[ c1 ];
         iter2 = rootData.cornerIndices( ri.node )[ c2 ];
@@ -3762,6 +4352,14 @@ int Octree< Degree >::GetRoot( const RootInfo& ri , Real isoValue , TreeOctNode:
         if( averageRoot>1 ) averageRoot = 1;
     }
     position[o] = Real(center-width/2+width*averageRoot);
+    if( normal )
+    {
+        // The implicit function grows towards the inside, so the outward normal is the negated gradient. The output
+        // frame is only scaled uniformly, which keeps the direction.
+        *normal = n[0] * ( Real(1)-averageRoot ) + n[1] * averageRoot;
+        Real length = Real( Length( *normal ) );
+        if( length>0 ) *normal /= -length;
+    }
     return 1;
 }
 template< int Degree >
@@ -3946,7 +4544,7 @@ template<int Degree>
 int Octree< Degree >::GetRootIndex( const RootInfo& ri , RootData& rootData , CoredPointIndex& index )
 {
     long long key = ri.key;
-    hash_map< long long , int >::iterator rootIter;
+    hash_map< long long , node_index_type >::iterator rootIter;
     rootIter = rootData.boundaryRoots.find( key );
     if( rootIter!=rootData.boundaryRoots.end() )
     {
@@ -3956,7 +4554,7 @@ int Octree< Degree >::GetRootIndex( const RootInfo& ri , RootData& rootData , Co
     }
     else if( rootData.interiorRoots )
     {
-        int eIndex = rootData.edgeIndices( ri.node )[ ri.edgeIndex ];
+        node_index_type eIndex = rootData.edgeIndices( ri.node )[ ri.edgeIndex ];
         if( rootData.edgesSet[ eIndex ] )
         {
             index.inCore = 0;
@@ -3970,7 +4568,8 @@ template< int Degree >
 int Octree< Degree >::SetMCRootPositions( TreeOctNode* node , int sDepth , Real isoValue , TreeOctNode::ConstNeighborKey5& neighborKey5 , RootData& rootData , 
                                           std::vector< Point3D< Real > >* interiorPositions , CoredMeshData* mesh , const Real* metSolution , int nonLinearFit )
 {
-    Point3D< Real > position;
+    Point3D< Real > position , normal;
+    Point3D< Real >* normalPtr = mesh->storeNormals ? &normal : NULL;
     int eIndex;
     RootInfo ri;
     int count=0;
@@ -3984,7 +4583,7 @@ int Octree< Degree >::SetMCRootPositions( TreeOctNode* node , int sDepth , Real
             long long key = ri.key;
             if( !rootData.interiorRoots || IsBoundaryEdge( node , i , j , k , sDepth ) )
             {
-                hash_map< long long , int >::iterator iter , end;
+                hash_map< long long , node_index_type >::iterator iter , end;
                 // Check if the root has already been set
 #ifdef USE_OPENMP                 
 #pragma omp critical (boundary_roots_hash_access)
@@ -3996,7 +4595,7 @@ int Octree< Degree >::SetMCRootPositions( TreeOctNode* node , int sDepth , Real
                 if( iter==end )
                 {
                     // Get the root information
-                    GetRoot( ri , isoValue , neighborKey5 , position , rootData , sDepth , metSolution , nonLinearFit );
+                    GetRoot( ri , isoValue , neighborKey5 , position , rootData , sDepth , metSolution , nonLinearFit , normalPtr );
                     position = position * _scale + _center;
                     // Add the root if it hasn't been added already
 #ifdef USE_OPENMP                     
@@ -4008,7 +4607,8 @@ int Octree< Degree >::SetMCRootPositions( TreeOctNode* node , int sDepth , Real
                         if( iter==end )
                         {
                             mesh->inCorePoints.push_back( position );
-                            rootData.boundaryRoots[key] = int( mesh->inCorePoints.size() ) - 1;
+                            if( normalPtr ) mesh->inCoreNormals.push_back( normal );
+                            rootData.boundaryRoots[key] = node_index_type( mesh->inCorePoints.size() )-1;
                         }
                     }
                     if( iter==end ) count++;
@@ -4016,11 +4616,11 @@ int Octree< Degree >::SetMCRootPositions( TreeOctNode* node , int sDepth , Real
             }
             else
             {
-                int nodeEdgeIndex = rootData.edgeIndices( ri.node )[ ri.edgeIndex ];
+                node_index_type nodeEdgeIndex = rootData.edgeIndices( ri.node )[ ri.edgeIndex ];
                 if( !rootData.edgesSet[ nodeEdgeIndex ] )
                 {
                     // Get the root information
-                    GetRoot( ri , isoValue , neighborKey5 , position , rootData , sDepth , metSolution , nonLinearFit );
+                    GetRoot( ri , isoValue , neighborKey5 , position , rootData , sDepth , metSolution , nonLinearFit , normalPtr );
                     position = position * _scale + _center;
                     // Add the root if it hasn't been added already
 #ifdef USE_OPENMP                     
@@ -4029,7 +4629,7 @@ int Octree< Degree >::SetMCRootPositions( TreeOctNode* node , int sDepth , Real
                     {
                         if( !rootData.edgesSet[ nodeEdgeIndex ] )
                         {
-                            rootData.interiorRoots[ nodeEdgeIndex ] = mesh->addOutOfCorePoint( position );
+                            rootData.interiorRoots[ nodeEdgeIndex ] = mesh->addOutOfCorePoint( position , normal );
                             interiorPositions->push_back( position );
                             rootData.edgesSet[ nodeEdgeIndex ] = 1;
                             count++;
@@ -4071,7 +4671,7 @@ int Octree< Degree >::SetBoundaryMCRootPositions( int sDepth , Real isoValue , R
                                     GetRoot( ri , isoValue , position , rootData , sDepth , nonLinearFit );
                                     position = position * _scale + _center;
                                     mesh->inCorePoints.push_back( position );
-                                    rootData.boundaryRoots[key] = int( mesh->inCorePoints.size() )-1;
+                                    rootData.boundaryRoots[key] = node_index_type( mesh->inCorePoints.size() )-1;
                                     count++;
                                 }
                             }
@@ -4193,7 +4793,7 @@ void Octree< Degree >::GetMCIsoEdges( TreeOctNode* node , int sDepth , std::vect
     }
 }
 template<int Degree>
-int Octree< Degree >::GetMCIsoTriangles( TreeOctNode* node , CoredMeshData* mesh , RootData& rootData , std::vector< Point3D< Real > >* interiorPositions , int offSet , int sDepth , bool polygonMesh , std::vector< Point3D< Real > >* barycenters )
+int Octree< Degree >::GetMCIsoTriangles( TreeOctNode* node , CoredMeshData* mesh , RootData& rootData , std::vector< Point3D< Real > >* interiorPositions , node_index_type offSet , int sDepth , bool polygonMesh , std::vector< Point3D< Real > >* barycenters )
 {
     int tris=0;
     std::vector< std::pair< RootInfo , RootInfo > > edges;
@@ -4263,7 +4863,7 @@ int Octree< Degree >::GetEdgeLoops( std::vector< std::pair< RootInfo , RootInfo
     return int(loops.size());
 }
 template<int Degree>
-int Octree<Degree>::AddTriangles( CoredMeshData* mesh , std::vector<CoredPointIndex>& edges , std::vector< Point3D< Real > >* interiorPositions , int offSet , bool polygonMesh , std::vector< Point3D< Real > >* barycenters )
+int Octree<Degree>::AddTriangles( CoredMeshData* mesh , std::vector<CoredPointIndex>& edges , std::vector< Point3D< Real > >* interiorPositions , node_index_type offSet , bool polygonMesh , std::vector< Point3D< Real > >* barycenters )
 {
     MinimalAreaTriangulation< Real > MAT;
     std::vector< Point3D< Real > > vertices;
@@ -4312,7 +4912,7 @@ int Octree<Degree>::AddTriangles( CoredMeshData* mesh , std::vector<CoredPointIn
                 c += p;
             }
             c /= Real( edges.size() );
-            int cIdx;
+            node_index_type cIdx;
 #ifdef USE_OPENMP             
 #pragma omp critical (add_point_access)
 #endif
@@ -4391,9 +4991,13 @@ Pointer( Real ) Octree< Degree >::GetSolutionGrid( int& res , Real isoValue , in
     fData.set( _boundaryType==0 ? depth+1 : depth , true , _boundaryType );
     res = 1<<depth;
     fData.setValueTables( fData.VALUE_FLAG );
-    Pointer( Real ) values = NewPointer< Real >( res * res * res );
-    memset( values , 0 , sizeof( Real ) * res  * res * res );
+    Pointer( Real ) values = NewPointer< Real >( size_t(res) * res * res );
+    // Samples of the grid are the odd indices of the value tables, shifted by res/2 for the free boundary
+    const int shift = _boundaryType==0 ? res/2 : 0;
 
+    // Collect the function index and the grid span (inclusive) of every contributing node
+    std::vector< const TreeOctNode* > nodes;
+    std::vector< int > spans;
     for( TreeOctNode* n=tree.nextNode() ; n ; n=tree.nextNode( n ) )
     {
         if( n->d>(_boundaryType==0?depth+1:depth) ) continue;
@@ -4417,28 +5021,171 @@ Pointer( Real ) Octree< Degree >::GetSolutionGrid( int& res , Real isoValue , in
                 start[i] = std::max< int >( start[i] ,   res+1 );
                 end  [i] = std::min< int >( end  [i] , 3*res-1 );
             }
+            start[i] = ( (start[i]-1)>>1 ) - shift , end[i] = ( (end[i]-1)>>1 ) - shift;
+            if( start[i]>end[i] ) skip = true;
         }
         if( skip ) continue;
-        Real coefficient = n->nodeData.solution;
-        for( int x=start[0] ; x<=end[0] ; x+=2 )
-            for( int y=start[1] ; y<=end[1] ; y+=2 )
-                for( int z=start[2] ; z<=end[2] ; z+=2 )
+        nodes.push_back( n );
+        for( int i=0 ; i<3 ; i++ ) spans.push_back( idx[i] ) , spans.push_back( start[i] ) , spans.push_back( end[i] );
+    }
+
+    // Fill the grid in slabs of z-slices. Every sample is written by one thread only and receives
+    // the node contributions in the same order, whatever the number of threads.
+    const int slabSize = 4;
+    const int slabs = ( res + slabSize - 1 ) / slabSize;
+    std::vector< std::vector< int > > slabNodes( slabs );
+    for( int i=0 ; i<int( nodes.size() ) ; i++ )
+        for( int s=spans[9*i+7]/slabSize ; s<=spans[9*i+8]/slabSize ; s++ ) slabNodes[s].push_back( i );
+
+    const int fCount = fData.functionCount;
+    const Real* valueTable = fData.valueTables;
+    std::vector< std::vector< Real > > xValues( threads );
+#ifdef USE_OPENMP
+#pragma omp parallel for num_threads( threads ) schedule( dynamic , 1 )
+#endif
+    for( int s=0 ; s<slabs ; s++ )
+    {
+        int thread = 0;
+#ifdef USE_OPENMP
+        thread = omp_get_thread_num();
+#endif
+        std::vector< Real >& xValue = xValues[thread];
+        const int zStart = s*slabSize , zEnd = std::min< int >( zStart+slabSize , res )-1;
+        memset( values + size_t(zStart)*res*res , 0 , sizeof( Real ) * size_t(zEnd-zStart+1)*res*res );
+        for( size_t j=0 ; j<slabNodes[s].size() ; j++ )
+        {
+            const int* span = &spans[ 9*slabNodes[s][j] ];
+            const Real coefficient = nodes[ slabNodes[s][j] ]->nodeData.solution;
+            // Tabulate the x-factors once, so that the inner loop runs over contiguous samples
+            const int xStart = span[1] , xCount = span[2]-span[1]+1;
+            xValue.resize( xCount );
+            for( int x=0 ; x<xCount ; x++ ) xValue[x] = valueTable[ span[0] + ( 2*( xStart+x+shift )+1 )*fCount ];
+            for( int zz=std::max< int >( span[7] , zStart ) ; zz<=std::min< int >( span[8] , zEnd ) ; zz++ )
+            {
+                const Real zValue = coefficient * valueTable[ span[6] + ( 2*( zz+shift )+1 )*fCount ];
+                for( int yy=span[4] ; yy<=span[5] ; yy++ )
                 {
-                    int xx = (x-1)>>1 , yy=(y-1)>>1 , zz = (z-1)>>1;
-                    if( _boundaryType==0 ) xx -= res/2 , yy -= res/2 , zz -= res/2;
-                    values[ zz*res*res + yy*res + xx ] +=
-                            coefficient *
-                            fData.valueTables[ idx[0]+x*fData.functionCount ] *
-                            fData.valueTables[ idx[1]+y*fData.functionCount ] *
-                            fData.valueTables[ idx[2]+z*fData.functionCount ];
+                    const Real yzValue = zValue * valueTable[ span[3] + ( 2*( yy+shift )+1 )*fCount ];
+                    Real* row = values + ( size_t(zz)*res + yy )*res + xStart;
+                    for( int x=0 ; x<xCount ; x++ ) row[x] += yzValue * xValue[x];
                 }
+            }
+        }
     }
-    if( _boundaryType==-1 ) for( int i=0 ; i<res*res*res ; i++ ) values[i] -= Real(0.5);
-    for( int i=0 ; i<res*res*res ; i++ ) values[i] -= isoValue;
+
+    Real offset = isoValue;
+    if( _boundaryType==-1 ) offset += Real(0.5);
+#ifdef USE_OPENMP
+#pragma omp parallel for num_threads( threads )
+#endif
+    // A signed 64-bit index, as OpenMP requires, since res^3 overflows an int from depth 11 on
+    for( long long i=0 ; i<(long long)res*res*res ; i++ ) values[i] -= offset;
 
     return values;
 }
 
+template< int Degree >
+void Octree< Degree >::GetSolutionGridFrame( int res , Point3D< Real >& origin , Real& spacing ) const
+{
+    // Sample i of the grid lies at offset + i*step in the unit cube
+    Real step , offset;
+    if( _boundaryType==0 ) step = Real(1.) / (2*res) , offset = ( res/2 + Real(0.5) ) * step;
+    else                   step = Real(1.) /    res  , offset =            Real(0.5)   * step;
+    for( int d=0 ; d<3 ; d++ ) origin[d] = offset * _scale + _center[d];
+    spacing = step * _scale;
+}
+
+template< int Degree >
+int Octree< Degree >::GetSolutionGridIsoTriangles( int depth , CoredMeshData* mesh )
+{
+    int res;
+    Pointer( Real ) values = GetSolutionGrid( res , Real(0) , depth );
+    if( res<2 ){ DeletePointer( values ) ; return 0; }
+    int treeDepth = _boundaryType==0 ? std::min< int >( depth , tree.maxDepth()-1 )+1 : std::min< int >( depth , tree.maxDepth() );
+
+    // Sample i of the grid lies at origin + i*spacing in the coordinates of the input points
+    Point3D< Real > origin;
+    Real spacing;
+    GetSolutionGridFrame( res , origin , spacing );
+    const size_t slice = size_t(res)*res;
+
+    // Estimate the iso-value as the average of the (trilinearly interpolated) grid values at the samples of that depth
+    double isoSum = 0;
+    int isoCount = 0;
+    for( TreeOctNode* node=tree.nextNode() ; node ; node=tree.nextNode( node ) )
+    {
+        if( node->depth()!=treeDepth || node->nodeData.normalIndex<0 ) continue;
+        Point3D< Real > p;
+        if( node->nodeData.pointIndex!=-1 ) p = _points[ node->nodeData.pointIndex ].position;
+        else
+        {
+            Real width;
+            node->centerAndWidth( p , width );
+        }
+        int i0[3];
+        Real dx[3];
+        for( int d=0 ; d<3 ; d++ )
+        {
+            Real g = std::max< Real >( Real(0) , std::min< Real >( Real(res-1) , ( p[d]*_scale+_center[d]-origin[d] ) / spacing ) );
+            i0[d] = std::min< int >( int(g) , res-2 );
+            dx[d] = g - i0[d];
+        }
+        double value = 0;
+        for( unsigned int c=0 ; c<Cube::CORNERS ; c++ )
+        {
+            int x , y , z;
+            Cube::FactorCornerIndex( c , x , y , z );
+            value += values[ (i0[2]+z)*slice + size_t(i0[1]+y)*res + i0[0]+x ] * ( x ? dx[0] : 1-dx[0] ) * ( y ? dx[1] : 1-dx[1] ) * ( z ? dx[2] : 1-dx[2] );
+        }
+        isoSum += value , isoCount++;
+    }
+    Real isoValue = isoCount ? Real( isoSum / isoCount ) : Real(0);
+
+    // Marching cubes over the grid cells, sharing the roots of edges between cells
+    hash_map< long long , int > roots;
+    std::vector< CoredVertexIndex > polygon( 3 );
+    int triangleCount = 0;
+    for( int z=0 ; z<res-1 ; z++ ) for( int y=0 ; y<res-1 ; y++ ) for( int x=0 ; x<res-1 ; x++ )
+    {
+        Real v[Cube::CORNERS];
+        for( unsigned int c=0 ; c<Cube::CORNERS ; c++ )
+        {
+            int cx , cy , cz;
+            Cube::FactorCornerIndex( c , cx , cy , cz );
+            v[c] = values[ (z+cz)*slice + size_t(y+cy)*res + x+cx ];
+        }
+        int mcIndex = MarchingCubes::GetIndex( v , isoValue );
+        if( !MarchingCubes::edgeMask[mcIndex] ) continue;
+        for( int t=0 ; MarchingCubes::triangles[mcIndex][t]!=-1 ; t+=3 )
+        {
+            for( int j=0 ; j<3 ; j++ )
+            {
+                int e = MarchingCubes::triangles[mcIndex][t+j] , o , i1 , i2 , c1 , c2 , cx , cy , cz;
+                Cube::FactorEdgeIndex( e , o , i1 , i2 );
+                Cube::EdgeCorners( e , c1 , c2 );
+                Cube::FactorCornerIndex( c1 , cx , cy , cz );
+                int start[3] = { x+cx , y+cy , z+cz };
+                long long key = ( (long long)( start[2]*slice ) + (long long)( start[1] )*res + start[0] ) * 3 + o;
+                hash_map< long long , int >::iterator iter = roots.find( key );
+                if( iter==roots.end() )
+                {
+                    Real t0 = MarchingCubes::Interpolate( v[c1]-isoValue , v[c2]-isoValue );
+                    Point3D< Real > position;
+                    for( int d=0 ; d<3 ; d++ ) position[d] = origin[d] + ( start[d] + ( d==o ? t0 : Real(0) ) ) * spacing;
+                    mesh->inCorePoints.push_back( position );
+                    iter = roots.insert( std::pair< long long , int >( key , int( mesh->inCorePoints.size() )-1 ) ).first;
+                }
+                // The table's winding is opposite to the orientation of the octree's iso-surface
+                polygon[2-j].idx = iter->second , polygon[2-j].inCore = true;
+            }
+            mesh->addPolygon( polygon );
+            triangleCount++;
+        }
+    }
+    DeletePointer( values );
+    return triangleCount;
+}
+
 ////////////////
 // VertexData //
 ////////////////
@@ -32,6 +32,7 @@ DAMAGE.
 #include "Allocator.h"
 #include "BinaryNode.h"
 #include "MarchingCubes.h"
+#include "NodeIndex.h"
 
 #define DIMENSION 3
 
@@ -39,7 +40,8 @@ template< class NodeData , class Real=float >
 class OctNode
 {
 private:
-	static int UseAlloc;
+	static POISSON_THREAD_LOCAL int UseAlloc;
+	static POISSON_THREAD_LOCAL AllocatorT<OctNode>* CurrentAllocator;
 
 	class AdjacencyCountFunction
 	{
@@ -79,6 +81,11 @@ public:
     static AllocatorT<OctNode> Allocator;
 	static int UseAllocator(void);
 	static void SetAllocator(int blockSize);
+	// Makes initChildren on the calling thread draw from the given allocator (NULL falls back to new/delete).
+	// Trees built concurrently on different threads each use their own allocator this way.
+	static void SetThreadAllocator(AllocatorT<OctNode>* allocator);
+	// The allocator initChildren on the calling thread draws from, NULL if it uses new/delete
+	static AllocatorT<OctNode>* ThreadAllocator(void);
 
 	OctNode* parent;
 	OctNode* children;
@@ -98,9 +105,9 @@ public:
 	void centerAndWidth( Point3D<Real>& center , Real& width ) const;
 	bool isInside( Point3D< Real > p ) const;
 
-	int leaves(void) const;
-	int maxDepthLeaves(int maxDepth) const;
-	int nodes(void) const;
+	node_index_type leaves(void) const;
+	node_index_type maxDepthLeaves(int maxDepth) const;
+	node_index_type nodes(void) const;
 	int maxDepth(void) const;
 
 	const OctNode* root(void) const;
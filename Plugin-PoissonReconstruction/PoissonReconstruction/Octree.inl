@@ -44,7 +44,8 @@ template<class NodeData,class Real> const int OctNode<NodeData,Real>::OffsetShif
 template<class NodeData,class Real> const int OctNode<NodeData,Real>::OffsetShift2=OffsetShift1+OffsetShift;
 template<class NodeData,class Real> const int OctNode<NodeData,Real>::OffsetShift3=OffsetShift2+OffsetShift;
 
-template<class NodeData,class Real> int OctNode<NodeData,Real>::UseAlloc=0;
+template<class NodeData,class Real> POISSON_THREAD_LOCAL int OctNode<NodeData,Real>::UseAlloc=0;
+template<class NodeData,class Real> POISSON_THREAD_LOCAL AllocatorT<OctNode<NodeData,Real> >* OctNode<NodeData,Real>::CurrentAllocator=NULL;
 template<class NodeData,class Real> AllocatorT<OctNode<NodeData,Real> > OctNode<NodeData,Real>::Allocator;
 
 template<class NodeData,class Real>
@@ -54,10 +55,19 @@ void OctNode<NodeData,Real>::SetAllocator(int blockSize)
   {
     UseAlloc=1;
     Allocator.set(blockSize);
+    CurrentAllocator=&Allocator;
   }
-  else{UseAlloc=0;}
+  else{UseAlloc=0;CurrentAllocator=NULL;}
 }
 template<class NodeData,class Real>
+void OctNode<NodeData,Real>::SetThreadAllocator(AllocatorT<OctNode>* allocator)
+{
+  CurrentAllocator=allocator;
+  UseAlloc=allocator ? 1 : 0;
+}
+template<class NodeData,class Real>
+AllocatorT<OctNode<NodeData,Real> >* OctNode<NodeData,Real>::ThreadAllocator(void){return UseAlloc ? CurrentAllocator : NULL;}
+template<class NodeData,class Real>
 int OctNode<NodeData,Real>::UseAllocator(void){return UseAlloc;}
 
 template <class NodeData,class Real>
@@ -83,7 +93,7 @@ void OctNode<NodeData,Real>::setFullDepth(int maxDepth){
 template <class NodeData,class Real>
 int OctNode<NodeData,Real>::initChildren( void )
 {
-  if( UseAlloc ) children=Allocator.newElements(8);
+  if( UseAlloc ) children=CurrentAllocator->newElements(8);
   else
   {
     if( children ) delete[] children;
@@ -181,29 +191,29 @@ int OctNode<NodeData,Real>::maxDepth(void) const{
   }
 }
 template <class NodeData,class Real>
-int OctNode<NodeData,Real>::nodes(void) const{
+node_index_type OctNode<NodeData,Real>::nodes(void) const{
   if(!children){return 1;}
   else{
-    int c=0;
+    node_index_type c=0;
     for(unsigned int i=0;i<Cube::CORNERS;i++){c+=children[i].nodes();}
     return c+1;
   }
 }
 template <class NodeData,class Real>
-int OctNode<NodeData,Real>::leaves(void) const{
+node_index_type OctNode<NodeData,Real>::leaves(void) const{
   if(!children){return 1;}
   else{
-    int c=0;
+    node_index_type c=0;
     for(unsigned int i=0;i<Cube::CORNERS;i++){c+=children[i].leaves();}
     return c;
   }
 }
 template<class NodeData,class Real>
-int OctNode<NodeData,Real>::maxDepthLeaves(int maxDepth) const{
+node_index_type OctNode<NodeData,Real>::maxDepthLeaves(int maxDepth) const{
   if(depth()>maxDepth){return 0;}
   if(!children){return 1;}
   else{
-    int c=0;
+    node_index_type c=0;
     for(unsigned int i=0;i<Cube::CORNERS;i++){c+=children[i].maxDepthLeaves(maxDepth);}
     return c;
   }
@@ -31,14 +31,15 @@ DAMAGE.
 
 #include "Vector.h"
 #include "Array.h"
+#include "NodeIndex.h"
 
 template <class T>
 struct MatrixEntry
 {
 	MatrixEntry( void )		    { N =-1; Value = 0; }
-	MatrixEntry( int i )	    { N = i; Value = 0; }
-	MatrixEntry( int i , T v )	{ N = i; Value = v; }
-	int N;
+	MatrixEntry( node_index_type i )	    { N = i; Value = 0; }
+	MatrixEntry( node_index_type i , T v )	{ N = i; Value = v; }
+	node_index_type N;
 	T Value;
 };
 
@@ -48,19 +49,19 @@ private:
 	bool _contiguous;
 	int _maxEntriesPerRow;
 public:
-	int rows;
+	node_index_type rows;
 	Pointer( int ) rowSizes;
 	Pointer( Pointer( MatrixEntry< T > ) ) m_ppElements;
-	Pointer( MatrixEntry< T > ) operator[] ( int idx ) { return m_ppElements[idx]; }
-	ConstPointer( MatrixEntry< T > ) operator[] ( int idx ) const { return m_ppElements[idx]; }
+	Pointer( MatrixEntry< T > ) operator[] ( node_index_type idx ) { return m_ppElements[idx]; }
+	ConstPointer( MatrixEntry< T > ) operator[] ( node_index_type idx ) const { return m_ppElements[idx]; }
 
 	SparseMatrix( void );
-	SparseMatrix( int rows );
-	SparseMatrix( int rows , int maxEntriesPerRow );
-	void Resize( int rows );
-	void Resize( int rows , int maxEntriesPerRow );
-	void SetRowSize( int row , int count );
-	int Entries( void ) const;
+	SparseMatrix( node_index_type rows );
+	SparseMatrix( node_index_type rows , int maxEntriesPerRow );
+	void Resize( node_index_type rows );
+	void Resize( node_index_type rows , int maxEntriesPerRow );
+	void SetRowSize( node_index_type row , int count );
+	node_index_type Entries( void ) const;
 
 	SparseMatrix( const SparseMatrix& M );
 	~SparseMatrix();
@@ -104,10 +105,14 @@ template< class T2 >
 struct MapReduceVector
 {
 private:
-	int _dim;
+	node_index_type _dim;
+	int _threads;
 public:
+	// One scratch buffer per block. The rows of a product (and the terms of a dot-product) are split into
+	// blocks()-many contiguous ranges whose partial results are always combined in block order, so a fixed
+	// block count gives results that do not depend on the number of threads doing the work.
 	std::vector< T2* > out;
-	MapReduceVector( void ) { _dim = 0; }
+	MapReduceVector( void ) { _dim = _threads = 0; }
 	~MapReduceVector( void )
 	{
 		if( _dim ) for( int t=0 ; t<int(out.size()) ; t++ ) delete[] out[t];
@@ -115,20 +120,52 @@ public:
 	}
 	T2* operator[]( int t ) { return out[t]; }
 	const T2* operator[]( int t ) const { return out[t]; }
-	int threads( void ) const { return int(out.size()) ; }
-	void resize( size_t threads , int dim )
+	int threads( void ) const { return _threads; }
+	int blocks( void ) const { return int(out.size()) ; }
+	// If blocks is zero, one block per thread is used
+	void resize( size_t threads , node_index_type dim , size_t blocks=0 )
 	{
-		if( threads!=out.size() || _dim<dim )
+		if( !blocks ) blocks = threads;
+		_threads = int( threads );
+		if( blocks!=out.size() || _dim<dim )
 		{
 			for( int t=0 ; t<int(out.size()) ; t++ ) delete[] out[t];
-			out.resize( threads );
+			out.resize( blocks );
 			for( int t=0 ; t<int(out.size()) ; t++ ) out[t] = new T2[dim];
 			_dim = dim;
+			// Every block is summed into the product with a static partition of the rows, so touch each
+			// buffer in that partition first to place its pages with the threads that will read them
+			int _blocks = int( out.size() );
+#ifdef USE_OPENMP
+#pragma omp parallel for num_threads( _threads ) schedule( static )
+#endif
+			for( int t=0 ; t<_threads ; t++ )
+			{
+				node_index_type start = (dim*t)/_threads , end = (dim*(t+1))/_threads;
+				for( int b=0 ; b<_blocks ; b++ ) memset( out[b]+start , 0 , sizeof( T2 ) * ( end-start ) );
+			}
 		}
 	}
 
 };
 
+// Optional convergence control of SparseSymmetricMatrix::Solve, which also reports the residual history in it
+struct SolverControl
+{
+	// Stop once the residual norm has dropped by less than the factor stagnationReduction over the last
+	// stagnationWindow iterations (a window of zero disables the test)
+	double stagnationReduction;
+	int stagnationWindow;
+	// Iterations that may follow the nominal ones, as long as the residual has neither reached the tolerance nor stagnated
+	int extraIters;
+	// The solve is skipped if the initial residual norm is below this value, a negative value uses the tolerance eps
+	double minResidual;
+	// Set by the solver: the residual norms relative to the one of the initial guess (of a zero guess when warm
+	// starting), before the first and after every iteration
+	std::vector< double > residuals;
+	SolverControl( void ) { stagnationReduction = 0 , stagnationWindow = 0 , extraIters = 0 , minResidual = -1; }
+};
+
 template< class T >
 class SparseSymmetricMatrix : public SparseMatrix< T >
 {
@@ -147,13 +184,14 @@ public:
 	void Multiply( const PoissonVector<T2>& In, PoissonVector<T2>& Out , MapReduceVector< T2 >& OutScratch , bool addDCTerm=false ) const;
 
 	template< class T2 >
-	void Multiply( const PoissonVector<T2>& In, PoissonVector<T2>& Out , std::vector< T2* >& OutScratch , const std::vector< int >& bounds ) const;
+	void Multiply( const PoissonVector<T2>& In, PoissonVector<T2>& Out , std::vector< T2* >& OutScratch , const std::vector< node_index_type >& bounds ) const;
 
 	template< class T2 >
 	static int Solve( const SparseSymmetricMatrix<T>& M , const PoissonVector<T2>& b , int iters , PoissonVector<T2>& solution , T2 eps=1e-8 , int reset=1 , int threads=0  , bool addDCTerm=false , bool solveNormal=false );
 
+	// If warmStart is set, solution holds an initial guess and eps is measured against the residual of a zero guess
 	template< class T2 >
-	static int Solve( const SparseSymmetricMatrix<T>& M , const PoissonVector<T2>& b , int iters , PoissonVector<T2>& solution , MapReduceVector<T2>& scratch , T2 eps=1e-8 , int reset=1 , bool addDCTerm=false , bool solveNormal=false );
+	static int Solve( const SparseSymmetricMatrix<T>& M , const PoissonVector<T2>& b , int iters , PoissonVector<T2>& solution , MapReduceVector<T2>& scratch , T2 eps=1e-8 , int reset=1 , bool addDCTerm=false , bool solveNormal=false , bool warmStart=false , SolverControl* control=NULL );
 #ifdef WIN32
 	template< class T2 >
 	static int SolveAtomic( const SparseSymmetricMatrix<T>& M , const PoissonVector<T2>& b , int iters , PoissonVector<T2>& solution , T2 eps=1e-8 , int reset=1 , int threads=0  , bool solveNormal=false );
@@ -50,7 +50,7 @@ SparseMatrix< T >::SparseMatrix( void )
 	m_ppElements = NullPointer< Pointer( MatrixEntry< T > ) >( );
 }
 
-template< class T > SparseMatrix< T >::SparseMatrix( int rows                        ) { 
+template< class T > SparseMatrix< T >::SparseMatrix( node_index_type rows                      ) { 
   _contiguous = false;
   _maxEntriesPerRow = 0;
   rows = 0;
@@ -59,7 +59,7 @@ template< class T > SparseMatrix< T >::SparseMatrix( int rows
   Resize( rows ); 
 }
 
-template< class T > SparseMatrix< T >::SparseMatrix( int rows , int maxEntriesPerRow ) { 
+template< class T > SparseMatrix< T >::SparseMatrix( node_index_type rows , int maxEntriesPerRow ) { 
   _contiguous = false;
   _maxEntriesPerRow = 0;
   rows = 0;
@@ -83,7 +83,7 @@ SparseMatrix< T >::SparseMatrix( const SparseMatrix& M )
   
 	if( M._contiguous ) Resize( M.rows , M._maxEntriesPerRow );
 	else                Resize( M.rows );
-	for( int i=0 ; i<rows ; i++ )
+	for( node_index_type i=0 ; i<rows ; i++ )
 	{
 		SetRowSize( i , M.rowSizes[i] );
 		memcpy( (*this)[i] , M[i] , sizeof( MatrixEntry< T > ) * rowSizes[i] );
@@ -91,10 +91,10 @@ SparseMatrix< T >::SparseMatrix( const SparseMatrix& M )
 }
 
 template<class T>
-int SparseMatrix<T>::Entries( void ) const
+node_index_type SparseMatrix<T>::Entries( void ) const
 {
-	int e = 0;
-	for( int i=0 ; i<rows ; i++ ) e += int( rowSizes[i] );
+	node_index_type e = 0;
+	for( node_index_type i=0 ; i<rows ; i++ ) e += int( rowSizes[i] );
 	return e;
 }
 template<class T>
@@ -102,7 +102,7 @@ SparseMatrix<T>& SparseMatrix<T>::operator = (const SparseMatrix<T>& M)
 {
 	if( M._contiguous ) Resize( M.rows , M._maxEntriesPerRow );
 	else                Resize( M.rows );
-	for( int i=0 ; i<rows ; i++ )
+	for( node_index_type i=0 ; i<rows ; i++ )
 	{
 		SetRowSize( i , M.rowSizes[i] );
 		memcpy( (*this)[i] , M[i] , sizeof( MatrixEntry< T > ) * rowSizes[i] );
@@ -134,23 +134,23 @@ bool SparseMatrix< T >::read( const char* fileName )
 template< class T >
 bool SparseMatrix< T >::write( FILE* fp ) const
 {
-	if( fwrite( &rows , sizeof( int ) , 1 , fp )!=1 ) return false;
+	if( fwrite( &rows , sizeof( node_index_type ) , 1 , fp )!=1 ) return false;
 	if( fwrite( rowSizes , sizeof( int ) , rows , fp )!=rows ) return false;
-	for( int i=0 ; i<rows ; i++ ) if( fwrite( (*this)[i] , sizeof( MatrixEntry< T > ) , rowSizes[i] , fp )!=rowSizes[i] ) return false;
+	for( node_index_type i=0 ; i<rows ; i++ ) if( fwrite( (*this)[i] , sizeof( MatrixEntry< T > ) , rowSizes[i] , fp )!=rowSizes[i] ) return false;
 	return true;
 }
 template< class T >
 bool SparseMatrix< T >::read( FILE* fp )
 {
-	int r;
-	if( fread( &r , sizeof( int ) , 1 , fp )!=1 ) return false;
+	node_index_type r;
+	if( fread( &r , sizeof( node_index_type ) , 1 , fp )!=1 ) return false;
 	Resize( r );
 	if( fread( rowSizes , sizeof( int ) , rows , fp )!=rows ) return false;
-	for( int i=0 ; i<rows ; i++ )
+	for( node_index_type i=0 ; i<rows ; i++ )
 	{
-		r = rowSizes[i];
+		int size = rowSizes[i];
 		rowSizes[i] = 0;
-		SetRowSize( i , r );
+		SetRowSize( i , size );
 		if( fread( (*this)[i] , sizeof( MatrixEntry< T > ) , rowSizes[i] , fp )!=rowSizes[i] ) return false;
 	}
 	return true;
@@ -158,12 +158,12 @@ bool SparseMatrix< T >::read( FILE* fp )
 
 
 template< class T >
-void SparseMatrix< T >::Resize( int r )
+void SparseMatrix< T >::Resize( node_index_type r )
 {
 	if( rows>0 )
 	{
 		if( _contiguous ){ if( _maxEntriesPerRow ) FreePointer( m_ppElements[0] ); }
-		else for( int i=0 ; i<rows ; i++ ){ if( rowSizes[i] ) FreePointer( m_ppElements[i] ); }
+		else for( node_index_type i=0 ; i<rows ; i++ ){ if( rowSizes[i] ) FreePointer( m_ppElements[i] ); }
 		FreePointer( m_ppElements );
 		FreePointer( rowSizes );
 	}
@@ -178,12 +178,12 @@ void SparseMatrix< T >::Resize( int r )
 	_maxEntriesPerRow = 0;
 }
 template< class T >
-void SparseMatrix< T >::Resize( int r , int e )
+void SparseMatrix< T >::Resize( node_index_type r , int e )
 {
 	if( rows>0 )
 	{
 		if( _contiguous ){ if( _maxEntriesPerRow ) FreePointer( m_ppElements[0] ); }
-		else for( int i=0 ; i<rows ; i++ ){ if( rowSizes[i] ) FreePointer( m_ppElements[i] ); }
+		else for( node_index_type i=0 ; i<rows ; i++ ){ if( rowSizes[i] ) FreePointer( m_ppElements[i] ); }
 		FreePointer( m_ppElements );
 		FreePointer( rowSizes );
 	}
@@ -194,14 +194,14 @@ void SparseMatrix< T >::Resize( int r , int e )
 		m_ppElements = AllocPointer< Pointer( MatrixEntry< T > ) >( r );
 		m_ppElements[0] = AllocPointer< MatrixEntry< T > >( r * e );
 		memset( rowSizes , 0 , sizeof( int ) * r );
-		for( int i=1 ; i<r ; i++ ) m_ppElements[i] = m_ppElements[i-1] + e;
+		for( node_index_type i=1 ; i<r ; i++ ) m_ppElements[i] = m_ppElements[i-1] + e;
 	}
 	_contiguous = true;
 	_maxEntriesPerRow = e;
 }
 
 template<class T>
-void SparseMatrix< T >::SetRowSize( int row , int count )
+void SparseMatrix< T >::SetRowSize( node_index_type row , int count )
 {
 	if( _contiguous )
 	{
@@ -254,7 +254,7 @@ SparseMatrix<T> SparseMatrix<T>::Multiply( const SparseMatrix<T>& M ) const
 	SparseMatrix<T> R( this->Rows(), M.Columns() );
 	for(int i=0; i<R.Rows(); i++){
 		for(int ii=0;ii<m_ppElements[i].size();ii++){
-			int N=m_ppElements[i][ii].N;
+			node_index_type N = m_ppElements[i][ii].N;
 			T Value=m_ppElements[i][ii].Value;
 			for(int jj=0;jj<M.m_ppElements[N].size();jj++){
 				R(i,M.m_ppElements[N][jj].N) += Value * M.m_ppElements[N][jj].Value;
@@ -288,7 +288,7 @@ void SparseMatrix<T>::Multiply( const PoissonVector<T2>& In , PoissonVector<T2>&
 #ifdef USE_OPENMP 
 #pragma omp parallel for num_threads( threads ) schedule( static )
 #endif
-	for( int i=0 ; i<rows ; i++ )
+	for( node_index_type i=0 ; i<rows ; i++ )
 	{
 		T2 temp = T2();
 		temp *= 0;
@@ -421,10 +421,10 @@ PoissonVector<T2> SparseSymmetricMatrix<T>::Multiply( const PoissonVector<T2>& V
 {
 	PoissonVector<T2> R( SparseMatrix< T >::rows );
 
-	for(int i=0; i<SparseMatrix< T >::rows; i++){
+	for(node_index_type i=0; i<SparseMatrix< T >::rows; i++){
 		for(int ii=0;ii<SparseMatrix< T >::rowSizes[i];ii++)
 		{
-			int j=SparseMatrix< T >::m_ppElements[i][ii].N;
+			node_index_type j = SparseMatrix< T >::m_ppElements[i][ii].N;
 			R(i)+=SparseMatrix< T >::m_ppElements[i][ii].Value * V.m_pV[j];
 			R(j)+=SparseMatrix< T >::m_ppElements[i][ii].Value * V.m_pV[i];
 		}
@@ -442,10 +442,10 @@ void SparseSymmetricMatrix<T>::Multiply( const PoissonVector<T2>& In , PoissonVe
 	T2 dcTerm = T2( 0 );
 	if( addDCTerm )
 	{
-		for( int i=0 ; i<SparseMatrix< T >::rows ; i++ ) dcTerm += in[i];
+		for( node_index_type i=0 ; i<SparseMatrix< T >::rows ; i++ ) dcTerm += in[i];
 		dcTerm /= SparseMatrix< T >::rows;
 	}
-	for( int i=0 ; i<SparseMatrix< T >::rows ; i++ )
+	for( node_index_type i=0 ; i<SparseMatrix< T >::rows ; i++ )
 	{
 		const MatrixEntry<T>* temp = SparseMatrix< T >::m_ppElements[i];
 		const MatrixEntry<T>* end = temp + SparseMatrix< T >::rowSizes[i];
@@ -453,118 +453,123 @@ void SparseSymmetricMatrix<T>::Multiply( const PoissonVector<T2>& In , PoissonVe
 		T2 out_i = T2(0);
 		for( ; temp!=end ; temp++ )
 		{
-			int j=temp->N;
+			node_index_type j = temp->N;
 			T2 v=temp->Value;
 			out_i += v * in[j];
 			out[j] += v * in_i_;
 		}
 		out[i] += out_i;
 	}
-	if( addDCTerm ) for( int i=0 ; i<SparseMatrix< T >::rows ; i++ ) out[i] += dcTerm;
+	if( addDCTerm ) for( node_index_type i=0 ; i<SparseMatrix< T >::rows ; i++ ) out[i] += dcTerm;
 }
 template<class T>
 template<class T2>
 void SparseSymmetricMatrix<T>::Multiply( const PoissonVector<T2>& In , PoissonVector<T2>& Out , MapReduceVector< T2 >& OutScratch , bool addDCTerm ) const
 {
-	int dim = int( In.Dimensions() );
+	node_index_type dim = node_index_type( In.Dimensions() );
 	const T2* in = &In[0];
-	int threads = OutScratch.threads();
+	int threads = OutScratch.threads() , blocks = OutScratch.blocks();
 	if( addDCTerm )
 	{
-		T2 dcTerm = 0;
+		std::vector< double > dcTerms( blocks , 0 );
 #ifdef USE_OPENMP 		
-#pragma omp parallel for num_threads( threads ) reduction ( + : dcTerm )
+#pragma omp parallel for num_threads( threads ) schedule( dynamic , 1 )
 #endif
-		for( int t=0 ; t<threads ; t++ ) 
+		for( int t=0 ; t<blocks ; t++ ) 
 		{
+			double dcTerm = 0;
 			T2* out = OutScratch[t];
 			memset( out , 0 , sizeof( T2 ) * dim );
-			for( int i=(SparseMatrix< T >::rows*t)/threads ; i<(SparseMatrix< T >::rows*(t+1))/threads ; i++ )
+			for( node_index_type i=(SparseMatrix< T >::rows*t)/blocks ; i<(SparseMatrix< T >::rows*(t+1))/blocks ; i++ )
 			{
 				const T2& in_i_ = in[i];
-				T2& out_i_ = out[i];
+				double out_i_ = 0;
 				ConstPointer( MatrixEntry< T > ) temp;
 				ConstPointer( MatrixEntry< T > ) end;
 				for( temp = SparseMatrix< T >::m_ppElements[i] , end = temp+SparseMatrix< T >::rowSizes[i] ; temp!=end ; temp++ )
 				{
-					int j = temp->N;
+					node_index_type j = temp->N;
 					T2 v = temp->Value;
-					out_i_ += v * in[j];
+					out_i_ += double( v ) * in[j];
 					out[j] += v * in_i_;
 				}
+				out[i] += T2( out_i_ );
 				dcTerm += in_i_;
 			}
+			dcTerms[t] = dcTerm;
 		}
+		double dcTerm = 0;
+		for( int t=0 ; t<blocks ; t++ ) dcTerm += dcTerms[t];
 		dcTerm /= dim;
-		dim = int( Out.Dimensions() );
+		dim = node_index_type( Out.Dimensions() );
 		T2* out = &Out[0];
 #ifdef USE_OPENMP 		
 #pragma omp parallel for num_threads( threads ) schedule( static )
 #endif
-		for( int i=0 ; i<dim ; i++ )
+		for( node_index_type i=0 ; i<dim ; i++ )
 		{
-			T2 _out = dcTerm;
-			for( int t=0 ; t<threads ; t++ ) _out += OutScratch[t][i];
+			T2 _out = T2( dcTerm );
+			for( int t=0 ; t<blocks ; t++ ) _out += OutScratch[t][i];
 			out[i] = _out;
 		}
 	}
 	else
 	{
 #ifdef USE_OPENMP 
-#pragma omp parallel for num_threads( threads )
+#pragma omp parallel for num_threads( threads ) schedule( dynamic , 1 )
 #endif
-		for( int t=0 ; t<threads ; t++ ) 
+		for( int t=0 ; t<blocks ; t++ ) 
 		{
 			T2* out = OutScratch[t];
 			memset( out , 0 , sizeof( T2 ) * dim );
-			for( int i=(SparseMatrix< T >::rows*t)/threads ; i<(SparseMatrix< T >::rows*(t+1))/threads ; i++ )
+			for( node_index_type i=(SparseMatrix< T >::rows*t)/blocks ; i<(SparseMatrix< T >::rows*(t+1))/blocks ; i++ )
 			{
 				T2 in_i_ = in[i];
-				T2 out_i_ = T2();
+				double out_i_ = 0;
 				ConstPointer( MatrixEntry< T > ) temp;
 				ConstPointer( MatrixEntry< T > ) end;
 				for( temp = SparseMatrix< T >::m_ppElements[i] , end = temp+SparseMatrix< T >::rowSizes[i] ; temp!=end ; temp++ )
 				{
-					int j = temp->N;
+					node_index_type j = temp->N;
 					T2 v = temp->Value;
-					out_i_ += v * in[j];
+					out_i_ += double( v ) * in[j];
 					out[j] += v * in_i_;
 				}
-				out[i] += out_i_;
+				out[i] += T2( out_i_ );
 			}
 		}
-		dim = int( Out.Dimensions() );
+		dim = node_index_type( Out.Dimensions() );
 		T2* out = &Out[0];
 #ifdef USE_OPENMP 		
 #pragma omp parallel for num_threads( threads ) schedule( static )
 #endif
-		for( int i=0 ; i<dim ; i++ )
+		for( node_index_type i=0 ; i<dim ; i++ )
 		{
 			T2 _out = T2(0);
-			for( int t=0 ; t<threads ; t++ ) _out += OutScratch[t][i];
+			for( int t=0 ; t<blocks ; t++ ) _out += OutScratch[t][i];
 			out[i] = _out;
 		}
 	}
 }
 template<class T>
 template<class T2>
-void SparseSymmetricMatrix<T>::Multiply( const PoissonVector<T2>& In , PoissonVector<T2>& Out , std::vector< T2* >& OutScratch , const std::vector< int >& bounds ) const
+void SparseSymmetricMatrix<T>::Multiply( const PoissonVector<T2>& In , PoissonVector<T2>& Out , std::vector< T2* >& OutScratch , const std::vector< node_index_type >& bounds ) const
 {
-	int dim = In.Dimensions();
+	node_index_type dim = node_index_type( In.Dimensions() );
 	const T2* in = &In[0];
 	int threads = OutScratch.size();
 #ifdef USE_OPENMP 	
 #pragma omp parallel for num_threads( threads )
 #endif
 	for( int t=0 ; t<threads ; t++ )
-		for( int i=0 ; i<dim ; i++ ) OutScratch[t][i] = T2(0);
+		for( node_index_type i=0 ; i<dim ; i++ ) OutScratch[t][i] = T2(0);
 #ifdef USE_OPENMP 		
 #pragma omp parallel for num_threads( threads )
 #endif
 	for( int t=0 ; t<threads ; t++ ) 
 	{
 		T2* out = OutScratch[t];
-		for( int i=bounds[t] ; i<bounds[t+1] ; i++ )
+		for( node_index_type i=bounds[t] ; i<bounds[t+1] ; i++ )
 		{
 			const MatrixEntry<T>* temp = SparseMatrix< T >::m_ppElements[i];
 			const MatrixEntry<T>* end = temp + SparseMatrix< T >::rowSizes[i];
@@ -572,7 +577,7 @@ void SparseSymmetricMatrix<T>::Multiply( const PoissonVector<T2>& In , PoissonVe
 			T2& out_i_ = out[i];
 			for(  ; temp!=end ; temp++ )
 			{
-				int j = temp->N;
+				node_index_type j = temp->N;
 				T2 v = temp->Value;
 				out_i_ += v * in[j];
 				out[j] += v * in_i_;
@@ -623,7 +628,7 @@ inline void AtomicIncrement( volatile double* ptr , double addend )
 }
 #endif // _AtomicIncrement_
 template< class T >
-void MultiplyAtomic( const SparseSymmetricMatrix< T >& A , const PoissonVector< float >& In , PoissonVector< float >& Out , int threads , const int* partition=NULL )
+void MultiplyAtomic( const SparseSymmetricMatrix< T >& A , const PoissonVector< float >& In , PoissonVector< float >& Out , int threads , const node_index_type* partition=NULL )
 {
 	Out.SetZero();
 	const float* in = &In[0];
@@ -633,7 +638,7 @@ void MultiplyAtomic( const SparseSymmetricMatrix< T >& A , const PoissonVector<
 #pragma omp parallel for num_threads( threads )
 #endif
 		for( int t=0 ; t<threads ; t++ )
-			for( int i=partition[t] ; i<partition[t+1] ; i++ )
+			for( node_index_type i=partition[t] ; i<partition[t+1] ; i++ )
 			{
 				const MatrixEntry< T >* temp = A[i];
 				const MatrixEntry< T >* end = temp + A.rowSizes[i];
@@ -641,7 +646,7 @@ void MultiplyAtomic( const SparseSymmetricMatrix< T >& A , const PoissonVector<
 				float out_i = 0.;
 				for( ; temp!=end ; temp++ )
 				{
-					int j = temp->N;
+					node_index_type j = temp->N;
 					float v = temp->Value;
 					out_i += v * in[j];
 					AtomicIncrement( out+j , v * in_i );
@@ -652,7 +657,7 @@ void MultiplyAtomic( const SparseSymmetricMatrix< T >& A , const PoissonVector<
 #ifdef USE_OPENMP 	
 #pragma omp parallel for num_threads( threads )
 #endif
-		for( int i=0 ; i<A.rows ; i++ )
+		for( node_index_type i=0 ; i<A.rows ; i++ )
 		{
 			const MatrixEntry< T >* temp = A[i];
 			const MatrixEntry< T >* end = temp + A.rowSizes[i];
@@ -660,7 +665,7 @@ void MultiplyAtomic( const SparseSymmetricMatrix< T >& A , const PoissonVector<
 			float out_i = 0.f;
 			for( ; temp!=end ; temp++ )
 			{
-				int j = temp->N;
+				node_index_type j = temp->N;
 				float v = temp->Value;
 				out_i += v * in[j];
 				AtomicIncrement( out+j , v * in_i );
@@ -669,7 +674,7 @@ void MultiplyAtomic( const SparseSymmetricMatrix< T >& A , const PoissonVector<
 		}
 }
 template< class T >
-void MultiplyAtomic( const SparseSymmetricMatrix< T >& A , const PoissonVector< double >& In , PoissonVector< double >& Out , int threads , const int* partition=NULL )
+void MultiplyAtomic( const SparseSymmetricMatrix< T >& A , const PoissonVector< double >& In , PoissonVector< double >& Out , int threads , const node_index_type* partition=NULL )
 {
 	Out.SetZero();
 	const double* in = &In[0];
@@ -680,7 +685,7 @@ void MultiplyAtomic( const SparseSymmetricMatrix< T >& A , const PoissonVector<
 #pragma omp parallel for num_threads( threads )
 #endif
 		for( int t=0 ; t<threads ; t++ )
-			for( int i=partition[t] ; i<partition[t+1] ; i++ )
+			for( node_index_type i=partition[t] ; i<partition[t+1] ; i++ )
 			{
 				const MatrixEntry< T >* temp = A[i];
 				const MatrixEntry< T >* end = temp + A.rowSizes[i];
@@ -688,7 +693,7 @@ void MultiplyAtomic( const SparseSymmetricMatrix< T >& A , const PoissonVector<
 				double out_i = 0.;
 				for( ; temp!=end ; temp++ )
 				{
-					int j = temp->N;
+					node_index_type j = temp->N;
 					T v = temp->Value;
 					out_i += v * in[j];
 					AtomicIncrement( out+j , v * in_i );
@@ -699,7 +704,7 @@ void MultiplyAtomic( const SparseSymmetricMatrix< T >& A , const PoissonVector<
 #ifdef USE_OPENMP 	
 #pragma omp parallel for num_threads( threads )
 #endif
-		for( int i=0 ; i<A.rows ; i++ )
+		for( node_index_type i=0 ; i<A.rows ; i++ )
 		{
 			const MatrixEntry< T >* temp = A[i];
 			const MatrixEntry< T >* end = temp + A.rowSizes[i];
@@ -707,7 +712,7 @@ void MultiplyAtomic( const SparseSymmetricMatrix< T >& A , const PoissonVector<
 			double out_i = 0.;
 			for( ; temp!=end ; temp++ )
 			{
-				int j = temp->N;
+				node_index_type j = temp->N;
 				T v = temp->Value;
 				out_i += v * in[j];
 				AtomicIncrement( out+j , v * in_i );
@@ -721,7 +726,7 @@ template< class T2 >
 int SparseSymmetricMatrix< T >::SolveAtomic( const SparseSymmetricMatrix< T >& A , const PoissonVector< T2 >& b , int iters , PoissonVector< T2 >& x , T2 eps , int reset , int threads , bool solveNormal )
 {
 	eps *= eps;
-	int dim = b.Dimensions();
+	node_index_type dim = node_index_type( b.Dimensions() );
 	if( reset )
 	{
 		x.Resize( dim );
@@ -733,18 +738,18 @@ int SparseSymmetricMatrix< T >::SolveAtomic( const SparseSymmetricMatrix< T >& A
 	T2 *_x = &x[0] , *_r = &r[0] , *_d = &d[0] , *_q = &q[0];
 	const T2* _b = &b[0];
 
-	std::vector< int > partition( threads+1 );
+	std::vector< node_index_type > partition( threads+1 );
 	{
-		int eCount = 0;
-		for( int i=0 ; i<A.rows ; i++ ) eCount += A.rowSizes[i];
+		node_index_type eCount = 0;
+		for( node_index_type i=0 ; i<A.rows ; i++ ) eCount += A.rowSizes[i];
 		partition[0] = 0;
 #ifdef USE_OPENMP 		
 #pragma omp parallel for num_threads( threads )
 #endif
 		for( int t=0 ; t<threads ; t++ )
 		{
-			int _eCount = 0;
-			for( int i=0 ; i<A.rows ; i++ )
+			node_index_type _eCount = 0;
+			for( node_index_type i=0 ; i<A.rows ; i++ )
 			{
 				_eCount += A.rowSizes[i];
 				if( _eCount*threads>=eCount*(t+1) )
@@ -764,7 +769,7 @@ int SparseSymmetricMatrix< T >::SolveAtomic( const SparseSymmetricMatrix< T >& A
 #ifdef USE_OPENMP 		
 #pragma omp parallel for num_threads( threads ) schedule( static )
 #endif
-		for( int i=0 ; i<dim ; i++ ) _d[i] = _r[i] = temp[i] - _r[i];
+		for( node_index_type i=0 ; i<dim ; i++ ) _d[i] = _r[i] = temp[i] - _r[i];
 	}
 	else
 	{
@@ -772,10 +777,10 @@ int SparseSymmetricMatrix< T >::SolveAtomic( const SparseSymmetricMatrix< T >& A
 #ifdef USE_OPENMP 		
 #pragma omp parallel for num_threads( threads ) schedule( static )
 #endif
-		for( int i=0 ; i<dim ; i++ ) _d[i] = _r[i] = _b[i] - _r[i];
+		for( node_index_type i=0 ; i<dim ; i++ ) _d[i] = _r[i] = _b[i] - _r[i];
 	}
 	double delta_new = 0 , delta_0;
-	for( size_t i=0 ; i<dim ; i++ ) delta_new += _r[i] * _r[i];
+	for( size_t i=0 ; i<dim ; i++ ) delta_new += double( _r[i] ) * _r[i];
 	delta_0 = delta_new;
 	if( delta_new<eps )
 	{
@@ -788,12 +793,12 @@ int SparseSymmetricMatrix< T >::SolveAtomic( const SparseSymmetricMatrix< T >& A
 		if( solveNormal ) MultiplyAtomic( A , d , temp , threads , &partition[0] ) , MultiplyAtomic( A , temp , q , threads , &partition[0] );
 		else              MultiplyAtomic( A , d , q , threads , &partition[0] );
         double dDotQ = 0;
-		for( int i=0 ; i<dim ; i++ ) dDotQ += _d[i] * _q[i];
+		for( node_index_type i=0 ; i<dim ; i++ ) dDotQ += double( _d[i] ) * _q[i];
 		T2 alpha = T2( delta_new / dDotQ );
 #ifdef USE_OPENMP 		
 #pragma omp parallel for num_threads( threads ) schedule( static )
 #endif
-		for( int i=0 ; i<dim ; i++ ) _x[i] += _d[i] * alpha;
+		for( node_index_type i=0 ; i<dim ; i++ ) _x[i] += _d[i] * alpha;
 		if( (ii%50)==(50-1) )
 		{
 			r.Resize( dim );
@@ -802,99 +807,168 @@ int SparseSymmetricMatrix< T >::SolveAtomic( const SparseSymmetricMatrix< T >& A
 #ifdef USE_OPENMP 			
 #pragma omp parallel for num_threads( threads ) schedule( static )
 #endif
-			for( int i=0 ; i<dim ; i++ ) _r[i] = _b[i] - _r[i];
+			for( node_index_type i=0 ; i<dim ; i++ ) _r[i] = _b[i] - _r[i];
 		}
 		else
 #ifdef USE_OPENMP 		
 #pragma omp parallel for num_threads( threads ) schedule( static )
 #endif
-			for( int i=0 ; i<dim ; i++ ) _r[i] -= _q[i] * alpha;
+			for( node_index_type i=0 ; i<dim ; i++ ) _r[i] -= _q[i] * alpha;
 
 		double delta_old = delta_new;
 		delta_new = 0;
-		for( size_t i=0 ; i<dim ; i++ ) delta_new += _r[i] * _r[i];
+		for( size_t i=0 ; i<dim ; i++ ) delta_new += double( _r[i] ) * _r[i];
 		T2 beta = T2( delta_new / delta_old );
 #ifdef USE_OPENMP 		
 #pragma omp parallel for num_threads( threads ) schedule( static )
 #endif
-		for( int i=0 ; i<dim ; i++ ) _d[i] = _r[i] + _d[i] * beta;
+		for( node_index_type i=0 ; i<dim ; i++ ) _d[i] = _r[i] + _d[i] * beta;
 	}
 	return ii;
 }
 #endif // WIN32
 template< class T >
 template< class T2 >
-int SparseSymmetricMatrix< T >::Solve( const SparseSymmetricMatrix<T>& A , const PoissonVector<T2>& b , int iters , PoissonVector<T2>& x , MapReduceVector< T2 >& scratch , T2 eps , int reset , bool addDCTerm , bool solveNormal )
+int SparseSymmetricMatrix< T >::Solve( const SparseSymmetricMatrix<T>& A , const PoissonVector<T2>& b , int iters , PoissonVector<T2>& x , MapReduceVector< T2 >& scratch , T2 eps , int reset , bool addDCTerm , bool solveNormal , bool warmStart , SolverControl* control )
 {
 	eps *= eps;
-	int dim = int( b.Dimensions() );
-	PoissonVector< T2 > r( dim ) , d( dim ) , q( dim ) , temp;
-	if( reset ) x.Resize( dim );
-	if( solveNormal ) temp.Resize( dim );
+	node_index_type dim = node_index_type( b.Dimensions() );
+	// Dot-products are accumulated per block and combined in block order, see MapReduceVector.
+	// The vector updates use a static schedule, so the thread that first touched a slice of the
+	// work vectors (see PoissonVector::Resize) keeps working on it.
+	int threads = scratch.threads() , blocks = scratch.blocks();
+	PoissonVector< T2 > r , d , q , temp;
+	r.Resize( dim , threads ) , d.Resize( dim , threads ) , q.Resize( dim , threads );
+	if( reset ) x.Resize( dim , threads );
+	if( solveNormal ) temp.Resize( dim , threads );
 	T2 *_x = &x[0] , *_r = &r[0] , *_d = &d[0] , *_q = &q[0];
 	const T2* _b = &b[0];
-
+	std::vector< double > partial( blocks );
 	double delta_new = 0 , delta_0;
 	if( solveNormal )
 	{
 		A.Multiply( x , temp , scratch , addDCTerm ) , A.Multiply( temp , r , scratch , addDCTerm ) , A.Multiply( b , temp , scratch , addDCTerm );
 #ifdef USE_OPENMP
-#pragma omp parallel for num_threads( scratch.threads() ) reduction( + : delta_new )
+#pragma omp parallel for num_threads( threads ) schedule( static )
 #endif
-		for( int i=0 ; i<dim ; i++ ) _d[i] = _r[i] = temp[i] - _r[i] , delta_new += _r[i] * _r[i];
+		for( int t=0 ; t<blocks ; t++ )
+		{
+			double sum = 0;
+			for( node_index_type i=(dim*t)/blocks ; i<(dim*(t+1))/blocks ; i++ ) _d[i] = _r[i] = temp[i] - _r[i] , sum += double( _r[i] ) * _r[i];
+			partial[t] = sum;
+		}
+		delta_new = 0;
+		for( int t=0 ; t<blocks ; t++ ) delta_new += partial[t];
 	}
 	else
 	{
 		 A.Multiply( x , r , scratch , addDCTerm );
-#ifdef USE_OPENMP 		 
-#pragma omp parallel for num_threads( scratch.threads() )  reduction ( + : delta_new )
+#ifdef USE_OPENMP
+#pragma omp parallel for num_threads( threads ) schedule( static )
 #endif
-		for( int i=0 ; i<dim ; i++ ) _d[i] = _r[i] = _b[i] - _r[i] , delta_new += _r[i] * _r[i];
+		for( int t=0 ; t<blocks ; t++ )
+		{
+			double sum = 0;
+			for( node_index_type i=(dim*t)/blocks ; i<(dim*(t+1))/blocks ; i++ ) _d[i] = _r[i] = _b[i] - _r[i] , sum += double( _r[i] ) * _r[i];
+			partial[t] = sum;
+		}
+		delta_new = 0;
+		for( int t=0 ; t<blocks ; t++ ) delta_new += partial[t];
 	}
 	delta_0 = delta_new;
-	if( delta_new<eps )
+	if( warmStart && !reset )
 	{
-		fprintf( stderr , "[WARNING] Initial residual too low: %g < %f\n" , delta_new , eps );
+		// The residual of a zero guess is the right-hand side (A b, still in temp, when solving the normal equations)
+		const T2* _b0 = solveNormal ? &temp[0] : _b;
+#ifdef USE_OPENMP
+#pragma omp parallel for num_threads( threads ) schedule( static )
+#endif
+		for( int t=0 ; t<blocks ; t++ )
+		{
+			double sum = 0;
+			for( node_index_type i=(dim*t)/blocks ; i<(dim*(t+1))/blocks ; i++ ) sum += double( _b0[i] ) * _b0[i];
+			partial[t] = sum;
+		}
+		delta_0 = 0;
+		for( int t=0 ; t<blocks ; t++ ) delta_0 += partial[t];
+	}
+	if( control ) control->residuals.clear();
+	double minDelta = ( control && control->minResidual>=0 ) ? control->minResidual * control->minResidual : eps;
+	if( delta_0<minDelta || delta_0==0 )
+	{
+		if( delta_0<eps ) fprintf( stderr , "[WARNING] Initial residual too low: %g < %f\n" , delta_0 , eps );
 		return 0;
 	}
-	int ii;
-	for( ii=0 ; ii<iters && delta_new>eps*delta_0 ; ii++ )
+	int ii , maxIters = iters;
+	bool stagnated = false;
+	if( control ) control->residuals.push_back( sqrt( delta_new / delta_0 ) ) , maxIters += control->extraIters;
+	for( ii=0 ; ii<maxIters && delta_new>eps*delta_0 && !stagnated ; ii++ )
 	{
 		if( solveNormal ) A.Multiply( d , temp , scratch , addDCTerm ) , A.Multiply( temp , q , scratch , addDCTerm );
 		else              A.Multiply( d , q , scratch , addDCTerm );
-        double dDotQ = 0;
-#ifdef USE_OPENMP         
-#pragma omp parallel for num_threads( scratch.threads() ) reduction( + : dDotQ )
+		double dDotQ;
+#ifdef USE_OPENMP
+#pragma omp parallel for num_threads( threads ) schedule( static )
 #endif
-		for( int i=0 ; i<dim ; i++ ) dDotQ += _d[i] * _q[i];
+		for( int t=0 ; t<blocks ; t++ )
+		{
+			double sum = 0;
+			for( node_index_type i=(dim*t)/blocks ; i<(dim*(t+1))/blocks ; i++ ) sum += double( _d[i] ) * _q[i];
+			partial[t] = sum;
+		}
+		dDotQ = 0;
+		for( int t=0 ; t<blocks ; t++ ) dDotQ += partial[t];
 		T2 alpha = T2( delta_new / dDotQ );
 		double delta_old = delta_new;
-		delta_new = 0;
 		if( (ii%50)==(50-1) )
 		{
 #ifdef USE_OPENMP 		
-#pragma omp parallel for num_threads( scratch.threads() )
+#pragma omp parallel for num_threads( threads ) schedule( static )
 #endif
-			for( int i=0 ; i<dim ; i++ ) _x[i] += _d[i] * alpha;
-			r.Resize( dim );
+			for( node_index_type i=0 ; i<dim ; i++ ) _x[i] += _d[i] * alpha;
+			r.Resize( dim , threads );
 			if( solveNormal ) A.Multiply( x , temp , scratch , addDCTerm ) , A.Multiply( temp , r , scratch , addDCTerm );
 			else              A.Multiply( x , r , scratch , addDCTerm );
-#ifdef USE_OPENMP 			
-#pragma omp parallel for num_threads( scratch.threads() ) reduction( + : delta_new )
+#ifdef USE_OPENMP
+#pragma omp parallel for num_threads( threads ) schedule( static )
 #endif
-			for( int i=0 ; i<dim ; i++ ) _r[i] = _b[i] - _r[i] , delta_new += _r[i] * _r[i] , _x[i] += _d[i] * alpha;
+			for( int t=0 ; t<blocks ; t++ )
+			{
+				double sum = 0;
+				for( node_index_type i=(dim*t)/blocks ; i<(dim*(t+1))/blocks ; i++ ) _r[i] = _b[i] - _r[i] , sum += double( _r[i] ) * _r[i] , _x[i] += _d[i] * alpha;
+				partial[t] = sum;
+			}
+			delta_new = 0;
+			for( int t=0 ; t<blocks ; t++ ) delta_new += partial[t];
 		}
 		else
-#ifdef USE_OPENMP 		
-#pragma omp parallel for num_threads( scratch.threads() ) reduction( + : delta_new )
+		{
+#ifdef USE_OPENMP
+#pragma omp parallel for num_threads( threads ) schedule( static )
 #endif
-			for( int i=0 ; i<dim ; i++ ) _r[i] -= _q[i] * alpha , delta_new += _r[i] * _r[i] ,  _x[i] += _d[i] * alpha;
+			for( int t=0 ; t<blocks ; t++ )
+			{
+				double sum = 0;
+				for( node_index_type i=(dim*t)/blocks ; i<(dim*(t+1))/blocks ; i++ ) _r[i] -= _q[i] * alpha , sum += double( _r[i] ) * _r[i] ,  _x[i] += _d[i] * alpha;
+				partial[t] = sum;
+			}
+			delta_new = 0;
+			for( int t=0 ; t<blocks ; t++ ) delta_new += partial[t];
+		}
 
 		T2 beta = T2( delta_new / delta_old );
 #ifdef USE_OPENMP 		
-#pragma omp parallel for num_threads( scratch.threads() )
+#pragma omp parallel for num_threads( threads ) schedule( static )
 #endif
-		for( int i=0 ; i<dim ; i++ ) _d[i] = _r[i] + _d[i] * beta;
+		for( node_index_type i=0 ; i<dim ; i++ ) _d[i] = _r[i] + _d[i] * beta;
+
+		if( control )
+		{
+			std::vector< double >& residuals = control->residuals;
+			residuals.push_back( sqrt( delta_new / delta_0 ) );
+			int w = control->stagnationWindow;
+			if( w>0 && int( residuals.size() )>w ) stagnated = residuals.back() > residuals[ residuals.size()-1-w ] * ( 1. - control->stagnationReduction );
+		}
 	}
 	return ii;
 }
@@ -903,7 +977,7 @@ template< class T2 >
 int SparseSymmetricMatrix<T>::Solve( const SparseSymmetricMatrix<T>& A , const PoissonVector<T2>& b , int iters , PoissonVector<T2>& x , T2 eps , int reset , int threads , bool addDCTerm , bool solveNormal )
 {
 	eps *= eps;
-	int dim = int( b.Dimensions() );
+	node_index_type dim = node_index_type( b.Dimensions() );
 	MapReduceVector< T2 > outScratch;
 	if( threads<1 ) threads = 1;
 	if( threads>1 ) outScratch.resize( threads , dim );
@@ -923,7 +997,7 @@ int SparseSymmetricMatrix<T>::Solve( const SparseSymmetricMatrix<T>& A , const P
 #ifdef USE_OPENMP 		
 #pragma omp parallel for num_threads( threads ) reduction( + : delta_new )
 #endif
-		for( int i=0 ; i<dim ; i++ ) _d[i] = _r[i] = temp[i] - _r[i] , delta_new += _r[i] * _r[i];
+		for( node_index_type i=0 ; i<dim ; i++ ) _d[i] = _r[i] = temp[i] - _r[i] , delta_new += double( _r[i] ) * _r[i];
 	}
 	else
 	{
@@ -932,7 +1006,7 @@ int SparseSymmetricMatrix<T>::Solve( const SparseSymmetricMatrix<T>& A , const P
 #ifdef USE_OPENMP 		
 #pragma omp parallel for num_threads( threads ) reduction( + : delta_new )
 #endif
-		for( int i=0 ; i<dim ; i++ ) _d[i] = _r[i] = _b[i] - _r[i] , delta_new += _r[i] * _r[i];
+		for( node_index_type i=0 ; i<dim ; i++ ) _d[i] = _r[i] = _b[i] - _r[i] , delta_new += double( _r[i] ) * _r[i];
 	}
 
 	delta_0 = delta_new;
@@ -958,7 +1032,7 @@ int SparseSymmetricMatrix<T>::Solve( const SparseSymmetricMatrix<T>& A , const P
 #ifdef USE_OPENMP         
 #pragma omp parallel for num_threads( threads ) reduction( + : dDotQ )
 #endif
-		for( int i=0 ; i<dim ; i++ ) dDotQ += _d[i] * _q[i];
+		for( node_index_type i=0 ; i<dim ; i++ ) dDotQ += double( _d[i] ) * _q[i];
 		T2 alpha = T2( delta_new / dDotQ );
 		double delta_old = delta_new;
 		delta_new = 0;
@@ -968,7 +1042,7 @@ int SparseSymmetricMatrix<T>::Solve( const SparseSymmetricMatrix<T>& A , const P
 #ifdef USE_OPENMP 		
 #pragma omp parallel for num_threads( threads )
 #endif
-			for( int i=0 ; i<dim ; i++ ) _x[i] += _d[i] * alpha;
+			for( node_index_type i=0 ; i<dim ; i++ ) _x[i] += _d[i] * alpha;
 			r.SetZero();
 			if( solveNormal )
 			{
@@ -983,21 +1057,21 @@ int SparseSymmetricMatrix<T>::Solve( const SparseSymmetricMatrix<T>& A , const P
 #ifdef USE_OPENMP 			
 #pragma omp parallel for num_threads( threads ) reduction ( + : delta_new )
 #endif
-			for( int i=0 ; i<dim ; i++ ) _r[i] = _b[i] - _r[i] , delta_new += _r[i] * _r[i] , _x[i] += _d[i] * alpha;
+			for( node_index_type i=0 ; i<dim ; i++ ) _r[i] = _b[i] - _r[i] , delta_new += double( _r[i] ) * _r[i] , _x[i] += _d[i] * alpha;
 		}
 		else
 		{
 #ifdef USE_OPENMP 		
 #pragma omp parallel for num_threads( threads ) reduction( + : delta_new )
 #endif
-			for( int i=0 ; i<dim ; i++ ) _r[i] -= _q[i] * alpha , delta_new += _r[i] * _r[i] , _x[i] += _d[i] * alpha;
+			for( node_index_type i=0 ; i<dim ; i++ ) _r[i] -= _q[i] * alpha , delta_new += double( _r[i] ) * _r[i] , _x[i] += _d[i] * alpha;
 		}
 
 		T2 beta = T2( delta_new / delta_old );
 #ifdef USE_OPENMP 		
 #pragma omp parallel for num_threads( threads )
 #endif
-		for( int i=0 ; i<dim ; i++ ) _d[i] = _r[i] + _d[i] * beta;
+		for( node_index_type i=0 ; i<dim ; i++ ) _d[i] = _r[i] + _d[i] * beta;
 	}
 	return ii;
 }
@@ -1021,7 +1095,7 @@ int SparseSymmetricMatrix<T>::Solve( const SparseSymmetricMatrix<T>& M , const P
 		// solution_new[j] * diagonal[j] + ( Md[j] - solution_old[j] * diagonal[j] ) = b[j]
 		// solution_new[j] = ( b[j] - ( Md[j] - solution_old[j] * diagonal[j] ) ) / diagonal[j]
 		// solution_new[j] = ( b[j] - Md[j] ) / diagonal[j] + solution_old[j]
-		for( int j=0 ; j<int(M.rows) ; j++ ) solution[j] += (b[j]-Md[j])/diagonal[j];
+		for( node_index_type j=0 ; j<M.rows ; j++ ) solution[j] += (b[j]-Md[j])/diagonal[j];
 	}
 	return iters;
 }
@@ -1030,7 +1104,7 @@ template< class T2 >
 void SparseSymmetricMatrix< T >::getDiagonal( PoissonVector< T2 >& diagonal ) const
 {
 	diagonal.Resize( SparseMatrix< T >::rows );
-	for( int i=0 ; i<SparseMatrix< T >::rows ; i++ )
+	for( node_index_type i=0 ; i<SparseMatrix< T >::rows ; i++ )
 	{
 		diagonal[i] = 0.;
 		for( int j=0 ; j<SparseMatrix< T >::rowSizes[i] ; j++ ) if( SparseMatrix< T >::m_ppElements[i][j].N==i ) diagonal[i] += SparseMatrix< T >::m_ppElements[i][j].Value * 2;
@@ -53,6 +53,9 @@ public:
 
 	size_t Dimensions() const;
 	void Resize( size_t N );
+	// Zeroes the entries in threads-many contiguous slices, one per thread, so that on a NUMA machine the
+	// pages of each slice are first touched (and placed) by the thread that processes it in the solver
+	void Resize( size_t N , int threads );
 
 	PoissonVector operator * (const T& A) const;
 	PoissonVector operator / (const T& A) const;
@@ -67,6 +67,26 @@ void PoissonVector<T>::Resize( size_t N )
 	}
 	if( N ) memset( m_pV , 0 , N*sizeof(T) );
 }
+template<class T>
+void PoissonVector<T>::Resize( size_t N , int threads )
+{
+	if( m_N!=N )
+	{
+		if( m_N ) DeletePointer( m_pV );
+		m_N = N;
+		m_pV = NewPointer< T >( N );
+	}
+	if( threads<1 ) threads = 1;
+	if( N )
+#ifdef USE_OPENMP
+#pragma omp parallel for num_threads( threads ) schedule( static )
+#endif
+		for( int t=0 ; t<threads ; t++ )
+		{
+			size_t start = (N*t)/threads , end = (N*(t+1))/threads;
+			if( end>start ) memset( &m_pV[start] , 0 , (end-start)*sizeof(T) );
+		}
+}
 
 template<class T>
 PoissonVector<T>::PoissonVector( size_t N, ConstPointer( T ) pV )
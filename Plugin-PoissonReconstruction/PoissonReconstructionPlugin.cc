@@ -58,9 +58,45 @@
 
 #include "PoissonReconstructionT.hh"
 
+#include <QDataStream>
+
+/// Forwards the preview meshes of a running reconstruction to the plugin
+class PoissonPreview : public ACG::PoissonReconstructionT<TriMesh>::PreviewCallback
+{
+public:
+  PoissonPreview(PoissonPlugin* _plugin) : plugin_(_plugin) {}
+
+  bool preview(int _depth, TriMesh& _mesh) { return plugin_->showPreview(_depth, _mesh); }
+
+private:
+  PoissonPlugin* plugin_;
+};
+
+/** Serializes the parameters that change the resulting mesh for PoissonMeshCache::key().
+ * Verbose, ShowResidual, Threads and PreviewDepths are not part of the key.
+ */
+static QByteArray cacheParameters(const ACG::PoissonReconstructionT<TriMesh>::Parameter& _parameter)
+{
+  QByteArray parameters;
+  QDataStream stream(&parameters, QIODevice::WriteOnly);
+  stream << qint32(_parameter.Depth) << qint32(_parameter.MinDepth) << qint32(_parameter.SamplesPerNode)
+         << _parameter.Scale << qint32(_parameter.Confidence) << _parameter.PointWeight << qint32(_parameter.AdaptiveExponent) << _parameter.IsoDivide
+         << qint32(_parameter.SolverDivide) << qint32(_parameter.MinIters) << _parameter.SolverAccuracy
+         << qint32(_parameter.FixedIters) << _parameter.Deterministic << _parameter.AdaptiveConvergence
+         << _parameter.UseROI;
+  if ( _parameter.UseROI )
+    stream << _parameter.ROIMin[0] << _parameter.ROIMin[1] << _parameter.ROIMin[2]
+           << _parameter.ROIMax[0] << _parameter.ROIMax[1] << _parameter.ROIMax[2]
+           << _parameter.ROIMargin << qint32(_parameter.ROICoarsening);
+  stream << _parameter.DecimationTolerance << _parameter.WarmStart;
+  return parameters;
+}
+
 PoissonPlugin::PoissonPlugin() :
         tool_(0),
-        toolIcon_(0)
+        toolIcon_(0),
+        previewId_(-1),
+        abortRequested_(false)
 {
 
 }
@@ -73,6 +109,8 @@ void PoissonPlugin::initializePlugin(){
   tool_ = new PoissonToolBox();
   
   connect(tool_->reconstructButton, SIGNAL( clicked() ), this, SLOT( slotPoissonReconstruct() ) );
+  connect(tool_->abortButton, SIGNAL( clicked() ), this, SLOT( slotAbortReconstruction() ) );
+  connect(tool_->cacheBox, SIGNAL( toggled(bool) ), this, SLOT( setResultCacheEnabled(bool) ) );
 
   toolIcon_ = new QIcon(OpenFlipper::Options::iconDirStr()+OpenFlipper::Options::dirSeparator()+"PoissonReconstruction.png");
   emit addToolbox( tr("Poisson Reconstruction") , tool_, toolIcon_);
@@ -118,6 +156,8 @@ void PoissonPlugin::initializePlugin(){
 
 void PoissonPlugin::pluginsInitialized()
 {
+  cache_.setDirectory(OpenFlipper::Options::configDirStr() + OpenFlipper::Options::dirSeparator() + "PoissonCache");
+
   emit setSlotDescription("poissonReconstruct(int,int)",tr("Reconstruct a triangle mesh from the given object. Returns the id of the new object or -1 if it failed."),
       QStringList(tr("ObjectId;depth").split(';')),QStringList(tr("ObjectId of the object;octree depth").split(';')));
   emit setSlotDescription("poissonReconstruct(IdList,int)",tr("Reconstruct one triangle mesh from the given objects. Returns the id of the new object or -1 if it failed."),
@@ -127,6 +167,35 @@ void PoissonPlugin::pluginsInitialized()
       QStringList(tr("ObjectId")),QStringList(tr("ObjectId of the object")));
   emit setSlotDescription("poissonReconstruct(IdList)",tr("Reconstruct one triangle mesh from the given objects. (Octree depth defaults to 7). Returns the id of the new object or -1 if it failed."),
       QStringList(tr("IdList")),QStringList(tr("Id of the objects")));
+
+  emit setSlotDescription("poissonReconstructROI(IdList,Vector,Vector,int)",tr("Reconstruct one triangle mesh from the given objects inside the given box. Points outside the slightly enlarged box are ignored. Returns the id of the new object or -1 if it failed."),
+      QStringList(tr("IdList;bbMin;bbMax;depth").split(';')),QStringList(tr("Id of the objects;minimum corner of the box;maximum corner of the box;octree depth").split(';')));
+  emit setSlotDescription("poissonReconstructROI(IdList,Vector,Vector)",tr("Reconstruct one triangle mesh from the given objects inside the given box. (Octree depth defaults to 7). Returns the id of the new object or -1 if it failed."),
+      QStringList(tr("IdList;bbMin;bbMax").split(';')),QStringList(tr("Id of the objects;minimum corner of the box;maximum corner of the box").split(';')));
+
+  emit setSlotDescription("poissonReconstructEach(IdList,int)",tr("Reconstruct a separate triangle mesh from each of the given objects. The reconstructions run concurrently. Returns the ids of the new objects."),
+      QStringList(tr("IdList;depth").split(';')),QStringList(tr("Id of the objects;octree depth").split(';')));
+  emit setSlotDescription("poissonReconstructEach(IdList)",tr("Reconstruct a separate triangle mesh from each of the given objects. The reconstructions run concurrently. (Octree depth defaults to 7). Returns the ids of the new objects."),
+      QStringList(tr("IdList")),QStringList(tr("Id of the objects")));
+
+  emit setSlotDescription("poissonReconstructToFile(IdList,QString,int)",tr("Reconstruct one triangle mesh from the given objects and write it to a binary PLY file, or an OBJ file if the name ends in .obj. No object is created. Returns true on success."),
+      QStringList(tr("IdList;filename;depth").split(';')),QStringList(tr("Id of the objects;output file;octree depth").split(';')));
+  emit setSlotDescription("poissonReconstructToFile(IdList,QString)",tr("Reconstruct one triangle mesh from the given objects and write it to a binary PLY file, or an OBJ file if the name ends in .obj. No object is created. (Octree depth defaults to 7). Returns true on success."),
+      QStringList(tr("IdList;filename").split(';')),QStringList(tr("Id of the objects;output file").split(';')));
+
+  emit setSlotDescription("poissonReconstructToVolume(IdList,QString,int,int)",tr("Solve for the indicator function of the given objects and write it, sampled on a regular grid, as raw floats to the given file. A MetaImage header (.mhd) describing the grid is written next to it. The surface is the zero level, the inside is positive. Returns true on success."),
+      QStringList(tr("IdList;filename;depth;gridDepth").split(';')),QStringList(tr("Id of the objects;output file;octree depth;the grid has 2^gridDepth samples per axis, -1 uses the octree depth").split(';')));
+  emit setSlotDescription("poissonReconstructToVolume(IdList,QString)",tr("Solve for the indicator function of the given objects and write it, sampled on a regular grid, as raw floats to the given file. A MetaImage header (.mhd) describing the grid is written next to it. (Octree depth and grid depth default to 7). Returns true on success."),
+      QStringList(tr("IdList;filename").split(';')),QStringList(tr("Id of the objects;output file").split(';')));
+
+  emit setSlotDescription("setResultCacheEnabled(bool)",tr("Enable or disable the result cache. If enabled, poissonReconstruct and poissonReconstructROI load the mesh of an earlier reconstruction of the same points with the same parameters from disk instead of solving again. Disabled by default."),
+      QStringList(tr("enabled")),QStringList(tr("true to use the cache")));
+  emit setSlotDescription("setResultCacheLimit(int)",tr("Set the size limit of the result cache on disk. If it is exceeded, the least recently used results are removed. Defaults to 256 MB."),
+      QStringList(tr("megabytes")),QStringList(tr("size limit in megabytes")));
+  emit setSlotDescription("setResultCacheDirectory(QString)",tr("Set the directory holding the result cache. Defaults to PoissonCache in the OpenFlipper configuration directory."),
+      QStringList(tr("directory")),QStringList(tr("cache directory")));
+  emit setSlotDescription("clearResultCache()",tr("Remove all results from the result cache."),
+      QStringList(),QStringList());
 }
 
 int PoissonPlugin::poissonReconstruct(int _id, int _depth)
@@ -137,100 +206,123 @@ int PoissonPlugin::poissonReconstruct(int _id, int _depth)
 
 int PoissonPlugin::poissonReconstruct(IdList _ids, int _depth)
 {
-  IdList generatedMeshes;
+  return reconstruct(_ids, _depth, 0, 0);
+}
 
-  unsigned int n_points = 0;
+int PoissonPlugin::poissonReconstructROI(IdList _ids, Vector _bbMin, Vector _bbMax, int _depth)
+{
+  for ( int i = 0 ; i < 3 ; ++i )
+    if ( _bbMin[i] > _bbMax[i] ) {
+      emit log(LOGERR,"Invalid region of interest: minimum corner exceeds maximum corner");
+      return -1;
+    }
 
-  // Data container for the algorithm
-  // holds two 3D vectors in 6 columns, first the position, followed by the normal of the point
-  std::vector< Real > pt_data;
+  return reconstruct(_ids, _depth, &_bbMin, &_bbMax);
+}
 
-  //get data from objects
-  for (IdList::iterator idIter = _ids.begin(); idIter != _ids.end(); ++idIter)
-  {
-    BaseObjectData* obj = 0;
-    PluginFunctions::getObject(*idIter,obj);
-    if ( obj == 0 ) {
-      emit log(LOGERR , QString("Unable to get Object width id %1").arg(*idIter));
-      continue;
-    }
+bool PoissonPlugin::collectPoints(int _id, std::vector< float >& _pt_data)
+{
+  size_t n_points = _pt_data.size() / 6;
 
-    //Triangle mesh
-    if ( obj->dataType() == DATA_TRIANGLE_MESH) {
+  BaseObjectData* obj = 0;
+  PluginFunctions::getObject(_id,obj);
+  if ( obj == 0 ) {
+    emit log(LOGERR , QString("Unable to get Object width id %1").arg(_id));
+    return false;
+  }
 
-      // Get triangle mesh
-      TriMesh* mesh = PluginFunctions::triMesh(obj);
+  //Triangle mesh
+  if ( obj->dataType() == DATA_TRIANGLE_MESH) {
 
-      n_points += mesh->n_vertices();
+    // Get triangle mesh
+    TriMesh* mesh = PluginFunctions::triMesh(obj);
 
-      emit log(LOGINFO,QString("Adding %1 points from Object %2").arg(mesh->n_vertices()).arg(*idIter) );
+    n_points += mesh->n_vertices();
 
-      pt_data.reserve( n_points * 6 );
-      TriMesh::VertexIter vit = mesh->vertices_begin();
-      for ( ; vit != mesh->vertices_end(); ++vit )
-      {
-        pt_data.push_back( mesh->point( *vit )[0] );
-        pt_data.push_back( mesh->point( *vit )[1] );
-        pt_data.push_back( mesh->point( *vit )[2] );
-        pt_data.push_back( mesh->normal( *vit )[0] );
-        pt_data.push_back( mesh->normal( *vit )[1] );
-        pt_data.push_back( mesh->normal( *vit )[2] );
-      }
-    }
-    //Poly mesh
-    else if ( obj->dataType() == DATA_POLY_MESH) {
-      // Get poly mesh
-      PolyMesh* mesh = PluginFunctions::polyMesh(obj);
-
-      n_points += mesh->n_vertices();
-
-      emit log(LOGINFO,QString("Adding %1 points from Object %2").arg(mesh->n_vertices()).arg(*idIter) );
-
-      pt_data.reserve( n_points * 6 );
-      PolyMesh::VertexIter vit = mesh->vertices_begin();
-      for ( ; vit != mesh->vertices_end(); ++vit )
-      {
-        pt_data.push_back( mesh->point( *vit )[0] );
-        pt_data.push_back( mesh->point( *vit )[1] );
-        pt_data.push_back( mesh->point( *vit )[2] );
-        pt_data.push_back( mesh->normal( *vit )[0] );
-        pt_data.push_back( mesh->normal( *vit )[1] );
-        pt_data.push_back( mesh->normal( *vit )[2] );
-      }
+    emit log(LOGINFO,QString("Adding %1 points from Object %2").arg(mesh->n_vertices()).arg(_id) );
+
+    _pt_data.reserve( n_points * 6 );
+    TriMesh::VertexIter vit = mesh->vertices_begin();
+    for ( ; vit != mesh->vertices_end(); ++vit )
+    {
+      _pt_data.push_back( mesh->point( *vit )[0] );
+      _pt_data.push_back( mesh->point( *vit )[1] );
+      _pt_data.push_back( mesh->point( *vit )[2] );
+      _pt_data.push_back( mesh->normal( *vit )[0] );
+      _pt_data.push_back( mesh->normal( *vit )[1] );
+      _pt_data.push_back( mesh->normal( *vit )[2] );
     }
-    //Splat cloud
-   #ifdef ENABLE_SPLATCLOUD_SUPPORT
-    else if( obj->dataType() == DATA_SPLATCLOUD)
+  }
+  //Poly mesh
+  else if ( obj->dataType() == DATA_POLY_MESH) {
+    // Get poly mesh
+    PolyMesh* mesh = PluginFunctions::polyMesh(obj);
+
+    n_points += mesh->n_vertices();
+
+    emit log(LOGINFO,QString("Adding %1 points from Object %2").arg(mesh->n_vertices()).arg(_id) );
+
+    _pt_data.reserve( n_points * 6 );
+    PolyMesh::VertexIter vit = mesh->vertices_begin();
+    for ( ; vit != mesh->vertices_end(); ++vit )
     {
+      _pt_data.push_back( mesh->point( *vit )[0] );
+      _pt_data.push_back( mesh->point( *vit )[1] );
+      _pt_data.push_back( mesh->point( *vit )[2] );
+      _pt_data.push_back( mesh->normal( *vit )[0] );
+      _pt_data.push_back( mesh->normal( *vit )[1] );
+      _pt_data.push_back( mesh->normal( *vit )[2] );
+    }
+  }
+  //Splat cloud
+ #ifdef ENABLE_SPLATCLOUD_SUPPORT
+  else if( obj->dataType() == DATA_SPLATCLOUD)
+  {
 
-      // Get splat cloud mesh
-      SplatCloud* cloud = PluginFunctions::splatCloud(obj);
+    // Get splat cloud mesh
+    SplatCloud* cloud = PluginFunctions::splatCloud(obj);
 
-      if ( ! cloud->hasNormals() ) {
-        emit log(LOGERR,"Splat cloud has no normals. Skipping it");
-        continue;
-      }
+    if ( ! cloud->hasNormals() ) {
+      emit log(LOGERR,"Splat cloud has no normals. Skipping it");
+      return false;
+    }
 
-      n_points += cloud->numSplats();
+    n_points += cloud->numSplats();
 
-      emit log(LOGINFO,QString("Adding %1 points from Object %2").arg(cloud->numSplats()).arg(*idIter) );
+    emit log(LOGINFO,QString("Adding %1 points from Object %2").arg(cloud->numSplats()).arg(_id) );
 
-      pt_data.reserve( n_points * 6 );
-      for (unsigned i = 0 ; i < cloud->numSplats(); ++i )
-      {
-        pt_data.push_back( cloud->positions( i )[0] );
-        pt_data.push_back( cloud->positions( i )[1] );
-        pt_data.push_back( cloud->positions( i )[2] );
-        pt_data.push_back( cloud->normals( i )[0] );
-        pt_data.push_back( cloud->normals( i )[1] );
-        pt_data.push_back( cloud->normals( i )[2] );
-      }
+    _pt_data.reserve( n_points * 6 );
+    for (unsigned i = 0 ; i < cloud->numSplats(); ++i )
+    {
+      _pt_data.push_back( cloud->positions( i )[0] );
+      _pt_data.push_back( cloud->positions( i )[1] );
+      _pt_data.push_back( cloud->positions( i )[2] );
+      _pt_data.push_back( cloud->normals( i )[0] );
+      _pt_data.push_back( cloud->normals( i )[1] );
+      _pt_data.push_back( cloud->normals( i )[2] );
     }
+  }
 #endif
-    else
-      emit log(LOGERR,QString("ObjectType of Object with id %1 is unsupported").arg(*idIter));
+  else {
+    emit log(LOGERR,QString("ObjectType of Object with id %1 is unsupported").arg(_id));
+    return false;
   }
 
+  return true;
+}
+
+int PoissonPlugin::reconstruct(IdList _ids, int _depth, const Vector* _bbMin, const Vector* _bbMax)
+{
+  IdList generatedMeshes;
+
+  // Data container for the algorithm
+  // holds two 3D vectors in 6 columns, first the position, followed by the normal of the point
+  std::vector< Real > pt_data;
+
+  //get data from objects
+  for (IdList::iterator idIter = _ids.begin(); idIter != _ids.end(); ++idIter)
+    collectPoints(*idIter, pt_data);
+
 
   int meshId = -1;
 
@@ -256,14 +348,54 @@ int PoissonPlugin::poissonReconstruct(IdList _ids, int _depth)
     ACG::PoissonReconstructionT<TriMesh>::Parameter params;
     params.Depth = _depth;
 
-    emit log(LOGINFO,"Starting reconstruction");
+    if ( _bbMin && _bbMax ) {
+      params.UseROI = true;
+      params.ROIMin = Point3D< Real >( Real((*_bbMin)[0]), Real((*_bbMin)[1]), Real((*_bbMin)[2]) );
+      params.ROIMax = Point3D< Real >( Real((*_bbMax)[0]), Real((*_bbMax)[1]), Real((*_bbMax)[2]) );
+    }
+
+    // Preview the coarser depths, the dense preview grid limits them to depth 8
+    PoissonPreview preview(this);
+    abortRequested_ = false;
+    if ( OpenFlipper::Options::gui() && tool_->previewBox->isChecked() ) {
+      for ( int depth = 5 ; depth < std::min(_depth, 9) ; ++depth )
+        params.PreviewDepths.push_back(depth);
+      pr.setPreviewCallback(&preview);
+      // Events are processed during previews, so block a second reconstruction
+      tool_->reconstructButton->setEnabled(false);
+      tool_->abortButton->setEnabled(true);
+    }
+
+    // Reuse an earlier reconstruction of the same points with the same parameters
+    const QByteArray cacheKey = cache_.enabled() ? PoissonMeshCache::key(pt_data, cacheParameters(params)) : QByteArray();
+    const bool cached = cache_.enabled() && cache_.load(cacheKey, *final_mesh);
+
+    bool success = cached;
+    if ( cached ) {
+      emit log(LOGINFO,"Reconstruction loaded from the result cache");
+    } else {
+      emit log(LOGINFO,"Starting reconstruction");
+      success = pr.run( pt_data, *final_mesh, params );
+      if ( success && cache_.enabled() && !cache_.store(cacheKey, *final_mesh) )
+        emit log(LOGWARN,"Unable to store the reconstruction in the result cache");
+    }
 
-    if ( pr.run( pt_data, *final_mesh, params ) ) {
+    if ( OpenFlipper::Options::gui() ) {
+      tool_->reconstructButton->setEnabled(true);
+      tool_->abortButton->setEnabled(false);
+    }
+
+    if ( previewId_ != -1 ) {
+      emit deleteObject( previewId_ );
+      previewId_ = -1;
+    }
+
+    if ( success ) {
       emit log(LOGINFO,"Reconstruction succeeded");
       emit updatedObject(meshId,UPDATE_ALL);
       finalObject->setName("Poisson Reconstruction.obj");
     } else {
-      emit log(LOGERR,"Reconstruction failed");
+      emit log(LOGERR, abortRequested_ ? "Reconstruction aborted" : "Reconstruction failed");
       emit deleteObject( meshId );
       meshId = -1;
     }
@@ -274,6 +406,149 @@ int PoissonPlugin::poissonReconstruct(IdList _ids, int _depth)
 }
 
 
+IdList PoissonPlugin::poissonReconstructEach(IdList _ids, int _depth)
+{
+  IdList sourceIds;
+  IdList generatedMeshes;
+
+  // Gather the points and create the target objects here, only the
+  // reconstructions themselves run concurrently
+  std::vector< std::vector< Real > > pt_data;
+  std::vector< TriMesh* > meshes;
+
+  for (IdList::iterator idIter = _ids.begin(); idIter != _ids.end(); ++idIter)
+  {
+    std::vector< Real > points;
+    if ( !collectPoints(*idIter, points) || points.empty() )
+      continue;
+
+    int meshId = -1;
+    emit addEmptyObject ( DATA_TRIANGLE_MESH, meshId );
+
+    TriMesh* final_mesh = NULL;
+    PluginFunctions::getMesh(meshId,final_mesh);
+    if ( final_mesh == 0 ) {
+      emit log(LOGERR,"Unable to create the reconstruction object");
+      continue;
+    }
+
+    pt_data.push_back( std::vector< Real >() );
+    pt_data.back().swap( points );
+    meshes.push_back( final_mesh );
+    sourceIds.push_back( *idIter );
+    generatedMeshes.push_back( meshId );
+  }
+
+  if ( meshes.empty() )
+    return generatedMeshes;
+
+  ACG::PoissonReconstructionT<TriMesh>::Parameter params;
+  params.Depth = _depth;
+  params.Verbose = false;
+
+  emit log(LOGINFO,QString("Starting %1 reconstructions").arg(meshes.size()));
+
+  const std::vector< bool > success = ACG::PoissonReconstructionT<TriMesh>::runBatch( pt_data, meshes, params );
+
+  IdList result;
+  for ( size_t i = 0 ; i < generatedMeshes.size() ; ++i ) {
+    if ( success[i] ) {
+      emit updatedObject(generatedMeshes[i],UPDATE_ALL);
+      PluginFunctions::triMeshObject(generatedMeshes[i])->setName(QString("Poisson Reconstruction %1.obj").arg(sourceIds[i]));
+      result.push_back( generatedMeshes[i] );
+    } else {
+      emit log(LOGERR,QString("Reconstruction of object %1 failed").arg(sourceIds[i]));
+      emit deleteObject( generatedMeshes[i] );
+    }
+  }
+
+  emit log(LOGINFO,QString("%1 of %2 reconstructions succeeded").arg(result.size()).arg(meshes.size()));
+
+  return result;
+}
+
+bool PoissonPlugin::poissonReconstructToFile(IdList _ids, QString _filename, int _depth)
+{
+  std::vector< Real > pt_data;
+
+  for (IdList::iterator idIter = _ids.begin(); idIter != _ids.end(); ++idIter)
+    collectPoints(*idIter, pt_data);
+
+  if ( pt_data.empty() ) {
+    emit log(LOGERR,"No points to reconstruct");
+    return false;
+  }
+
+  ACG::PoissonReconstructionT<TriMesh> pr;
+
+  ACG::PoissonReconstructionT<TriMesh>::Parameter params;
+  params.Depth = _depth;
+
+  emit log(LOGINFO,QString("Starting reconstruction into %1").arg(_filename));
+
+  if ( !pr.run( pt_data, std::string(_filename.toLocal8Bit().constData()), params ) ) {
+    emit log(LOGERR,"Reconstruction failed");
+    return false;
+  }
+
+  emit log(LOGINFO,QString("Reconstruction written to %1").arg(_filename));
+
+  return true;
+}
+
+bool PoissonPlugin::poissonReconstructToVolume(IdList _ids, QString _filename, int _depth, int _gridDepth)
+{
+  std::vector< Real > pt_data;
+
+  for (IdList::iterator idIter = _ids.begin(); idIter != _ids.end(); ++idIter)
+    collectPoints(*idIter, pt_data);
+
+  if ( pt_data.empty() ) {
+    emit log(LOGERR,"No points to reconstruct");
+    return false;
+  }
+
+  ACG::PoissonReconstructionT<TriMesh> pr;
+
+  ACG::PoissonReconstructionT<TriMesh>::Parameter params;
+  params.Depth = _depth;
+
+  emit log(LOGINFO,QString("Starting reconstruction into %1").arg(_filename));
+
+  if ( !pr.runVolume( pt_data, std::string(_filename.toLocal8Bit().constData()), params, _gridDepth ) ) {
+    emit log(LOGERR,"Reconstruction failed");
+    return false;
+  }
+
+  emit log(LOGINFO,QString("Volume written to %1").arg(_filename));
+
+  return true;
+}
+
+void PoissonPlugin::setResultCacheEnabled(bool _enabled)
+{
+  cache_.setEnabled(_enabled);
+
+  if ( OpenFlipper::Options::gui() && tool_ )
+    tool_->cacheBox->setChecked(_enabled);
+}
+
+void PoissonPlugin::setResultCacheLimit(int _megabytes)
+{
+  cache_.setMaxSize(qint64(std::max(_megabytes, 0)) << 20);
+}
+
+void PoissonPlugin::setResultCacheDirectory(QString _directory)
+{
+  cache_.setDirectory(_directory);
+}
+
+void PoissonPlugin::clearResultCache()
+{
+  cache_.clear();
+  emit log(LOGINFO,QString("Result cache %1 cleared").arg(cache_.directory()));
+}
+
 void PoissonPlugin::slotPoissonReconstruct(){
 
   if ( ! OpenFlipper::Options::gui())
@@ -299,6 +574,42 @@ void PoissonPlugin::slotPoissonReconstruct(){
 
 }
 
+void PoissonPlugin::slotAbortReconstruction(){
+  abortRequested_ = true;
+}
+
+bool PoissonPlugin::showPreview(int _depth, TriMesh& _mesh)
+{
+  if ( abortRequested_ )
+    return false;
+
+  if ( previewId_ == -1 ) {
+    emit addEmptyObject( DATA_TRIANGLE_MESH, previewId_ );
+
+    TriMeshObject* previewObject = PluginFunctions::triMeshObject(previewId_);
+    if ( previewObject == 0 ) {
+      previewId_ = -1;
+      return true;
+    }
+    previewObject->setName("Poisson Preview");
+  }
+
+  TriMesh* previewMesh = NULL;
+  PluginFunctions::getMesh(previewId_, previewMesh);
+  if ( previewMesh == 0 )
+    return true;
+
+  *previewMesh = _mesh;
+
+  emit log(LOGINFO,QString("Preview at depth %1").arg(_depth));
+  emit updatedObject(previewId_,UPDATE_ALL);
+
+  // Let the viewer redraw and the abort button react while the solver is running
+  QCoreApplication::processEvents();
+
+  return !abortRequested_;
+}
+
 #if QT_VERSION < 0x050000
 Q_EXPORT_PLUGIN2( poissonplugin , PoissonPlugin );
 #endif
@@ -50,10 +50,15 @@
 #include <OpenFlipper/BasePlugin/LoggingInterface.hh>
 #include <OpenFlipper/BasePlugin/LoadSaveInterface.hh>
 
+#include <ObjectTypes/TriangleMesh/TriangleMesh.hh>
+
 #include <QObject>
 #include <QtGui>
 
+#include <vector>
+
 #include "PoissonToolbox.hh"
+#include "PoissonMeshCache.hh"
 
 class PoissonPlugin : public QObject, BaseInterface, ToolboxInterface, LoadSaveInterface, LoggingInterface, AboutInfoInterface
 {
@@ -82,6 +87,7 @@ signals:
   // Load/Save Interface
   void addEmptyObject (DataType _type, int& _id);
   void deleteObject( int _id );
+  void updatedObject(int _identifier, const UpdateType& _type);
 
   // ToolboxInterface
   void addToolbox( QString _name  , QWidget* _widget, QIcon* _icon );
@@ -101,6 +107,9 @@ private slots:
   /// Button slot iterating over all targets and passing them to the correct functions
   void slotPoissonReconstruct();
 
+  /// Abort button slot, stops the running reconstruction at the next preview
+  void slotAbortReconstruction();
+
   // Tell system that this plugin runs without ui
   void noguiSupported( ) {} ;
 
@@ -110,6 +119,30 @@ int poissonReconstruct(int _id, int _depth = 7);
 
   int poissonReconstruct(IdList _ids, int _depth = 7);
 
+  /// Reconstructs only the part of the objects inside the box [_bbMin,_bbMax]
+  int poissonReconstructROI(IdList _ids, Vector _bbMin, Vector _bbMax, int _depth = 7);
+
+  /// Reconstructs a separate mesh for every object, running the reconstructions concurrently
+  IdList poissonReconstructEach(IdList _ids, int _depth = 7);
+
+  /// Reconstructs the objects directly into a PLY or OBJ file without creating a mesh object
+  bool poissonReconstructToFile(IdList _ids, QString _filename, int _depth = 7);
+
+  /// Writes the indicator function of the objects, sampled on a regular grid, to a raw float volume file
+  bool poissonReconstructToVolume(IdList _ids, QString _filename, int _depth = 7, int _gridDepth = -1);
+
+  /// Enables or disables the reuse of earlier reconstructions of the same points with the same parameters
+  void setResultCacheEnabled(bool _enabled);
+
+  /// Limits the size of the result cache on disk, the least recently used results are removed first
+  void setResultCacheLimit(int _megabytes);
+
+  /// Sets the directory holding the cached results
+  void setResultCacheDirectory(QString _directory);
+
+  /// Removes all cached results
+  void clearResultCache();
+
 public :
   PoissonPlugin();
   ~PoissonPlugin() {};
@@ -117,10 +150,30 @@ public :
   QString name() { return (QString("Poisson Reconstruction Plugin")); };
   QString description( ) { return (QString("Poisson reconstruction based on the Code by Michael Kazhdan and Matthew Bolitho")); };
 
+private :
+  /// Appends position and normal of every point of the object to _pt_data, returns false if the object is unusable
+  bool collectPoints(int _id, std::vector< float >& _pt_data);
+
+  /// Collects the points of the given objects and reconstructs them, restricted to the box if _bbMin and _bbMax are given
+  int reconstruct(IdList _ids, int _depth, const Vector* _bbMin, const Vector* _bbMax);
+
+public :
+  /// Shows an intermediate mesh of the running reconstruction, returns false if it should be aborted
+  bool showPreview(int _depth, TriMesh& _mesh);
+
 private :
   PoissonToolBox* tool_;
   QIcon* toolIcon_;
 
+  /// Id of the object showing the preview meshes, -1 if there is none
+  int previewId_;
+
+  /// Set by the abort button while a reconstruction is running
+  bool abortRequested_;
+
+  /// Results of earlier reconstructions, see reconstruct()
+  PoissonMeshCache cache_;
+
 
 public slots:
   QString version() { return QString("1.0"); };
@@ -17,8 +17,14 @@ namespace ACG {
 
 //== IMPLEMENTATION ==========================================================
 
+/// Progress output of the reconstruction running on this thread, batch jobs switch it off via Parameter::Verbose
+POISSON_THREAD_LOCAL bool dumpOutputEnabled = true;
+
 void DumpOutput( const char* format , ... )
 {
+  if ( !dumpOutputEnabled )
+    return;
+
   va_list args;
   va_start( args , format );
   vprintf( format , args );
@@ -33,22 +39,251 @@ run( std::vector< Real >& _pt_data, MeshT& _mesh, const Parameter& _parameter )
 
     m_parameter = _parameter;
 
-    Real isoValue = 0;
+    // The vertex normals are taken from the gradient of the implicit function, unless the decimation moves the vertices
+    CoredFileMeshData mesh;
+    mesh.storeNormals = _mesh.has_vertex_normals() && m_parameter.DecimationTolerance <= 0;
+    bool solved = solve( _pt_data, mesh );
+    releaseTables();
+    if( !solved )
+      return false;
+
+    copyMesh( mesh, _mesh, m_parameter.UseROI );
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+template <class MeshT>
+bool
+PoissonReconstructionT<MeshT>::
+run( std::vector< Real >& _pt_data, const std::string& _filename, const Parameter& _parameter )
+{
+    m_parameter = _parameter;
+
+    std::string extension = _filename.substr( std::min( _filename.rfind( '.' ), _filename.size() ) );
+    std::transform( extension.begin(), extension.end(), extension.begin(), ::tolower );
+
+    CoredMeshFileWriter writer;
+    if( !writer.open( _filename.c_str(), extension == ".obj" ? CoredMeshFileWriter::OBJ : CoredMeshFileWriter::PLY_BINARY, m_parameter.UseROI ) )
+    {
+      std::cerr << "Unable to open " << _filename << " for writing" << std::endl;
+      return false;
+    }
+
+    bool solved = solve( _pt_data, writer );
+    releaseTables();
+    if( !solved )
+      return false;
+
+    if( !writer.close() )
+    {
+      std::cerr << "Unable to write " << _filename << std::endl;
+      return false;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+template <class MeshT>
+bool
+PoissonReconstructionT<MeshT>::
+runVolume( std::vector< Real >& _pt_data, const std::string& _filename, const Parameter& _parameter, int _depth )
+{
+    m_parameter = _parameter;
+
+    bool success = reconstructVolume< 2 >( _pt_data, _filename, _depth );
+    releaseTables();
+    return success;
+}
+
+//-----------------------------------------------------------------------------
+
+template <class MeshT>
+bool
+PoissonReconstructionT<MeshT>::
+addPoints( std::vector< Real >& _pt_data, const std::vector< Real >& _points, MeshT& _mesh )
+{
+    _pt_data.insert( _pt_data.end(), _points.begin(), _points.end() );
 
-    Octree<2> tree;
-#ifdef USE_OMP
-    tree.threads = omp_get_num_procs();
+    Parameter parameter = m_parameter;
+    parameter.WarmStart = true;
+    return run( _pt_data, _mesh, parameter );
+}
+
+//-----------------------------------------------------------------------------
+
+template <class MeshT>
+bool
+PoissonReconstructionT<MeshT>::
+solve( std::vector< Real >& _pt_data, CoredMeshData& _coredMesh )
+{
+    return reconstruct< 2 >( _pt_data, _coredMesh );
+}
+
+//-----------------------------------------------------------------------------
+
+template <class MeshT>
+void
+PoissonReconstructionT<MeshT>::
+releaseTables()
+{
+    // Tables still referenced by concurrent reconstructions are kept, batch jobs leave them to runBatch
+    if( !m_allocator )
+      BSplineData< 2 , Real >::ClearTableCache();
+}
+
+//-----------------------------------------------------------------------------
+
+template <class MeshT>
+std::vector< bool >
+PoissonReconstructionT<MeshT>::
+runBatch( std::vector< std::vector< Real > >& _pt_data, const std::vector< MeshT* >& _meshes, const Parameter& _parameter, int _maxJobs )
+{
+    int jobCount = int( std::min( _pt_data.size(), _meshes.size() ) );
+    std::vector< char > success( jobCount, 0 );
+
+    // Start with the largest point sets, so that the jobs finishing last are short ones
+    std::vector< std::pair< size_t, int > > order( jobCount );
+    for( int i=0 ; i<jobCount ; i++ ) order[i] = std::make_pair( _pt_data[i].size(), i );
+    std::sort( order.rbegin(), order.rend() );
+
+    int workers = 1;
+#ifdef USE_OPENMP
+    workers = _maxJobs > 0 ? _maxJobs : omp_get_num_procs();
+#endif
+    workers = std::max( 1, std::min( workers, jobCount ) );
+
+    Parameter parameter = _parameter;
+    parameter.Threads = 1;
+    parameter.PreviewDepths.clear();
+
+    std::vector< AllocatorT< TreeOctNode > > allocators( workers );
+    for( int t=0 ; t<workers ; t++ ) allocators[t].set( MEMORY_ALLOCATOR_BLOCK_SIZE );
+
+#ifdef USE_OPENMP
+#pragma omp parallel for num_threads( workers ) schedule( dynamic , 1 )
+#endif
+    for( int j=0 ; j<jobCount ; j++ )
+    {
+        int t = 0;
+#ifdef USE_OPENMP
+        t = omp_get_thread_num();
+#endif
+        int i = order[j].second;
+
+        PoissonReconstructionT<MeshT> reconstruction;
+        reconstruction.m_allocator = &allocators[t];
+        success[i] = reconstruction.run( _pt_data[i], *_meshes[i], parameter ) ? 1 : 0;
+
+        TreeOctNode::SetThreadAllocator( NULL );
+    }
+
+    // Release the pools while they are current, so that the node destructors
+    // leave the pooled children alone
+    for( int t=0 ; t<workers ; t++ )
+    {
+        TreeOctNode::SetThreadAllocator( &allocators[t] );
+        allocators[t].reset();
+    }
+    TreeOctNode::SetThreadAllocator( NULL );
+
+    // The jobs shared the B-spline tables, drop them now that all of them are done
+    BSplineData< 2 , Real >::ClearTableCache();
+
+    return std::vector< bool >( success.begin(), success.end() );
+}
+
+//-----------------------------------------------------------------------------
+
+template <class MeshT>
+template< int Degree >
+bool
+PoissonReconstructionT<MeshT>::
+solveTree( Octree< Degree >& _tree, std::vector< Real >& _pt_data )
+{
+    dumpOutputEnabled = m_parameter.Verbose;
+
+#ifdef USE_OPENMP
+    _tree.threads = m_parameter.Threads > 0 ? m_parameter.Threads : omp_get_num_procs();
 #else
-    tree.threads = 1;
+    _tree.threads = 1;
 #endif
-    TreeOctNode::SetAllocator( MEMORY_ALLOCATOR_BLOCK_SIZE );
+    _tree.deterministic = m_parameter.Deterministic;
+    _tree.adaptiveConvergence = m_parameter.AdaptiveConvergence;
+
+    bool warmStart = false, appended = false;
+    unsigned long long checksum = 0;
+    if( m_parameter.WarmStart )
+    {
+        // FNV-1a over the bit patterns of the coordinates, to tell if the points changed or were appended to
+        checksum = 14695981039346656037ULL;
+        unsigned long long prefixChecksum = 0;
+        for( size_t i=0 ; i<_pt_data.size() ; i++ )
+        {
+            if( i == m_warmStart.pointCount ) prefixChecksum = checksum;
+            unsigned int bits;
+            memcpy( &bits, &_pt_data[i], sizeof( bits ) );
+            checksum = ( checksum ^ bits ) * 1099511628211ULL;
+        }
+        warmStart = warmStartCompatible( _pt_data, checksum, prefixChecksum, appended );
+        m_warmStart.valid = false;
+
+        // Keep the nodes where they were, so that the previous coefficients match them
+        if( warmStart )
+        {
+            _tree.setFrame( m_warmStart.frameOrigin, m_warmStart.frameScale );
+            if( appended )
+            {
+                DumpOutput( "Inserting %d points into the previous tree\n" , int( ( _pt_data.size() - m_warmStart.pointCount ) / 6 ) );
+
+                // The next append is checked against all points of the tree
+                for( size_t i=m_warmStart.pointCount ; i+2<_pt_data.size() ; i+=6 )
+                    for( int j=0 ; j<3 ; j++ )
+                    {
+                        m_warmStart.boxMin[j] = std::min< Real >( m_warmStart.boxMin[j], _pt_data[i+j] );
+                        m_warmStart.boxMax[j] = std::max< Real >( m_warmStart.boxMax[j], _pt_data[i+j] );
+                    }
+            }
+        }
+        else
+        {
+            for( size_t i=0 ; i+2<_pt_data.size() ; i+=6 )
+                for( int j=0 ; j<3 ; j++ )
+                {
+                    if( !i || _pt_data[i+j] < m_warmStart.boxMin[j] ) m_warmStart.boxMin[j] = _pt_data[i+j];
+                    if( !i || _pt_data[i+j] > m_warmStart.boxMax[j] ) m_warmStart.boxMax[j] = _pt_data[i+j];
+                }
+        }
+    }
+    else m_warmStart = WarmStartData();
+    m_warmStarted = warmStart;
+
+    if( m_allocator )
+    {
+        // Reuse the nodes of the previous job of this batch worker. The
+        // allocator has to be current while rolling back, otherwise the node
+        // destructors would free children that live in the pool.
+        TreeOctNode::SetThreadAllocator( m_allocator );
+        m_allocator->rollBack();
+    }
+    else TreeOctNode::SetAllocator( MEMORY_ALLOCATOR_BLOCK_SIZE );
+    if( m_previewCallback && !m_parameter.PreviewDepths.empty() )
+    {
+        m_previewTree = &_tree;
+        _tree.depthSolvedCallback = &PoissonReconstructionT::template depthSolved< Degree >;
+        _tree.depthSolvedUserData = this;
+    }
+    if( m_parameter.UseROI ) _tree.setROI( m_parameter.ROIMin , m_parameter.ROIMax , m_parameter.ROIMargin , m_parameter.ROICoarsening );
 
-    std::cerr << "Tree construction with depth " << m_parameter.Depth << std::endl;
-    tree.setBSplineData( m_parameter.Depth );
+    if( m_parameter.Verbose ) std::cerr << "Tree construction with depth " << m_parameter.Depth << std::endl;
+    _tree.setBSplineData( m_parameter.Depth );
     double maxMemoryUsage;
-    tree.maxMemoryUsage=0;
+    _tree.maxMemoryUsage=0;
     XForm4x4< Real > xForm = XForm4x4< Real >::Identity();
-    int pointCount = tree.setTreeMemory( _pt_data ,  m_parameter.Depth ,  m_parameter.MinDepth , m_parameter.Depth , Real(m_parameter.SamplesPerNode),
+    int pointCount = _tree.setTreeMemory( _pt_data ,  m_parameter.Depth ,  m_parameter.MinDepth , m_parameter.Depth , Real(m_parameter.SamplesPerNode),
                                          m_parameter.Scale , m_parameter.Confidence , m_parameter.PointWeight , m_parameter.AdaptiveExponent , xForm );
 
     if (pointCount <= 0)
@@ -57,29 +292,126 @@ run( std::vector< Real >& _pt_data, MeshT& _mesh, const Parameter& _parameter )
       return false;
     }
 
-    std::cerr << "Tree Clipping" << std::endl;
+    if( m_parameter.Verbose ) std::cerr << "Tree Clipping" << std::endl;
 
-    tree.ClipTree();
+    double time = Time();
+    _tree.ClipTree();
+    DumpOutput( "Time for clipping: %f\n" , Time()-time );
 
-    std::cerr << "Tree Finalize" << std::endl;
-    tree.finalize( m_parameter.IsoDivide );
+    if( m_parameter.Verbose ) std::cerr << "Tree Finalize" << std::endl;
+    time = Time();
+    _tree.finalize( m_parameter.IsoDivide );
+    DumpOutput( "Time for finalize: %f\n" , Time()-time );
 
     DumpOutput( "Input Points: %d\n" , pointCount );
-    DumpOutput( "Leaves/Nodes: %d/%d\n" , tree.tree.leaves() , tree.tree.nodes() );
+    DumpOutput( "Leaves/Nodes: %lld/%lld\n" , (long long)_tree.tree.leaves() , (long long)_tree.tree.nodes() );
     DumpOutput( "Memory Usage: %.3f MB\n" , float( MemoryInfo::Usage() )/(1<<20) );
 
-    maxMemoryUsage = tree.maxMemoryUsage;
-    tree.maxMemoryUsage=0;
-    tree.SetLaplacianConstraints();
+    maxMemoryUsage = _tree.maxMemoryUsage;
+    _tree.maxMemoryUsage=0;
+    std::vector< long long > keys;
+    if( m_parameter.WarmStart ) _tree.getNodeKeys( keys );
+    // The constraints only depend on the splatted normals, which PointWeight and AdaptiveExponent do not change
+    if( warmStart && m_parameter.Confidence == m_warmStart.parameter.Confidence && keys == m_warmStart.keys )
+    {
+        _tree.SetLaplacianConstraints( m_warmStart.constraints );
+        DumpOutput( "Reused constraints of the previous solve\n" );
+    }
+    else
+    {
+        _tree.SetLaplacianConstraints();
+        if( m_parameter.WarmStart ) _tree.getConstraints( m_warmStart.constraints );
+    }
+    if( warmStart ) _tree.setSolution( m_warmStart.keys, m_warmStart.solution );
     DumpOutput( "Memory Usage: %.3f MB\n" , float( MemoryInfo::Usage())/(1<<20) );
-    maxMemoryUsage = std::max< double >( maxMemoryUsage , tree.maxMemoryUsage );
+    maxMemoryUsage = std::max< double >( maxMemoryUsage , _tree.maxMemoryUsage );
 
-    tree.maxMemoryUsage=0;
-    tree.LaplacianMatrixIteration( m_parameter.SolverDivide, m_parameter.ShowResidual, m_parameter.MinIters, m_parameter.SolverAccuracy, m_parameter.Depth, m_parameter.FixedIters );
+    _tree.maxMemoryUsage=0;
+    int iterations = _tree.LaplacianMatrixIteration( m_parameter.SolverDivide, m_parameter.ShowResidual, m_parameter.MinIters, m_parameter.SolverAccuracy, m_parameter.Depth, m_parameter.FixedIters );
+    m_previewTree = 0;
+    m_solverStatistics = _tree.solverStatistics();
+    if (iterations < 0)
+    {
+      std::cerr << "Reconstruction aborted" << std::endl;
+      return false;
+    }
     DumpOutput( "Memory Usage: %.3f MB\n" , float( MemoryInfo::Usage() )/(1<<20) );
-    maxMemoryUsage = std::max< double >( maxMemoryUsage , tree.maxMemoryUsage );
+    maxMemoryUsage = std::max< double >( maxMemoryUsage , _tree.maxMemoryUsage );
+
+    if( m_parameter.WarmStart )
+    {
+        m_warmStart.parameter = m_parameter;
+        m_warmStart.pointCount = _pt_data.size();
+        m_warmStart.pointChecksum = checksum;
+        _tree.getFrame( m_warmStart.frameOrigin, m_warmStart.frameScale );
+        _tree.getBounds( m_warmStart.boundsMin, m_warmStart.boundsMax );
+        m_warmStart.keys.swap( keys );
+        _tree.getSolution( m_warmStart.solution );
+        m_warmStart.valid = true;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+template <class MeshT>
+bool
+PoissonReconstructionT<MeshT>::
+warmStartCompatible( const std::vector< Real >& _pt_data, unsigned long long _checksum, unsigned long long _prefixChecksum, bool& _appended ) const
+{
+    const Parameter& previous = m_warmStart.parameter;
+    if( !m_warmStart.valid || m_warmStart.pointCount > _pt_data.size() )
+      return false;
+
+    _appended = m_warmStart.pointCount < _pt_data.size();
+    if( m_warmStart.pointChecksum != ( _appended ? _prefixChecksum : _checksum ) )
+      return false;
+
+    if( previous.Depth != m_parameter.Depth || previous.MinDepth != m_parameter.MinDepth ||
+        previous.SamplesPerNode != m_parameter.SamplesPerNode || previous.Scale != m_parameter.Scale || previous.UseROI != m_parameter.UseROI )
+      return false;
+
+    if( m_parameter.UseROI )
+    {
+        if( previous.ROIMargin != m_parameter.ROIMargin || previous.ROICoarsening != m_parameter.ROICoarsening )
+          return false;
+        for( int i=0 ; i<3 ; i++ )
+            if( previous.ROIMin[i] != m_parameter.ROIMin[i] || previous.ROIMax[i] != m_parameter.ROIMax[i] )
+              return false;
+    }
+
+    // The appended points have to lie within the margin that Scale leaves around the previous points, and inside
+    // the bounds of the retained frame, as the octree drops points outside of them
+    if( _appended )
+    {
+        Real extent = 0;
+        for( int j=0 ; j<3 ; j++ ) extent = std::max< Real >( extent, m_warmStart.boxMax[j] - m_warmStart.boxMin[j] );
+        Real pad = extent * ( m_parameter.Scale - Real(1) ) / 2;
+        for( size_t i=m_warmStart.pointCount ; i+2<_pt_data.size() ; i+=6 )
+            for( int j=0 ; j<3 ; j++ )
+                if( _pt_data[i+j] < std::max< Real >( m_warmStart.boxMin[j] - pad, m_warmStart.boundsMin[j] ) ||
+                    _pt_data[i+j] > std::min< Real >( m_warmStart.boxMax[j] + pad, m_warmStart.boundsMax[j] ) )
+                  return false;
+    }
+
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+
+template <class MeshT>
+template< int Degree >
+bool
+PoissonReconstructionT<MeshT>::
+reconstruct( std::vector< Real >& _pt_data, CoredMeshData& _coredMesh )
+{
+    Real isoValue = 0;
+
+    Octree< Degree > tree;
+    if( !solveTree( tree, _pt_data ) )
+      return false;
 
-    CoredFileMeshData mesh;
     if( m_parameter.Verbose ) tree.maxMemoryUsage=0;
     double time=Time();
     isoValue = tree.GetIsoValue();
@@ -87,66 +419,179 @@ run( std::vector< Real >& _pt_data, MeshT& _mesh, const Parameter& _parameter )
     DumpOutput( "Iso-Value: %e\n" , isoValue );
 
     tree.maxMemoryUsage = 0;
-    tree.GetMCIsoTriangles( isoValue , m_parameter.IsoDivide , &mesh );
-
-    _mesh.clear();
-    mesh.resetIterator();
+    if( m_parameter.DecimationTolerance > 0 )
+    {
+        CoredMeshDecimator decimator( &_coredMesh , m_parameter.DecimationTolerance * tree.cellWidth( m_parameter.Depth ) );
+        tree.GetMCIsoTriangles( isoValue , m_parameter.IsoDivide , &decimator );
+        decimator.finish();
+        DumpOutput( "Decimated triangles: %lld -> %lld\n" , (long long)decimator.polygonCount() , (long long)_coredMesh.polygonCount() );
+    }
+    else tree.GetMCIsoTriangles( isoValue , m_parameter.IsoDivide , &_coredMesh );
 
     DumpOutput( "Time for Iso: %f\n" , Time()-time );
 
+    return true;
+}
 
+//-----------------------------------------------------------------------------
 
+template <class MeshT>
+template< int Degree >
+bool
+PoissonReconstructionT<MeshT>::
+reconstructVolume( std::vector< Real >& _pt_data, const std::string& _filename, int _depth )
+{
+    Octree< Degree > tree;
+    if( !solveTree( tree, _pt_data ) )
+      return false;
 
+    double time=Time();
+    Real isoValue = tree.GetIsoValue();
+    int res;
+    Pointer( Real ) values = tree.GetSolutionGrid( res , isoValue , _depth );
+    DumpOutput( "Time for %d^3 grid: %f\n" , res , Time()-time );
+
+    Point3D< Real > origin;
+    Real spacing;
+    tree.GetSolutionGridFrame( res , origin , spacing );
+
+    // The samples go to a raw file, described by a MetaImage header next to it
+    std::string base = _filename.substr( 0, std::min( _filename.rfind( '.' ), _filename.size() ) );
+    std::string header = base + ".mhd";
+    std::string data = _filename;
+    if( data == header ) data = base + ".raw";
+
+    FILE* fp = fopen( data.c_str(), "wb" );
+    bool success = fp != 0;
+    if( fp )
+    {
+        for( int z=0 ; z<res && success ; z++ )
+            success = fwrite( values + size_t(z)*res*res , sizeof( Real ) , size_t(res)*res , fp ) == size_t(res)*res;
+        if( fclose( fp ) ) success = false;
+    }
+    DeletePointer( values );
 
+    fp = success ? fopen( header.c_str(), "w" ) : 0;
+    if( fp )
+    {
+        const int one = 1;
+        fprintf( fp , "ObjectType = Image\nNDims = 3\n" );
+        fprintf( fp , "DimSize = %d %d %d\n" , res , res , res );
+        fprintf( fp , "ElementSpacing = %g %g %g\n" , spacing , spacing , spacing );
+        fprintf( fp , "Offset = %g %g %g\n" , origin[0] , origin[1] , origin[2] );
+        fprintf( fp , "ElementType = MET_FLOAT\nElementByteOrderMSB = %s\n" , *( (const char*)&one ) ? "False" : "True" );
+        fprintf( fp , "ElementDataFile = %s\n" , data.substr( data.find_last_of( "/\\" ) + 1 ).c_str() );
+        if( fclose( fp ) ) success = false;
+    }
+    else success = false;
 
+    if( !success ) std::cerr << "Unable to write the volume " << _filename << std::endl;
+    return success;
+}
 
+//-----------------------------------------------------------------------------
 
+template <class MeshT>
+template< int Degree >
+bool
+PoissonReconstructionT<MeshT>::
+depthSolved( int _depth, void* _reconstruction )
+{
+    PoissonReconstructionT<MeshT>* reconstruction = static_cast< PoissonReconstructionT<MeshT>* >( _reconstruction );
+    const std::vector< int >& depths = reconstruction->m_parameter.PreviewDepths;
+    if( std::find( depths.begin(), depths.end(), _depth ) == depths.end() )
+      return true;
 
+    Octree< Degree >* tree = static_cast< Octree< Degree >* >( reconstruction->m_previewTree );
 
+    double time=Time();
+    CoredVectorMeshData mesh;
+    tree->GetSolutionGridIsoTriangles( _depth , &mesh );
+    DumpOutput( "Time for preview at depth %d: %f\n" , _depth , Time()-time );
 
-//    int nr_vertices=int(mesh.outOfCorePointCount()+mesh.inCorePoints.size());
-    int nr_faces=mesh.polygonCount();
+    MeshT previewMesh;
+    reconstruction->copyMesh( mesh, previewMesh, false );
 
-    mesh.resetIterator();
+    return reconstruction->m_previewCallback->preview( _depth, previewMesh );
+}
 
-    //
-    // describe vertex and face properties
-    //
+//-----------------------------------------------------------------------------
+
+template <class MeshT>
+void
+PoissonReconstructionT<MeshT>::
+copyMesh( CoredMeshData& _coredMesh, MeshT& _mesh, bool _referencedOnly )
+{
+    _mesh.clear();
+
+    node_index_type nr_faces=_coredMesh.polygonCount();
+
+    _coredMesh.resetIterator();
+
+    // In ROI mode, roots computed around the box are not necessarily used by a triangle inside it.
+    // There the faces are scanned first and only the referenced vertices are added.
+    // The cored indices may be 64 bit (BIG_DATA), the handles of the target mesh are not
+    node_index_type inCoreCount = node_index_type( _coredMesh.inCorePoints.size() );
+    std::vector< int > vertexMap( inCoreCount + _coredMesh.outOfCorePointCount() , _referencedOnly ? -1 : 0 );
+    std::vector< CoredVertexIndex > polygon;
+    if( _referencedOnly )
+    {
+        for( node_index_type i=0 ; i<nr_faces ; i++ )
+        {
+            _coredMesh.nextPolygon( polygon );
+            for( int j=0 ; j<int( polygon.size() ) ; j++ )
+                vertexMap[ polygon[j].inCore ? polygon[j].idx : polygon[j].idx + inCoreCount ] = 0;
+        }
+        _coredMesh.resetIterator();
+    }
 
     // write vertices
-    Point3D< float > p;
-    for( int i=0 ; i < int( mesh.inCorePoints.size() ) ; i++ )
+    bool normals = _coredMesh.storeNormals && _mesh.has_vertex_normals();
+    Point3D< float > p, n;
+    int vertexCount = 0;
+    for( node_index_type i=0 ; i < inCoreCount ; i++ )
     {
-        p = mesh.inCorePoints[i];
-        _mesh.add_vertex( typename MeshT::Point(p[0],p[1],p[2]) );
+        if( vertexMap[i]<0 ) continue;
+        p = _coredMesh.inCorePoints[i];
+        typename MeshT::VertexHandle vh = _mesh.add_vertex( typename MeshT::Point(p[0],p[1],p[2]) );
+        if( normals )
+        {
+            n = _coredMesh.inCoreNormals[i];
+            _mesh.set_normal( vh, typename MeshT::Normal(n[0],n[1],n[2]) );
+        }
+        vertexMap[i] = vertexCount++;
     }
-    for( int i=0; i<mesh.outOfCorePointCount() ; i++ )
+    for( node_index_type i=0; i<_coredMesh.outOfCorePointCount() ; i++ )
     {
-        mesh.nextOutOfCorePoint(p);
-        _mesh.add_vertex( typename MeshT::Point(p[0],p[1],p[2]) );
+        _coredMesh.nextOutOfCorePoint(p, n);
+        if( vertexMap[ i + inCoreCount ]<0 ) continue;
+        typename MeshT::VertexHandle vh = _mesh.add_vertex( typename MeshT::Point(p[0],p[1],p[2]) );
+        if( normals )
+          _mesh.set_normal( vh, typename MeshT::Normal(n[0],n[1],n[2]) );
+        vertexMap[ i + inCoreCount ] = vertexCount++;
 
     }  // for, write vertices
 
     // write faces
-    std::vector< CoredVertexIndex > polygon;
-    for( int i=0 ; i<nr_faces ; i++ )
+    for( node_index_type i=0 ; i<nr_faces ; i++ )
     {
         //
         // create and fill a struct that the ply code can handle
         //
-        mesh.nextPolygon( polygon );
+        _coredMesh.nextPolygon( polygon );
         std::vector< typename MeshT::VertexHandle > face;
         for( int i=0 ; i<int( polygon.size() ) ; i++ )
-            if( polygon[i].inCore ) face.push_back( _mesh.vertex_handle( polygon[i].idx ) );
-            else                    face.push_back( _mesh.vertex_handle( polygon[i].idx + int( mesh.inCorePoints.size() ) ) );
+            if( polygon[i].inCore ) face.push_back( _mesh.vertex_handle( vertexMap[ polygon[i].idx ] ) );
+            else                    face.push_back( _mesh.vertex_handle( vertexMap[ polygon[i].idx + inCoreCount ] ) );
 
         _mesh.add_face( face );
 
     }  // for, write faces
 
-    _mesh.update_normals();
-
-    return true;
+    if( !normals )
+      _mesh.update_normals();
+    else if( _mesh.has_face_normals() )
+      _mesh.update_face_normals();
 }
 
 //-----------------------------------------------------------------------------
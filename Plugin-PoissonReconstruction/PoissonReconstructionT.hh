@@ -25,6 +25,12 @@
 #include <omp.h>
 #endif
 
+#include <vector>
+#include <string>
+#include <cctype>
+#include <cstring>
+#include <algorithm>
+
 #include "PoissonReconstruction/Time.h"
 #include "PoissonReconstruction/MarchingCubes.h"
 #include "PoissonReconstruction/Octree.h"
@@ -32,6 +38,7 @@
 #include "PoissonReconstruction/PPolynomial.h"
 #include "PoissonReconstruction/MemoryUsage.h"
 #include "PoissonReconstruction/MultiGridOctreeData.h"
+#include "PoissonReconstruction/CoredMeshDecimator.h"
 
 
 //== FORWARDDECLARATIONS ======================================================
@@ -58,7 +65,7 @@ class PoissonReconstructionT
 public:
 
     /// Constructor
-    PoissonReconstructionT() {}
+    PoissonReconstructionT() : m_previewCallback(0), m_previewTree(0), m_allocator(0), m_warmStarted(false) {}
 
     /// Destructor
     ~PoissonReconstructionT() {}
@@ -79,7 +86,15 @@ public:
             MinIters(24),
             SolverAccuracy(float(1e-3)),
             FixedIters(-1),
-            Verbose(true){}
+            Verbose(true),
+            Threads(0),
+            Deterministic(false),
+            AdaptiveConvergence(false),
+            UseROI(false),
+            ROIMargin(0.1f),
+            ROICoarsening(2),
+            DecimationTolerance(0),
+            WarmStart(false){}
 
 
         int Depth;
@@ -90,21 +105,164 @@ public:
         Real PointWeight;
         int AdaptiveExponent;
         Real IsoDivide; // = 0
-        int SolverDivide;
+        int SolverDivide; // finer depths are solved in sub-domains, one per node of this depth, several at a time
         bool ShowResidual;
         int MinIters;
         double SolverAccuracy;
         int FixedIters;
         bool Verbose;
+        int Threads; // threads used by the octree solver, 0 uses all processors
+        bool Deterministic; // if set, the result is bit-for-bit the same for any number of threads
+
+        // If set, the solver accuracy of each depth follows its node width: SolverAccuracy applies to the finest depth and
+        // every coarser depth may be solved twice as coarsely. A depth stops early when its residual stagnates and may take
+        // up to twice its nominal iterations (see MinIters) while the residual keeps dropping.
+        bool AdaptiveConvergence;
+
+        // Region of interest: if UseROI is set, only the box [ROIMin,ROIMax] is reconstructed at full depth.
+        // Points within ROIMargin (relative to the largest box extent) around the box are kept at
+        // ROICoarsening levels below Depth to provide boundary conditions, all other points are culled.
+        bool UseROI;
+        Point3D< Real > ROIMin;
+        Point3D< Real > ROIMax;
+        Real ROIMargin;
+        int ROICoarsening;
+
+        // Depths after which a preview mesh is extracted from the partial solution and passed to the preview
+        // callback. The preview samples the solution on a dense (2^depth)^3 grid, so keep these depths moderate.
+        std::vector< int > PreviewDepths;
+
+        // If positive, the triangles of every iso-subtree (see IsoDivide) are simplified before they are passed on,
+        // as long as they stay within this distance, in widths of the finest octree cells, from the extracted surface.
+        Real DecimationTolerance;
+
+        // If set, the octree coefficients are kept after the run. A following run of the same object on the same points with
+        // the same tree parameters (Depth, MinDepth, SamplesPerNode, Scale and the region of interest) starts the solver
+        // from them, and if only PointWeight or AdaptiveExponent changed, the constraints are reused as well.
+        // Points appended to those of the previous run (see addPoints) are inserted into the octree of that run, as long
+        // as they lie within the bounding box of its points padded according to Scale and inside its frame; otherwise the
+        // octree is fitted anew. The plugin reconstructs every call from scratch, so this is only available through the API.
+        bool WarmStart;
+
+    };
 
+    /// Receives the preview meshes requested via Parameter::PreviewDepths
+    class PreviewCallback
+    {
+    public:
+        virtual ~PreviewCallback() {}
+
+        /// Called with the mesh of the solution up to _depth. Return false to abort the reconstruction.
+        virtual bool preview( int _depth, MeshT& _mesh ) = 0;
     };
 
     bool run( std::vector< Real >& _pt_data, MeshT& _mesh, const Parameter& _parameter );
 
+    /** Reconstructs the surface directly into a file without building a mesh.
+     *
+     * Files ending in .obj are written as OBJ, all others as binary PLY. The triangles are streamed to
+     * the file while they are extracted, so memory does not grow with the size of the output.
+     */
+    bool run( std::vector< Real >& _pt_data, const std::string& _filename, const Parameter& _parameter );
+
+    /** Solves for the indicator function and samples it on a regular (2^_depth)^3 grid instead of extracting a surface.
+     *
+     * The samples, with the iso-value subtracted so that the surface is their zero level and the inside is positive, are written as raw floats
+     * (x fastest) to _filename, and a MetaImage header (.mhd) with the grid position next to it. _depth<=0 uses
+     * the octree depth.
+     */
+    bool runVolume( std::vector< Real >& _pt_data, const std::string& _filename, const Parameter& _parameter, int _depth = -1 );
+
+    /** Appends the oriented points _points (same layout as _pt_data) to the points _pt_data of the previous run and
+     * reconstructs _mesh from all of them, warm-started from the previous solve (see Parameter::WarmStart). Uses the
+     * parameters of the previous run.
+     */
+    bool addPoints( std::vector< Real >& _pt_data, const std::vector< Real >& _points, MeshT& _mesh );
+
+    /// True if the last solve started from the coefficients of the previous run, see Parameter::WarmStart
+    bool warmStarted() const { return m_warmStarted; }
+
+    /// Residuals and iterations of every depth of the last solve, coarsest first
+    const std::vector< SolverDepthStatistics >& solverStatistics() const { return m_solverStatistics; }
+
+    /// Sets the receiver of preview meshes, 0 disables previews
+    void setPreviewCallback( PreviewCallback* _callback ) { m_previewCallback = _callback; }
+
+    /** Reconstructs every point set of _pt_data independently into the corresponding mesh of _meshes.
+     *
+     * Up to _maxJobs reconstructions (0: one per processor) run concurrently, each of them single threaded.
+     * Every concurrent job owns a node allocator that is reused by the following jobs, so the memory held
+     * at once is bounded by the number of concurrent jobs. Previews are not supported in batch mode.
+     *
+     * @return success flag of every job
+     */
+    static std::vector< bool > runBatch( std::vector< std::vector< Real > >& _pt_data, const std::vector< MeshT* >& _meshes,
+                                         const Parameter& _parameter, int _maxJobs = 0 );
+
 private:
 
+    /// Solver hook extracting a preview mesh after the depths listed in Parameter::PreviewDepths
+    template< int Degree >
+    static bool depthSolved( int _depth, void* _reconstruction );
+
+    /// Copies the extracted surface into the mesh, optionally only the vertices referenced by a face
+    void copyMesh( CoredMeshData& _coredMesh, MeshT& _mesh, bool _referencedOnly );
+
+    /// Runs the reconstruction with quadratic B-splines, the only degree the octree solver supports; the surface is passed to _coredMesh
+    bool solve( std::vector< Real >& _pt_data, CoredMeshData& _coredMesh );
+
+    /// Frees the cached B-spline tables once the tree is gone, so that they do not outlive the reconstruction
+    void releaseTables();
+
+    /// Builds the octree from the points and solves for the indicator function
+    template< int Degree >
+    bool solveTree( Octree< Degree >& _tree, std::vector< Real >& _pt_data );
+
+    /// Runs the reconstruction with B-splines of the given degree
+    template< int Degree >
+    bool reconstruct( std::vector< Real >& _pt_data, CoredMeshData& _coredMesh );
+
+    /// Runs the reconstruction and writes the sampled indicator function, see runVolume
+    template< int Degree >
+    bool reconstructVolume( std::vector< Real >& _pt_data, const std::string& _filename, int _depth );
+
     Parameter m_parameter;
 
+    PreviewCallback* m_previewCallback;
+
+    /// Octree of the running reconstruction, used by depthSolved
+    void* m_previewTree;
+
+    std::vector< SolverDepthStatistics > m_solverStatistics;
+
+    /// Node allocator of a batch job, 0 uses the process-wide allocator
+    AllocatorT< TreeOctNode >* m_allocator;
+
+    /// Solve retained for Parameter::WarmStart
+    struct WarmStartData
+    {
+        WarmStartData() : valid(false), pointCount(0), pointChecksum(0), frameScale(0) {}
+
+        bool valid;
+        Parameter parameter;
+        std::vector< Real >::size_type pointCount;
+        unsigned long long pointChecksum;
+        Point3D< Real > frameOrigin, boxMin, boxMax;
+        Point3D< Real > boundsMin, boundsMax; // the octree drops points outside of this box of its frame
+        Real frameScale;
+        std::vector< long long > keys;
+        std::vector< Real > constraints, solution;
+    };
+    WarmStartData m_warmStart;
+
+    /// Set if the last solve started from m_warmStart
+    bool m_warmStarted;
+
+    /** Checks if the retained solve was computed for the same tree and either the same points or the leading
+     * points of _pt_data, given the checksums of all and of the leading points. _appended is set in the second case.
+     */
+    bool warmStartCompatible( const std::vector< Real >& _pt_data, unsigned long long _checksum, unsigned long long _prefixChecksum, bool& _appended ) const;
+
 
 };
 
@@ -0,0 +1,90 @@
+/*===========================================================================*\
+*                                                                            *
+*                              OpenFlipper                                   *
+*      Copyright (C) 2001-2014 by Computer Graphics Group, RWTH Aachen       *
+*                           www.openflipper.org                              *
+*                                                                            *
+*--------------------------------------------------------------------------- *
+*  This file is part of OpenFlipper.                                         *
+*                                                                            *
+*  OpenFlipper is free software: you can redistribute it and/or modify       *
+*  it under the terms of the GNU Lesser General Public License as            *
+*  published by the Free Software Foundation, either version 3 of            *
+*  the License, or (at your option) any later version with the               *
+*  following exceptions:                                                     *
+*                                                                            *
+*  If other files instantiate templates or use macros                        *
+*  or inline functions from this file, or you compile this file and          *
+*  link it with other files to produce an executable, this file does         *
+*  not by itself cause the resulting executable to be covered by the         *
+*  GNU Lesser General Public License. This exception does not however        *
+*  invalidate any other reasons why the executable file might be             *
+*  covered by the GNU Lesser General Public License.                         *
+*                                                                            *
+*  OpenFlipper is distributed in the hope that it will be useful,            *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+*  GNU Lesser General Public License for more details.                       *
+*                                                                            *
+*  You should have received a copy of the GNU LesserGeneral Public           *
+*  License along with OpenFlipper. If not,                                   *
+*  see <http://www.gnu.org/licenses/>.                                       *
+*                                                                            *
+\*===========================================================================*/
+
+
+#include "../PoissonMeshCache.hh"
+
+#include <iostream>
+
+static int failures = 0;
+
+static void check(bool _condition, const char* _description)
+{
+  if ( !_condition )
+  {
+    std::cerr << "FAILED: " << _description << std::endl;
+    ++failures;
+  }
+}
+
+static QByteArray hashChunked(const std::vector< char >& _bytes, size_t _maxChunk)
+{
+  QCryptographicHash hash(QCryptographicHash::Sha1);
+  PoissonMeshCache::addData(hash, &_bytes[0], _bytes.size(), _maxChunk);
+  return hash.result();
+}
+
+int main()
+{
+  // serialized parameters as passed by the plugin
+  const QByteArray parameter("depth 8");
+  const QByteArray otherParameter("depth 9");
+
+  // oriented points: position and normal per point
+  std::vector< float > points(6 * 1000);
+  for ( size_t i = 0; i < points.size(); ++i )
+    points[i] = float(i % 97) * 0.01f;
+
+  std::vector< float > tail(points);
+  tail.back() += 1.0f;
+
+  check(PoissonMeshCache::key(points, parameter) == PoissonMeshCache::key(std::vector< float >(points), parameter),
+        "equal points give equal keys");
+  check(PoissonMeshCache::key(points, parameter) != PoissonMeshCache::key(tail, parameter),
+        "points differing only in the last value give different keys");
+  check(PoissonMeshCache::key(points, parameter) != PoissonMeshCache::key(points, otherParameter),
+        "different parameters give different keys");
+
+  // the bytes after the first chunk must reach the hash, as for inputs above 2 GiB
+  std::vector< char > bytes(1000, 'a');
+  std::vector< char > tailBytes(bytes);
+  tailBytes.back() = 'b';
+
+  check(hashChunked(bytes, 64) == hashChunked(bytes, bytes.size()),
+        "chunked hashing equals hashing in one piece");
+  check(hashChunked(bytes, 64) != hashChunked(tailBytes, 64),
+        "bytes differing only in the last chunk give different hashes");
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,113 @@
+/*===========================================================================*\
+*                                                                            *
+*                              OpenFlipper                                   *
+*      Copyright (C) 2001-2014 by Computer Graphics Group, RWTH Aachen       *
+*                           www.openflipper.org                              *
+*                                                                            *
+*--------------------------------------------------------------------------- *
+*  This file is part of OpenFlipper.                                         *
+*                                                                            *
+*  OpenFlipper is free software: you can redistribute it and/or modify       *
+*  it under the terms of the GNU Lesser General Public License as            *
+*  published by the Free Software Foundation, either version 3 of            *
+*  the License, or (at your option) any later version with the               *
+*  following exceptions:                                                     *
+*                                                                            *
+*  If other files instantiate templates or use macros                        *
+*  or inline functions from this file, or you compile this file and          *
+*  link it with other files to produce an executable, this file does         *
+*  not by itself cause the resulting executable to be covered by the         *
+*  GNU Lesser General Public License. This exception does not however        *
+*  invalidate any other reasons why the executable file might be             *
+*  covered by the GNU Lesser General Public License.                         *
+*                                                                            *
+*  OpenFlipper is distributed in the hope that it will be useful,            *
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+*  GNU Lesser General Public License for more details.                       *
+*                                                                            *
+*  You should have received a copy of the GNU LesserGeneral Public           *
+*  License along with OpenFlipper. If not,                                   *
+*  see <http://www.gnu.org/licenses/>.                                       *
+*                                                                            *
+\*===========================================================================*/
+
+#include <ObjectTypes/TriangleMesh/TriangleMesh.hh>
+
+#include "../PoissonReconstructionT.hh"
+
+#include <cmath>
+#include <iostream>
+
+static int failures = 0;
+
+static void check(bool _condition, const char* _description)
+{
+  if ( !_condition )
+  {
+    std::cerr << "FAILED: " << _description << std::endl;
+    ++failures;
+  }
+}
+
+/// 5x5 points in the plane where coordinate _axis equals _offset, oriented along that axis
+static std::vector< Real > patch(int _axis, Real _offset)
+{
+  std::vector< Real > points;
+  for ( int i = -2; i <= 2; ++i )
+    for ( int j = -2; j <= 2; ++j )
+    {
+      Real p[6] = { 0, 0, 0, 0, 0, 0 };
+      p[_axis] = _offset;
+      p[(_axis + 1) % 3] = Real(0.02) * i;
+      p[(_axis + 2) % 3] = Real(0.02) * j;
+      p[3 + _axis] = 1;
+      points.insert(points.end(), p, p + 6);
+    }
+  return points;
+}
+
+int main()
+{
+  // flat ellipsoid spanning [-1,1] in x and about [-0.3,0.3] in y and z
+  std::vector< Real > points;
+  const int count = 2000;
+  for ( int i = 0; i < count; ++i )
+  {
+    const double theta = M_PI * i / ( count - 1 ), phi = 2.399963 * i;
+    const double x = cos(theta), y = 0.3 * sin(theta) * cos(phi), z = 0.3 * sin(theta) * sin(phi);
+    const double nx = x, ny = y / 0.09, nz = z / 0.09, length = sqrt(nx*nx + ny*ny + nz*nz);
+    points.push_back(Real(x)); points.push_back(Real(y)); points.push_back(Real(z));
+    points.push_back(Real(nx / length)); points.push_back(Real(ny / length)); points.push_back(Real(nz / length));
+  }
+
+  typedef ACG::PoissonReconstructionT< TriMesh > Reconstruction;
+  Reconstruction reconstruction;
+  Reconstruction::Parameter parameter;
+  parameter.Depth = 5;
+  parameter.Verbose = false;
+  parameter.WarmStart = true;
+
+  TriMesh mesh;
+  check(reconstruction.run(points, mesh, parameter), "initial reconstruction");
+  check(!reconstruction.warmStarted(), "the initial reconstruction fits a new tree");
+
+  // within the padded box of the initial points
+  check(reconstruction.addPoints(points, patch(1, Real(0.35)), mesh), "first append");
+  check(reconstruction.warmStarted(), "the first append is inserted into the previous tree");
+
+  // beyond the padded box of the initial points, but within the box padded around the first append
+  check(reconstruction.addPoints(points, patch(1, Real(0.43)), mesh), "second append");
+  check(reconstruction.warmStarted(), "the second append is checked against the points of the first append");
+
+  check(reconstruction.addPoints(points, patch(0, Real(1.08)), mesh), "third append");
+  check(reconstruction.warmStarted(), "the third append lies within the frame of the tree");
+
+  // the padded box grew with the third append, but the points would fall outside the frame of the tree
+  check(reconstruction.addPoints(points, patch(0, Real(1.15)), mesh), "fourth append");
+  check(!reconstruction.warmStarted(), "points outside the frame of the tree fit a new tree");
+
+  check(mesh.n_faces() > 0, "the final reconstruction has faces");
+
+  return failures ? 1 : 0;
+}
@@ -54,10 +54,10 @@
   #include <QtGui>
 #endif
 #include <QVBoxLayout>
-#include <QHash>
 
 
-#include <map>
+#include <algorithm>
+#include <cstring>
 
 #ifdef USE_OPENMP
 #include <omp.h>
@@ -293,6 +293,10 @@ void TangentSpace::computePerVertexTangents( TriMesh* mesh )
   if (!mesh->get_property_handle( vtangentPropHandle, propName_))
     mesh->add_property( vtangentPropHandle, propName_ );
 
+  // compute tbn matrix of each face once instead of once per corner
+  FaceTangentSpaces faceTBN;
+  computeFaceTangentSpaces(mesh, &faceTBN);
+
   const int numVertices = mesh->n_vertices();
 
   // computation can be parallel
@@ -314,10 +318,8 @@ void TangentSpace::computePerVertexTangents( TriMesh* mesh )
     {
       if (!mesh->is_boundary(*voh_it))
       {
-        TriMesh::FaceHandle fh = mesh->face_handle(*voh_it);
-
         TangentBasis triangleTBN;
-        computeWeightedTangentSpace(mesh, *voh_it, &triangleTBN);
+        getWeightedTangentSpace(mesh, faceTBN, *voh_it, &triangleTBN);
 
         averageTBN.add(triangleTBN);
       }
@@ -340,7 +342,7 @@ void TangentSpace::computePerVertexTangents( TriMesh* mesh )
   }
 }
 
-// key for hashtable of smoothing groups
+// key of a smoothing group
 struct TangentSpace_SmoothingGroupKey
 {
   // normal
@@ -348,13 +350,34 @@ struct TangentSpace_SmoothingGroupKey
   // texcoord
   ACG::Vec2f uv;
 
+  // bits of normal and texcoord floats without the high precision mantissa bits
+  uint bits[5];
+
+  TangentSpace_SmoothingGroupKey()
+  {
+  }
+
   TangentSpace_SmoothingGroupKey(const ACG::Vec3f& _n, ACG::Vec2f _uv = ACG::Vec2f(0.0f, 0.0f))
     : n(_n), uv(_uv)
   {
+    for (int i = 0; i < 5; ++i)
+    {
+      // get float from normal/uv, interpret as uint
+      const float f = i < 3 ? n[i] : uv[i - 3];
+      memcpy(bits + i, &f, sizeof(uint));
+
+      // discard high precision mantissa bits
+      bits[i] &= 0xfffffe00;
+    }
   }
 
   bool operator == (const TangentSpace_SmoothingGroupKey& rhs) const
   {
+    // cheap reject, keys only matched with equal coarse bits in the former hashtable lookup
+    for (int i = 0; i < 5; ++i)
+      if (bits[i] != rhs.bits[i])
+        return false;
+
     float cosTheta = n | rhs.n;
 
     if (cosTheta > 0.998f)
@@ -368,38 +391,6 @@ struct TangentSpace_SmoothingGroupKey
   }
 };
 
-uint qHash(const TangentSpace_SmoothingGroupKey& k)
-{
-  // compute hash of each float
-  uint x[5];
-
-  for (int i = 0; i < 5; ++i)
-  {
-    uint u;
-
-    // get float from normal/uv, interpret as uint
-    if (i < 3)
-      u = *reinterpret_cast<const uint*>(k.n.data() + i);
-    else
-      u = *reinterpret_cast<const uint*>(k.uv.data() + i - 3);
-
-    // discard high precision mantissa bits
-    u &= 0xfffffe00;
-
-    x[i] = ::qHash(u);
-  }
-
-  // combine hash values with prime numbers
-  uint p[5] = {439, 3373, 1033, 6673, 53};
-
-  uint result = 0;
-
-  for (int i = 0; i < 5; ++i)
-    result += x[i] * p[i];
-
-  return ((result >> 22) ^ (result >> 11) ^ result);
-}
-
 void TangentSpace::computePerHalfedgeTangents( TriMesh* mesh )
 {
   /* 
@@ -417,195 +408,227 @@ void TangentSpace::computePerHalfedgeTangents( TriMesh* mesh )
   if (!mesh->get_property_handle( htangentPropHandle, propName_))
     mesh->add_property( htangentPropHandle, propName_ );
 
+  // compute tbn matrix of each face once instead of once per corner
+  FaceTangentSpaces faceTBN;
+  computeFaceTangentSpaces(mesh, &faceTBN);
+
   const int numVertices = mesh->n_vertices();
 
+  // scratch buffers of each thread are sized by the max valence, so there is no allocation per vertex
+  int maxValence = 0;
+
+#ifdef  USE_OPENMP
+#pragma omp parallel
+#endif
+  {
+    int threadMaxValence = 0;
+
+#ifdef  USE_OPENMP
+#pragma omp for
+#endif
+    for (int curVertex = 0; curVertex < numVertices; ++curVertex )
+      threadMaxValence = std::max(threadMaxValence, int(mesh->valence(mesh->vertex_handle(curVertex))));
+
+#ifdef  USE_OPENMP
+#pragma omp critical (tangentspace_max_valence)
+#endif
+    maxValence = std::max(maxValence, threadMaxValence);
+  }
+
   // computation can be parallel
 #ifdef  USE_OPENMP
-#pragma omp parallel for
+#pragma omp parallel
 #endif
-  for (int curVertex = 0; curVertex < numVertices; ++curVertex )
   {
-    TriMesh::VertexHandle curVertexHandle = mesh->vertex_handle(curVertex);
+    // incoming halfedges of the current vertex and their smoothing groups
+    std::vector<TriMesh::HalfedgeHandle> Halfedges(maxValence);
+    std::vector<int> SmoothingGroups(maxValence);
 
-    // map from normal,texc combination to first halfedge for that combination
-    QHash<TangentSpace_SmoothingGroupKey, TriMesh::HalfedgeHandle> UniqueNormals;
+    // normal,texc combination of each smoothing group
+    std::vector<TangentSpace_SmoothingGroupKey> UniqueNormals(maxValence);
 
-    // maps from halfedge -> smoothing group
-    std::map<TriMesh::HalfedgeHandle, int> SmoothingGroups;
-    int numNormalGroups = 0;
+    // tangent space per smoothing group
+    //  smoothing group with flipped parity at index: smGroup + numNormalGroups
+    std::vector<TangentBasis> TangentSpaces(maxValence * 2);
 
-    for ( TriMesh::VertexIHalfedgeIter voh_it = mesh->vih_begin(curVertexHandle); voh_it != mesh->vih_end(curVertexHandle); ++voh_it )
+#ifdef  USE_OPENMP
+#pragma omp for
+#endif
+    for (int curVertex = 0; curVertex < numVertices; ++curVertex )
     {
-      // openmesh stores halfedges at boundaries, which do not belong to any face
-      // opposite halfedge should belong to a face, so its fine to skip empty halfedges
-      if ( mesh->is_boundary(*voh_it) )
-        continue; 
+      TriMesh::VertexHandle curVertexHandle = mesh->vertex_handle(curVertex);
 
-      // halfedge normal
-      ACG::Vec3f hn = ACG::Vec3f(mesh->normal(*voh_it)[0], mesh->normal(*voh_it)[1], mesh->normal(*voh_it)[2]);
+      int numHalfedges = 0;
+      int numNormalGroups = 0;
 
-      // halfedge texcoord
-      ACG::Vec2f ht(0.0f, 0.0f);
-
-      if (preserveTextureSeams_)
+      for ( TriMesh::VertexIHalfedgeIter voh_it = mesh->vih_begin(curVertexHandle); voh_it != mesh->vih_end(curVertexHandle); ++voh_it )
       {
-        if (mesh->has_halfedge_texcoords2D())
-          ht = mesh->texcoord2D(*voh_it);
-        else
-          ht = mesh->texcoord2D( mesh->to_vertex_handle(*voh_it) );
-      }
+        const int curHalfedge = numHalfedges++;
+        Halfedges[curHalfedge] = *voh_it;
 
-      TangentSpace_SmoothingGroupKey key(hn, ht);
+        // halfedges without smoothing group fall back to the first group
+        SmoothingGroups[curHalfedge] = 0;
 
-      QHash<TangentSpace_SmoothingGroupKey, TriMesh::HalfedgeHandle>::iterator itNormalGroup = UniqueNormals.find(key);
+        // openmesh stores halfedges at boundaries, which do not belong to any face
+        // opposite halfedge should belong to a face, so its fine to skip empty halfedges
+        if ( mesh->is_boundary(*voh_it) )
+          continue; 
 
-      if (itNormalGroup == UniqueNormals.end())
-      {
-        // normal has not been encountered yet -> new smoothing group
-        SmoothingGroups[*voh_it] = numNormalGroups++; 
-        UniqueNormals[key] = *voh_it;
-      }
-      else
-      {
-        // normal has been references already, use same smoothing group
-        TriMesh::HalfedgeHandle firstHalfedge = *itNormalGroup;
-        SmoothingGroups[*voh_it] = SmoothingGroups[firstHalfedge];
-      }
-    }
+        // halfedge normal
+        ACG::Vec3f hn = ACG::Vec3f(mesh->normal(*voh_it)[0], mesh->normal(*voh_it)[1], mesh->normal(*voh_it)[2]);
 
-    // tangent space per smoothing group
-    //  smoothing group with flipped parity at index: smGroup + numNormalGroups
-    std::vector<TangentBasis> TangentSpaces(numNormalGroups * 2);
+        // halfedge texcoord
+        ACG::Vec2f ht(0.0f, 0.0f);
 
-    // set zero
-    for (size_t i = 0; i < TangentSpaces.size(); ++i)
-      TangentSpaces[i].setZero();
+        if (preserveTextureSeams_)
+        {
+          if (mesh->has_halfedge_texcoords2D())
+            ht = mesh->texcoord2D(*voh_it);
+          else
+            ht = mesh->texcoord2D( mesh->to_vertex_handle(*voh_it) );
+        }
 
-    int numSmoothingGroups = numNormalGroups;
+        TangentSpace_SmoothingGroupKey key(hn, ht);
 
-    for ( TriMesh::VertexIHalfedgeIter voh_it = mesh->vih_begin(curVertexHandle); voh_it != mesh->vih_end(curVertexHandle); ++voh_it )
-    {
-      // skip empty boundary halfedge
-      if (mesh->is_boundary(*voh_it))
-        continue;
+        // linear search, there are at most valence many groups
+        int normalGroup = 0;
+        while (normalGroup < numNormalGroups && !(UniqueNormals[normalGroup] == key))
+          ++normalGroup;
+
+        if (normalGroup == numNormalGroups)
+        {
+          // normal has not been encountered yet -> new smoothing group
+          UniqueNormals[numNormalGroups++] = key;
+        }
 
-      TriMesh::FaceHandle fh = mesh->face_handle(*voh_it);
+        SmoothingGroups[curHalfedge] = normalGroup;
+      }
 
-      // get halfedge normal
-      ACG::Vec3f hn = ACG::Vec3f(mesh->normal(*voh_it)[0], mesh->normal(*voh_it)[1], mesh->normal(*voh_it)[2]);
+      // set zero
+      for (int i = 0; i < numNormalGroups * 2; ++i)
+        TangentSpaces[i].setZero();
 
-      // get smoothing group of current halfedge
-      int smGroup = SmoothingGroups[*voh_it];
+      int numSmoothingGroups = numNormalGroups;
 
-      if (fh == mesh->InvalidFaceHandle)
+      for (int curHalfedge = 0; curHalfedge < numHalfedges; ++curHalfedge)
       {
-        std::cerr << "warning: face_handle invalid for halfedge " << *voh_it << std::endl;
-        continue;
-      }
+        TriMesh::HalfedgeHandle hh = Halfedges[curHalfedge];
 
-      TangentBasis triTbn;
-      computeWeightedTangentSpace(mesh, *voh_it, &triTbn);
+        // skip empty boundary halfedge
+        if (mesh->is_boundary(hh))
+          continue;
 
-      float parity = triTbn.parity;
-      float groupParity = TangentSpaces[smGroup].parity;
+        // get halfedge normal
+        ACG::Vec3f hn = ACG::Vec3f(mesh->normal(hh)[0], mesh->normal(hh)[1], mesh->normal(hh)[2]);
 
+        // get smoothing group of current halfedge
+        int smGroup = SmoothingGroups[curHalfedge];
 
-      if (groupParity == 0.0f || groupParity == parity)
-      {
-        // compute weighted average inside smoothing group
-        TangentSpaces[smGroup].add(triTbn);
-        TangentSpaces[smGroup].parity = parity;
-      }
-      else
-      {
-        // mirrored uv coords
-        // create new smoothing group along seam
+        TangentBasis triTbn;
+        getWeightedTangentSpace(mesh, faceTBN, hh, &triTbn);
+
+        float parity = triTbn.parity;
+        float groupParity = TangentSpaces[smGroup].parity;
 
-        // group id for flipped parity = groupId + numNormalGroups
-        smGroup += numNormalGroups;
-        SmoothingGroups[*voh_it] = smGroup;
 
-        // make sure flipped parity is correct
-        if (TangentSpaces[smGroup].parity == 0.0f)
+        if (groupParity == 0.0f || groupParity == parity)
         {
-          ++numSmoothingGroups;
-          TangentSpaces[smGroup].parity = triTbn.parity;
+          // compute weighted average inside smoothing group
+          TangentSpaces[smGroup].add(triTbn);
+          TangentSpaces[smGroup].parity = parity;
         }
         else
-          assert(TangentSpaces[smGroup].parity == triTbn.parity);
-
-        TangentSpaces[smGroup].add(triTbn);
-      }
-
-      // use precomputed halfedge normal instead of tangent space normal
-      TangentSpaces[smGroup].n = hn;
-    }
+        {
+          // mirrored uv coords
+          // create new smoothing group along seam
 
+          // group id for flipped parity = groupId + numNormalGroups
+          smGroup += numNormalGroups;
+          SmoothingGroups[curHalfedge] = smGroup;
 
-    // orthonormalize 
-    int numTBNMatrices = 0;
+          // make sure flipped parity is correct
+          if (TangentSpaces[smGroup].parity == 0.0f)
+          {
+            ++numSmoothingGroups;
+            TangentSpaces[smGroup].parity = triTbn.parity;
+          }
+          else
+            assert(TangentSpaces[smGroup].parity == triTbn.parity);
 
-    for (size_t i = 0; i < TangentSpaces.size(); ++i)
-    {
-      TangentBasis* tbn = &TangentSpaces[i];
+          TangentSpaces[smGroup].add(triTbn);
+        }
 
-      if (tbn->parity != 0.0f)
-      {
-        tbn->orthonormalize(decompMethod_);
-        ++numTBNMatrices;
+        // use precomputed halfedge normal instead of tangent space normal
+        TangentSpaces[smGroup].n = hn;
       }
-    }
 
-    if (!numTBNMatrices)
-    {
-      std::cerr << "error: could not compute halfedge tangents for vertex " << curVertexHandle << std::endl;
-    }
-    else
-    {
-      if (numTBNMatrices != numSmoothingGroups)
-        std::cerr << "warning: could not compute tangents for all smoothing groups of vertex" << curVertexHandle << std::endl;
 
-      // set per halfedge property
+      // orthonormalize 
+      int numTBNMatrices = 0;
 
-      for ( TriMesh::VertexIHalfedgeIter voh_it = mesh->vih_begin(curVertexHandle); voh_it != mesh->vih_end(curVertexHandle); ++voh_it )
+      for (int i = 0; i < numNormalGroups * 2; ++i)
       {
-        // get matrix in smoothing group of halfedge
-        int smGroup = SmoothingGroups[*voh_it];
-        TangentBasis* tbn = &TangentSpaces[smGroup];
+        TangentBasis* tbn = &TangentSpaces[i];
 
-        if (tbn->parity == 0.0f)
+        if (tbn->parity != 0.0f)
         {
-          // something went wrong, choose matrix from other smoothing group
+          tbn->orthonormalize(decompMethod_);
+          ++numTBNMatrices;
+        }
+      }
 
-          tbn = &TangentSpaces[0];
+      if (!numTBNMatrices)
+      {
+        std::cerr << "error: could not compute halfedge tangents for vertex " << curVertexHandle << std::endl;
+      }
+      else
+      {
+        if (numTBNMatrices != numSmoothingGroups)
+          std::cerr << "warning: could not compute tangents for all smoothing groups of vertex" << curVertexHandle << std::endl;
 
-          while (tbn->parity == 0.0f)
-            ++tbn;
-        }
+        // set per halfedge property
 
-        // update normals after polar decomp
-        if (decompMethod_ == DECOMP_POLAR)
+        for (int curHalfedge = 0; curHalfedge < numHalfedges; ++curHalfedge)
         {
-          if (overwriteVertexNormals_)
-            mesh->set_normal(*voh_it, ACG::Vec3d(tbn->n[0], tbn->n[1], tbn->n[2]));
-          else
+          TriMesh::HalfedgeHandle hh = Halfedges[curHalfedge];
+
+          // get matrix in smoothing group of halfedge
+          int smGroup = SmoothingGroups[curHalfedge];
+          TangentBasis* tbn = &TangentSpaces[smGroup];
+
+          if (tbn->parity == 0.0f)
           {
-            // normal may not be changed, rotate from back to normal
-            ACG::Vec3f storedNormal = ACG::Vec3f(mesh->normal(*voh_it)[0], mesh->normal(*voh_it)[1], mesh->normal(*voh_it)[2]);
+            // something went wrong, choose matrix from other smoothing group
 
-            if (tbn->n != storedNormal)
+            tbn = &TangentSpaces[0];
+
+            while (tbn->parity == 0.0f)
+              ++tbn;
+          }
+
+          // update normals after polar decomp
+          if (decompMethod_ == DECOMP_POLAR)
+          {
+            if (overwriteVertexNormals_)
+              mesh->set_normal(hh, ACG::Vec3d(tbn->n[0], tbn->n[1], tbn->n[2]));
+            else
             {
-              tbn->n = storedNormal;
-              tbn->orthonormalize(DECOMP_HALF_ANGLE);
+              // normal may not be changed, rotate from back to normal
+              ACG::Vec3f storedNormal = ACG::Vec3f(mesh->normal(hh)[0], mesh->normal(hh)[1], mesh->normal(hh)[2]);
+
+              if (tbn->n != storedNormal)
+              {
+                tbn->n = storedNormal;
+                tbn->orthonormalize(DECOMP_HALF_ANGLE);
+              }
             }
           }
-        }
 
-        mesh->property(htangentPropHandle, *voh_it) =  ACG::Vec4f(tbn->t[0], tbn->t[1], tbn->t[2], tbn->parity);
-//        mesh->property(htangentPropHandle, *voh_it) =  ACG::Vec3d(tbn->t[0], tbn->t[1], tbn->t[2]);
+          mesh->property(htangentPropHandle, hh) =  ACG::Vec4f(tbn->t[0], tbn->t[1], tbn->t[2], tbn->parity);
+//          mesh->property(htangentPropHandle, hh) =  ACG::Vec3d(tbn->t[0], tbn->t[1], tbn->t[2]);
+        }
       }
     }
-
   }
 }
 
@@ -746,16 +769,16 @@ float TangentSpace::computeUVArea( TriMesh* _mesh, TriMesh::HalfedgeHandle _h )
 
 
 
-void TangentSpace::computeWeightedTangentSpace( TriMesh* mesh, TriMesh::HalfedgeHandle _h, TangentBasis* _out )
+void TangentSpace::computeWeightedTangentSpace( PolyMesh* mesh, PolyMesh::HalfedgeHandle _h, TangentBasis* _out )
 {
   _out->setZero();
   if (mesh->is_boundary(_h))
     return;
 
-  TriMesh::FaceHandle fh = mesh->face_handle(_h);
+  PolyMesh::FaceHandle fh = mesh->face_handle(_h);
 
   bool weighted = weightByAngle_ || weightByArea_;
-  _out->parity = computeTriTBN(mesh, fh, &_out->t, &_out->b, &_out->n, !weighted);
+  _out->parity = computeFaceTBN(mesh, fh, &_out->t, &_out->b, &_out->n, !weighted);
 
   if (weighted)
   {
@@ -774,9 +797,6 @@ void TangentSpace::computeWeightedTangentSpace( TriMesh* mesh, TriMesh::Halfedge
   if (weightByArea_)
     weight *= mesh->calc_sector_area(_h);  // angle and area equally weighted
 
-  if (weightByUVArea_)
-    weight *= computeUVArea(mesh, _h);
-
 //   if (weight == 0.0f) 
 //     weight = 1.0f; // no weighting
 
@@ -786,40 +806,80 @@ void TangentSpace::computeWeightedTangentSpace( TriMesh* mesh, TriMesh::Halfedge
 }
 
 
-void TangentSpace::computeWeightedTangentSpace( PolyMesh* mesh, PolyMesh::HalfedgeHandle _h, TangentBasis* _out )
+void TangentSpace::computeFaceTangentSpaces( TriMesh* _mesh, FaceTangentSpaces* _out )
 {
-  _out->setZero();
-  if (mesh->is_boundary(_h))
-    return;
+  const int numFaces = _mesh->n_faces();
 
-  PolyMesh::FaceHandle fh = mesh->face_handle(_h);
+  _out->t.resize(numFaces);
+  _out->b.resize(numFaces);
+  _out->n.resize(numFaces);
+  _out->parity.resize(numFaces);
+  _out->weight.assign(_mesh->n_halfedges(), 0.0f);
 
-  bool weighted = weightByAngle_ || weightByArea_;
-  _out->parity = computeFaceTBN(mesh, fh, &_out->t, &_out->b, &_out->n, !weighted);
+  const bool weighted = weightByAngle_ || weightByArea_;
 
-  if (weighted)
+  // each face writes only its own entries and the weights of its own halfedges
+#ifdef  USE_OPENMP
+#pragma omp parallel for
+#endif
+  for ( int curFace = 0; curFace < numFaces; ++curFace )
   {
-    _out->t.normalize();
-    _out->b.normalize();
-    _out->n.normalize();
-  }
+    TriMesh::FaceHandle fh = _mesh->face_handle(curFace);
 
-  float weight = 1.0f;
+    ACG::Vec3f t,b,n;
+    _out->parity[curFace] = computeTriTBN(_mesh, fh, &t, &b, &n, !weighted);
 
-  // weight by inner angle to get tessellation independent tangents
-  if (weightByAngle_)
-    weight *= mesh->calc_sector_angle(_h);
+    if (weighted)
+    {
+      t.normalize();
+      b.normalize();
+      n.normalize();
+    }
 
-  // weight by area to prefer bigger faces over small faces
-  if (weightByArea_)
-    weight *= mesh->calc_sector_area(_h);  // angle and area equally weighted
+    _out->t[curFace] = t;
+    _out->b[curFace] = b;
+    _out->n[curFace] = n;
 
-//   if (weight == 0.0f) 
-//     weight = 1.0f; // no weighting
+    // area of triangle in texture space, shared by all corners
+    float uvArea = 0.0f;
 
-  _out->t *= weight;
-  _out->b *= weight;
-  _out->n *= weight;
+    if (weightByUVArea_)
+      uvArea = computeUVArea(_mesh, _mesh->halfedge_handle(fh));
+
+    // weight by inner angle and area at each corner of the face
+    for (TriMesh::FaceHalfedgeIter fh_it = _mesh->fh_begin(fh) ; fh_it != _mesh->fh_end(fh); ++fh_it)
+    {
+      TriMesh::HalfedgeHandle hh = *fh_it;
+      float weight = 1.0f;
+
+      if (weightByAngle_)
+        weight *= _mesh->calc_sector_angle(hh);
+
+      if (weightByArea_)
+        weight *= _mesh->calc_sector_area(hh);
+
+      if (weightByUVArea_)
+        weight *= uvArea;
+
+      _out->weight[hh.idx()] = weight;
+    }
+  }
+}
+
+
+void TangentSpace::getWeightedTangentSpace( TriMesh* _mesh, const FaceTangentSpaces& _faces, TriMesh::HalfedgeHandle _h, TangentBasis* _out )
+{
+  _out->setZero();
+  if (_mesh->is_boundary(_h))
+    return;
+
+  const int face = _mesh->face_handle(_h).idx();
+  const float weight = _faces.weight[_h.idx()];
+
+  _out->t = _faces.t[face] * weight;
+  _out->b = _faces.b[face] * weight;
+  _out->n = _faces.n[face] * weight;
+  _out->parity = _faces.parity[face];
 }
 
 
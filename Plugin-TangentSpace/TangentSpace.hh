@@ -56,6 +56,7 @@
 #include <QLineEdit>
 
 #include <string>
+#include <vector>
 
 class TangentSpace : public QObject, BaseInterface, ToolboxInterface
 {
@@ -107,6 +108,17 @@ class TangentSpace : public QObject, BaseInterface, ToolboxInterface
       void computeParity();
     };
 
+    // per-face tangent space matrices of a triangle mesh, stored as structure of arrays
+    struct FaceTangentSpaces
+    {
+      // face tbn matrix indexed by face, normalized if weighted by angle or area
+      std::vector<ACG::Vec3f> t, b, n;
+      std::vector<float> parity;
+
+      // weight of the face corner at the to-vertex, indexed by halfedge
+      std::vector<float> weight;
+    };
+
 
     // compute unnormalized triangle tangent, bitangent and normal vector
     //  returns parity
@@ -117,9 +129,14 @@ class TangentSpace : public QObject, BaseInterface, ToolboxInterface
 
 
     // compute tangent matrix of triangle (optionally weighted by angle at incoming halfedge and/or area of triangle)
-    void computeWeightedTangentSpace(TriMesh* mesh, TriMesh::HalfedgeHandle _h, TangentBasis* _out);
     void computeWeightedTangentSpace(PolyMesh* mesh, PolyMesh::HalfedgeHandle _h, TangentBasis* _out);
 
+    // compute tbn matrices and corner weights of all faces once
+    void computeFaceTangentSpaces(TriMesh* _mesh, FaceTangentSpaces* _out);
+
+    // weighted tangent space matrix of the face at halfedge _h from precomputed face data
+    void getWeightedTangentSpace(TriMesh* _mesh, const FaceTangentSpaces& _faces, TriMesh::HalfedgeHandle _h, TangentBasis* _out);
+
     
     // parity of tangent space matrix = sign(det(TBN))
     // returns +1: positive, -1: mirrored